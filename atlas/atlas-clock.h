@@ -5,8 +5,16 @@
 #include <chrono>
 #include <ctime>
 
+#ifdef ATLAS_SIMULATOR
+#include "simulator.h"
+#endif
+
 namespace atlas {
+#ifdef ATLAS_SIMULATOR
+using clock = sim::clock;
+#else
 using clock = std::chrono::steady_clock;
+#endif
 using time_point = clock::time_point;
 }
 
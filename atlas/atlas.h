@@ -19,6 +19,9 @@
 
 #include "atlas-clock.h"
 #include "syscalls.h"
+#ifdef ATLAS_SIMULATOR
+#include "simulator.h"
+#endif
 
 #if defined(__x86_64__)
 #define ARG64(x) x
@@ -36,7 +39,9 @@ extern "C" {
 static inline long atlas_submit(pid_t tid, uint64_t id,
                                 const struct timeval *const exectime,
                                 const struct timeval *const deadline) {
-#if defined(__x86_64__)
+#if defined(ATLAS_SIMULATOR)
+  return atlas_sim_submit(tid, id, exectime, deadline);
+#elif defined(__x86_64__)
   return syscall(SYS_atlas_submit, tid, id, exectime, deadline);
 #elif defined(__arm__)
   return syscall(SYS_atlas_submit, tid, 0, ARG64(id), exectime, deadline);
@@ -44,15 +49,21 @@ static inline long atlas_submit(pid_t tid, uint64_t id,
 }
 
 static inline long atlas_next(uint64_t *next) {
+#ifdef ATLAS_SIMULATOR
+  return atlas_sim_next(next);
+#else
   for(;; ) {
     long ret = syscall(SYS_atlas_next, next);
     if(ret != -1 || errno != EINTR)
       return ret;
   }
+#endif
 }
 
 static inline long atlas_remove(pid_t tid, const uint64_t id) {
-#if defined(__x86_64__)
+#if defined(ATLAS_SIMULATOR)
+  return atlas_sim_remove(tid, id);
+#elif defined(__x86_64__)
   return syscall(SYS_atlas_remove, tid, id);
 #elif defined(__arm__)
   return syscall(SYS_atlas_remove, tid, 0, ARG64(id));
@@ -62,7 +73,9 @@ static inline long atlas_remove(pid_t tid, const uint64_t id) {
 static inline long atlas_update(pid_t tid, uint64_t id,
                                 const struct timeval *const exectime,
                                 const struct timeval *const deadline) {
-#if defined(__x86_64__)
+#if defined(ATLAS_SIMULATOR)
+  return atlas_sim_update(tid, id, exectime, deadline);
+#elif defined(__x86_64__)
   return syscall(SYS_atlas_update, tid, id, exectime, deadline);
 #elif defined(__arm__)
   return syscall(SYS_atlas_update, tid, 0, ARG64(id), exectime, deadline);
@@ -70,22 +83,38 @@ static inline long atlas_update(pid_t tid, uint64_t id,
 }
 
 static inline long atlas_tp_create(uint64_t *id) {
+#ifdef ATLAS_SIMULATOR
+  return atlas_sim_tp_create(id);
+#else
   return syscall(SYS_atlas_tp_create, id);
+#endif
 }
 
 static inline long atlas_tp_destroy(const uint64_t id) {
+#ifdef ATLAS_SIMULATOR
+  return atlas_sim_tp_destroy(id);
+#else
   return syscall(SYS_atlas_tp_destroy, ARG64(id));
+#endif
 }
 
 static inline long atlas_tp_join(const uint64_t id) {
+#ifdef ATLAS_SIMULATOR
+  return atlas_sim_tp_join(id);
+#else
   return syscall(SYS_atlas_tp_join, ARG64(id));
+#endif
 }
 
 static inline long atlas_tp_submit(const uint64_t tpid, const uint64_t id,
                                    const struct timeval *const exectime,
                                    const struct timeval *const deadline) {
+#ifdef ATLAS_SIMULATOR
+  return atlas_sim_tp_submit(tpid, id, exectime, deadline);
+#else
   return syscall(SYS_atlas_tp_submit, ARG64(tpid), ARG64(id), exectime,
                  deadline);
+#endif
 }
 
 #ifdef __cplusplus
@@ -144,10 +173,20 @@ struct timeval to_timeval(const std::chrono::time_point<Clock, Duration> &t) {
 }
 }
 
+/* Sleeps until t on the ATLAS clock, which is virtual with the simulator. */
+template <class Duration>
+void sleep_until(const std::chrono::time_point<clock, Duration> &t) {
+#ifdef ATLAS_SIMULATOR
+  sim::sleep_until(t);
+#else
+  std::this_thread::sleep_until(t);
+#endif
+}
+
 namespace threadpool {
 static inline auto create() {
   uint64_t id;
-  auto ret = syscall(SYS_atlas_tp_create, &id);
+  auto ret = atlas_tp_create(&id);
   if (ret != 0) {
     std::ostringstream os;
     os << "Error creating threadpool (" << errno << "): " << strerror(errno);
@@ -157,18 +196,17 @@ static inline auto create() {
 }
 
 static inline decltype(auto) destroy(const uint64_t id) {
-  return syscall(SYS_atlas_tp_destroy, ARG64(id));
+  return atlas_tp_destroy(id);
 }
 
 static inline decltype(auto) join(const uint64_t id) {
-  return syscall(SYS_atlas_tp_join, ARG64(id));
+  return atlas_tp_join(id);
 }
 
 static inline decltype(auto) submit(const uint64_t tpid, const uint64_t id,
                                     const struct timeval *const exectime,
                                     const struct timeval *const deadline) {
-  return syscall(SYS_atlas_tp_submit, ARG64(tpid), ARG64(id), exectime,
-                 deadline);
+  return atlas_tp_submit(tpid, id, exectime, deadline);
 }
 
 template <class Rep1, class Period1, class Rep2, class Period2>
@@ -177,7 +215,7 @@ decltype(auto) submit(const uint64_t tpid, const uint64_t id,
                       const std::chrono::duration<Rep2, Period2> deadline) {
   struct timeval tv_exectime = to_timeval(exec_time);
   struct timeval tv_deadline =
-      to_timeval(std::chrono::steady_clock::now() + deadline);
+      to_timeval(clock::now() + deadline);
 
   return threadpool::submit(tpid, id, &tv_exectime, &tv_deadline);
 }
@@ -199,7 +237,7 @@ decltype(auto) submit(pid_t tid, uint64_t id,
                       std::chrono::duration<Rep2, Period2> deadline) {
   struct timeval tv_exectime = to_timeval(exec_time);
   struct timeval tv_deadline =
-      to_timeval(std::chrono::steady_clock::now() + deadline);
+      to_timeval(clock::now() + deadline);
 
   return atlas_submit(tid, id, &tv_exectime, &tv_deadline);
 }
@@ -220,7 +258,7 @@ decltype(auto) update(pid_t tid, uint64_t id,
                       std::chrono::duration<Rep2, Period2> deadline) {
   struct timeval tv_exectime = to_timeval(exec_time);
   struct timeval tv_deadline =
-      to_timeval(std::chrono::steady_clock::now() + deadline);
+      to_timeval(clock::now() + deadline);
 
   return atlas_update(tid, id, &tv_exectime, &tv_deadline);
 }
@@ -1,21 +1,55 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 
+/* How late jobs were released after their release time. */
+struct jitter {
+  int64_t releases{0};
+  std::chrono::nanoseconds total{0};
+  std::chrono::nanoseconds max{0};
+
+  void record(const std::chrono::nanoseconds late) {
+    ++releases;
+    total += late;
+    max = std::max(max, late);
+  }
+
+  jitter &operator+=(const jitter &rhs) {
+    releases += rhs.releases;
+    total += rhs.total;
+    max = std::max(max, rhs.max);
+    return *this;
+  }
+
+  /* mean and maximum in us */
+  friend std::ostream &operator<<(std::ostream &os, const jitter &rhs) {
+    using us = std::chrono::duration<double, std::micro>;
+    const auto mean = rhs.releases ? us(rhs.total).count() / rhs.releases : 0.0;
+    return os << mean << " " << us(rhs.max).count();
+  }
+};
+
 struct result {
   int64_t jobs{0};
   int64_t missed{0};
+  /* of the jobs that were run */
+  struct jitter jitter;
 
   result() = default;
   result(int64_t jobs_, int64_t missed_) : jobs(jobs_), missed(missed_) {}
 
   result operator+(const result &rhs) {
-    return result{jobs + rhs.jobs, missed + rhs.missed};
+    result r{*this};
+    return r += rhs;
   }
 
   result &operator+=(const result &rhs) {
     jobs += rhs.jobs;
     missed += rhs.missed;
+    jitter += rhs.jitter;
     return *this;
   }
 
@@ -23,8 +57,6 @@ struct result {
     const auto ratio = double(rhs.missed) / rhs.jobs;
     const auto meta = (rhs.missed == 0) ? 0 : (ratio < 0.01) ? 500 : 1000;
     return os << ratio * 100 << " " << rhs.missed << " " << rhs.jobs << " "
-              << meta;
+              << meta << " " << rhs.jitter;
   }
 };
-
-
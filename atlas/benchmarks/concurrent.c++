@@ -13,8 +13,13 @@
 #include "utils/common.h"
 
 #include "taskgen.h"
+#include "schedulability.h"
+#include "release.h"
 #include "common.h"
 
+#ifdef ATLAS_SIMULATOR
+static auto do_work(const execution_time &e) { atlas::sim::execute(e); }
+#else
 static auto do_work(const execution_time &e) {
   using namespace std::chrono;
   static constexpr execution_time work_unit{100us};
@@ -68,6 +73,7 @@ static auto do_work(const execution_time &e) {
 #endif
 #endif
 }
+#endif
 
 using namespace std::chrono;
 
@@ -83,10 +89,11 @@ class concurrent_queue {
   std::atomic<int64_t> deadline_misses{0};
   std::atomic<uint64_t> init;
   std::atomic<uint64_t> done;
+  jitter release_jitter;
 
   struct task_params {
     nanoseconds e;
-    steady_clock::time_point dl;
+    atlas::time_point dl;
   };
   std::vector<task_params> params;
 
@@ -118,7 +125,7 @@ class concurrent_queue {
       const auto params = reinterpret_cast<task_params *>(id);
       do_work(params->e - 300us);
 #endif
-      if (steady_clock::now() > params->dl)
+      if (atlas::clock::now() > params->dl)
         ++deadline_misses_;
     }
 
@@ -140,9 +147,14 @@ class concurrent_queue {
 public:
   concurrent_queue(const size_t n, U usum, U umax, period p_min, period p_max,
                    const bool exectime = false)
+      : concurrent_queue(generate_taskset(n, usum, umax, p_min, p_max),
+                         exectime) {}
+
+  concurrent_queue(const std::vector<task_attr> &attr,
+                   const bool exectime = false)
       : tp(atlas::threadpool::create()),
         num_threads(exectime ? 1 : std::thread::hardware_concurrency()),
-        tasks(generate_taskset(n, usum, umax, p_min, p_max)),
+        tasks(attr),
         threads(std::make_unique<std::thread[]>(num_threads)),
         hyperperiod(::hyperperiod(tasks)),
         jobs_(std::accumulate(std::begin(tasks), std::end(tasks), int64_t(0),
@@ -170,24 +182,19 @@ public:
     struct result r;
     r.jobs = jobs_;
     r.missed = deadline_misses;
+    r.jitter = release_jitter;
     return r;
   }
 
   void simulate() {
     using namespace std::chrono;
-    struct release {
-      steady_clock::time_point r;
-      task_attr * t;
-      size_t count;
-
-      bool operator<(const release &rhs) { return r < rhs.r; }
-    };
 
 #if 0
     std::cout << "Running simulation for "
               << duration_cast<ms>(hyperperiod).count() << "s" << std::endl;
 #endif
 
+#ifndef ATLAS_SIMULATOR
     {
       struct sched_param param;
       param.sched_priority = sched_get_priority_max(SCHED_FIFO);
@@ -197,39 +204,33 @@ public:
         exit(EXIT_FAILURE);
       }
     }
-    const auto t0 = steady_clock::now();
-
-    std::vector<release> releases(tasks.size());
-    for (size_t i = 0; i < releases.size(); ++i) {
-      auto &release = releases.at(i);
-      auto &task = tasks.at(i);
-
-      release.r = t0;
-      release.t = &task;
-    }
-
-    int64_t job = 0;
-    for (; job < jobs_;) {
-      for (auto &&release : releases) {
-        if (release.r <= steady_clock::now()) {
-          auto dl = release.r + release.t->p;
-          auto &&p = params.at(job);
-          p.e = release.t->e;
+#endif
+    std::vector<int64_t> counts;
+    for (const auto &task : tasks)
+      counts.push_back(hyperperiod / task.p);
+
+    const auto t0 = atlas::clock::now();
+    size_t job = 0;
+    release_jitter = release_engine{}.run(
+        tasks, counts, t0,
+        [this, &job](const size_t i, const int64_t,
+                     const atlas::time_point &r) {
+          const auto &task = tasks.at(i);
+          const auto dl = r + task.p;
+          auto &&p = params.at(job++);
+          p.e = task.e;
           p.dl = dl;
-          atlas::threadpool::submit(tp, reinterpret_cast<uint64_t>(&p),
-                                    release.t->e, dl);
-          release.r = dl;
-          ++release.count;
-          ++job;
-        }
-      }
-
-      std::sort(std::begin(releases), std::end(releases));
-      std::this_thread::sleep_until(releases.front().r);
-    }
+          atlas::threadpool::submit(tp, reinterpret_cast<uint64_t>(&p), task.e,
+                                    dl);
+        });
 
+#ifdef ATLAS_SIMULATOR
+    /* let virtual time advance while joining the workers */
+    atlas::sim::detach();
+#endif
     synchronize_end();
 
+#ifndef ATLAS_SIMULATOR
     {
       /* This seems necessary, since forking from FIFO threads seems broken. */
       struct sched_param param;
@@ -240,6 +241,7 @@ public:
         exit(EXIT_FAILURE);
       }
     }
+#endif
   }
 };
 
@@ -270,20 +272,44 @@ static void find_minimum_e(const size_t count, const period p) {
   }
 }
 
+/* With prefilter, task sets that the global EDF analysis for all cores
+ * decides are not run: those schedulable with overhead added to each job
+ * count as meeting all deadlines, unschedulable ones are left out of the
+ * result. */
 static auto schedulable(const size_t tasks, const U u_sum, const U u_max,
                         const size_t count, const period pmin,
-                        const period pmax) {
+                        const period pmax, const taskgen_options &options,
+                        const bool prefilter = false,
+                        const execution_time overhead = execution_time{0}) {
   using namespace std::chrono;
   result failures;
+  size_t rejected = 0;
+  const auto cores = std::thread::hardware_concurrency();
 
   for (size_t j = 0; j < count; ++j) {
-    concurrent_queue ts(tasks, u_sum, u_max, pmin, pmax);
-    ts.simulate();
-    failures += ts.result();
-    std::cerr << ".";
+    const auto attr =
+        generate_taskset(tasks, u_sum, u_max, pmin, pmax, options);
+    const auto v =
+        prefilter ? analyze(attr, cores, overhead) : verdict::unknown;
+    if (v == verdict::schedulable) {
+      const auto hp = ::hyperperiod(attr);
+      for (const auto &task : attr)
+        failures.jobs += hp / task.p;
+      std::cerr << "+";
+    } else if (v == verdict::unschedulable) {
+      ++rejected;
+      std::cerr << "-";
+    } else {
+      concurrent_queue ts(attr);
+      ts.simulate();
+      failures += ts.result();
+      std::cerr << ".";
+    }
     std::cerr.flush();
   }
   std::cerr << std::endl;
+  if (rejected)
+    std::cerr << rejected << " unschedulable task sets not run." << std::endl;
   return failures;
 }
 
@@ -300,6 +326,9 @@ int main(int argc, char *argv[]) {
   int64_t umax;
   int64_t pmin;
   int64_t pmax;
+  int64_t overhead = 0;
+  int64_t limit;
+  taskgen_options options;
 
   // clang-format off
   desc.add_options()
@@ -317,9 +346,19 @@ int main(int argc, char *argv[]) {
      "Minimum period of any task. (Default: 10ms)")
     ("max-period", po::value(&pmax)->default_value(100),
      "Maximum period of any task. (Default: 100ms)")
+    ("periods", po::value(&options.periods)->default_value(period_mode::cooked),
+     "Period generation: cooked, log-uniform or harmonic. (Default: cooked)")
+    ("utilizations",
+     po::value(&options.utilizations)->default_value(utilization_mode::uunisort),
+     "Utilization generation: uunisort or uunifast. (Default: uunisort)")
+    ("limit", po::value(&limit)->default_value(0),
+     "Limit the hyperperiod to <num> seconds. (Default: 0, off)")
     ("no-preroll", "Disable preroll (Default: on)")
     ("idle-pull", "Enable idle-pull (Default: off)")
-    ("overload-push", "Enable overload-push (Default: off)");
+    ("overload-push", "Enable overload-push (Default: off)")
+    ("prefilter", po::value(&overhead)->implicit_value(300),
+     "Run only task sets the global EDF analysis cannot decide with <us> "
+     "overhead per job. (Default: off, 300us)");
   // clang-format on
 
   po::variables_map vm;
@@ -331,6 +370,8 @@ int main(int argc, char *argv[]) {
     return EXIT_SUCCESS;
   }
 
+  options.limit = s{limit};
+
   set_procfsparam(attribute::job_stealing, vm.count("idle-pull"));
   set_procfsparam(attribute::overload_push, vm.count("overload-push"));
   set_procfsparam(attribute::preroll, !vm.count("no-preroll"));
@@ -356,7 +397,8 @@ int main(int argc, char *argv[]) {
         continue;
       }
       auto failures = schedulable(task, U{usum}, U{umax}, count, period{pmin},
-                                  period{pmax});
+                                  period{pmax}, options, vm.count("prefilter"),
+                                  us{overhead});
       std::cout << double(usum) / 1000.0 << " " << task << " " << failures << std::endl;
       std::cerr << failures << " deadline misses with " << task << " tasks "
                 << std::endl;
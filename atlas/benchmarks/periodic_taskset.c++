@@ -24,6 +24,8 @@
 #include "utils/common.h"
 
 #include "taskgen.h"
+#include "schedulability.h"
+#include "release.h"
 #include "common.h"
 
 #define SCHED_DEADLINE	6
@@ -56,6 +58,9 @@ static decltype(auto) sched_getattr(pid_t pid, struct sched_attr *attr,
   return syscall(__NR_sched_getattr, pid, attr, size, flags);
 }
 
+#ifdef ATLAS_SIMULATOR
+static auto do_work(const execution_time &e) { atlas::sim::execute(e); }
+#else
 static auto do_work(const execution_time &e) {
   using namespace std::chrono;
   static constexpr execution_time work_unit{100us};
@@ -109,6 +114,7 @@ static auto do_work(const execution_time &e) {
 #endif
 #endif
 }
+#endif
 
 class periodic_taskset {
   struct task {
@@ -119,12 +125,12 @@ class periodic_taskset {
     mutable std::mutex lock;
     mutable std::condition_variable cv;
     mutable uint64_t count = 0;
-    mutable std::chrono::steady_clock::time_point deadline;
+    mutable atlas::time_point deadline;
     bool edf;
     mutable std::atomic_bool init{false};
     mutable std::atomic_bool done{false};
 
-    auto submit(uint64_t id, std::chrono::steady_clock::time_point d) const {
+    auto submit(uint64_t id, atlas::time_point d) const {
       auto dl = d + attr.p;
 
       if (!edf) {
@@ -139,7 +145,7 @@ class periodic_taskset {
 
     auto next_edf() const {
       using namespace std::chrono;
-      steady_clock::time_point dl;
+      atlas::time_point dl;
 
       {
         std::unique_lock<std::mutex> l(lock);
@@ -154,27 +160,39 @@ class periodic_taskset {
       do_work(1ms);
 #endif
 
-      return std::chrono::steady_clock::now() > dl;
+      return atlas::clock::now() > dl;
     }
 
     auto next_atlas() const {
       using namespace std::chrono;
       uint64_t id;
-      steady_clock::time_point dl;
+      atlas::time_point dl;
 
+#ifdef ATLAS_SIMULATOR
+      /* wait in the simulator, so virtual time advances */
+      while (atlas::next(id) != 1)
+        ;
+      {
+        std::unique_lock<std::mutex> l(lock);
+        cv.wait(l, [this] { return count; });
+        --count;
+        dl = deadline;
+      }
+#else
       {
         std::unique_lock<std::mutex> l(lock);
         cv.wait(l, [&id] { return atlas::next(id) != 0; });
         --count;
         dl = deadline;
       }
+#endif
 #ifndef MEASURE_OVERHEAD
       do_work(attr.e - 200us);
 #else
       do_work(1ms);
 #endif
 
-      return std::chrono::steady_clock::now() > dl;
+      return atlas::clock::now() > dl;
     }
 
     auto next(const int64_t job) const {
@@ -201,6 +219,7 @@ class periodic_taskset {
 
   hyperperiod_t hyperperiod;
   std::atomic_bool stop{false};
+  jitter release_jitter;
 
   auto run(const size_t i) {
     using namespace std::chrono;
@@ -257,6 +276,10 @@ class periodic_taskset {
       if (!tasks.at(i).done && !tasks.at(i).edf) {
         atlas::np::submit(threads[i], 0, 1s, 2s);
       }
+#ifdef ATLAS_SIMULATOR
+      /* let virtual time advance while joining the task thread */
+      atlas::sim::detach();
+#endif
       if (threads[i].joinable()) {
         threads[i].join();
       }
@@ -266,8 +289,12 @@ class periodic_taskset {
 public:
   periodic_taskset(const size_t n, U usum, U umax, period p_min, period p_max,
                    const bool edf = false)
-      : tasks(n), threads(std::make_unique<std::thread[]>(n)) {
-    const auto attr = generate_taskset(n, usum, umax, p_min, p_max);
+      : periodic_taskset(generate_taskset(n, usum, umax, p_min, p_max), edf) {}
+
+  periodic_taskset(const std::vector<task_attr> &attr, const bool edf = false)
+      : tasks(attr.size()),
+        threads(std::make_unique<std::thread[]>(attr.size())) {
+    const auto n = attr.size();
     hyperperiod = ::hyperperiod(attr);
     for (size_t i = 0; i < n; ++i) {
       auto &task = tasks.at(i);
@@ -290,25 +317,20 @@ public:
       r.jobs += task.jobs;
       r.missed += task.deadline_misses;
     }
+    r.jitter = release_jitter;
 
     return r;
   }
 
   void simulate() {
     using namespace std::chrono;
-    struct release {
-      steady_clock::time_point r;
-      task * t;
-      size_t count;
-
-      bool operator<(const release &rhs) { return r < rhs.r; }
-    };
 
 #if 0
     std::cout << "Running simulation for "
               << duration_cast<s>(hyperperiod).count() << "s" << std::endl;
 #endif
 
+#ifndef ATLAS_SIMULATOR
     {
       struct sched_param param;
       param.sched_priority = sched_get_priority_max(SCHED_FIFO);
@@ -318,33 +340,24 @@ public:
         exit(EXIT_FAILURE);
       }
     }
-    const auto t0 = steady_clock::now();
-
-    size_t jobs = 0;
-    std::vector<release> releases(tasks.size());
-    for (size_t i = 0; i < releases.size(); ++i) {
-      auto &release = releases.at(i);
-      auto &task = tasks.at(i);
-
-      release.r = t0;
-      release.t = &task;
-      jobs += static_cast<size_t>(task.jobs);
+#endif
+    std::vector<task_attr> attr;
+    std::vector<int64_t> jobs;
+    for (const auto &task : tasks) {
+      attr.push_back(task.attr);
+      jobs.push_back(task.jobs);
     }
 
-    for (size_t job = 0; job < jobs; ++job) {
-      for (auto &&release : releases) {
-        if (release.r <= steady_clock::now()) {
-          release.r = release.t->submit(release.count, release.r);
-          ++release.count;
-        }
-      }
-
-      std::sort(std::begin(releases), std::end(releases));
-      std::this_thread::sleep_until(releases.front().r);
-    }
+    const auto t0 = atlas::clock::now();
+    release_jitter = release_engine{}.run(
+        attr, jobs, t0,
+        [this](const size_t i, const int64_t job, const atlas::time_point &r) {
+          tasks.at(i).submit(static_cast<uint64_t>(job), r);
+        });
 
     synchronize_end();
 
+#ifndef ATLAS_SIMULATOR
     {
       /* This seems necessary, since forking from FIFO threads seems broken. */
       struct sched_param param;
@@ -355,6 +368,7 @@ public:
         exit(EXIT_FAILURE);
       }
     }
+#endif
   }
 
   friend std::ostream &operator<<(std::ostream &os,
@@ -398,37 +412,55 @@ static void find_minimum_e(const size_t count, const period p,
 
 static auto duration(const size_t tasks, const U u_sum, const U u_max,
                      const size_t count, const period pmin, const period pmax,
-                     const hyperperiod_t limit) {
+                     const taskgen_options &options) {
   using namespace std::chrono;
 
   hyperperiod_t duration{0};
   for (size_t j = 0; j < count; ++j) {
-    const auto attr = generate_taskset(tasks, u_sum, u_max, pmin, pmax);
-    const auto hp = ::hyperperiod(attr);
-    if (limit != hyperperiod_t{0} && hp > limit) {
-      --j;
-      continue;
-    }
-    duration += hp;
+    const auto attr =
+        generate_taskset(tasks, u_sum, u_max, pmin, pmax, options);
+    duration += ::hyperperiod(attr);
   }
 
   return duration;
 }
 
+/* With prefilter, task sets that the analysis decides are not run: those
+ * schedulable with overhead added to each job count as meeting all deadlines,
+ * unschedulable ones are left out of the result. */
 static auto schedulable(const size_t tasks, const U u_sum, const U u_max,
                         const size_t count, const period pmin,
-                        const period pmax, const bool edf = false) {
+                        const period pmax, const taskgen_options &options,
+                        const bool edf = false,
+                        const bool prefilter = false,
+                        const execution_time overhead = execution_time{0}) {
   using namespace std::chrono;
   result failures;
+  size_t rejected = 0;
 
   for (size_t j = 0; j < count; ++j) {
-    periodic_taskset ts(tasks, u_sum, u_max, pmin, pmax, edf);
-    ts.simulate();
-    failures += ts.result();
-    std::cerr << ".";
+    const auto attr =
+        generate_taskset(tasks, u_sum, u_max, pmin, pmax, options);
+    const auto v = prefilter ? analyze(attr, 1, overhead) : verdict::unknown;
+    if (v == verdict::schedulable) {
+      const auto hp = ::hyperperiod(attr);
+      for (const auto &task : attr)
+        failures.jobs += hp / task.p;
+      std::cerr << "+";
+    } else if (v == verdict::unschedulable) {
+      ++rejected;
+      std::cerr << "-";
+    } else {
+      periodic_taskset ts(attr, edf);
+      ts.simulate();
+      failures += ts.result();
+      std::cerr << ".";
+    }
     std::cerr.flush();
   }
   std::cerr << std::endl;
+  if (rejected)
+    std::cerr << rejected << " unschedulable task sets not run." << std::endl;
   return failures;
 }
 
@@ -446,6 +478,8 @@ int main(int argc, char *argv[]) {
   int64_t pmin;
   int64_t pmax;
   int64_t limit;
+  taskgen_options options;
+  int64_t overhead = 0;
 
   // clang-format off
   desc.add_options()
@@ -468,8 +502,16 @@ int main(int argc, char *argv[]) {
     ("overload-push", "Enable overload-push (Default: off)")
     ("duration",
      "Experiment duration for task sets with current parameters.")
+    ("periods", po::value(&options.periods)->default_value(period_mode::cooked),
+     "Period generation: cooked, log-uniform or harmonic. (Default: cooked)")
+    ("utilizations",
+     po::value(&options.utilizations)->default_value(utilization_mode::uunisort),
+     "Utilization generation: uunisort or uunifast. (Default: uunisort)")
     ("limit", po::value(&limit)->default_value(0),
      "Limit the hyperperiod to <num> seconds. (Default: 0, off)")
+    ("prefilter", po::value(&overhead)->implicit_value(200),
+     "Run only task sets the EDF analysis cannot decide with <us> overhead "
+     "per job. (Default: off, 200us)")
     ("edf", "Use Linux' SCHED_DEADLINE.");
   // clang-format on
 
@@ -482,6 +524,15 @@ int main(int argc, char *argv[]) {
     return EXIT_SUCCESS;
   }
 
+#ifdef ATLAS_SIMULATOR
+  if (vm.count("edf")) {
+    std::cerr << "SCHED_DEADLINE is not simulated." << std::endl;
+    return EXIT_FAILURE;
+  }
+#endif
+
+  options.limit = s{limit};
+
   if (!vm.count("edf")) {
     set_procfsparam(attribute::job_stealing, vm.count("idle-pull"));
     set_procfsparam(attribute::overload_push, vm.count("overload-push"));
@@ -504,7 +555,7 @@ int main(int argc, char *argv[]) {
     for (size_t task = tasks.front(); task <= tasks.back(); ++task) {
       for (const auto &usum : usums) {
         duration += ::duration(task, U{usum}, U{umax}, count, period{pmin},
-                               period{pmax}, s{limit});
+                               period{pmax}, options);
       }
     }
 
@@ -520,7 +571,8 @@ int main(int argc, char *argv[]) {
       }
 
       auto failures = schedulable(task, U{usum}, U{umax}, count, period{pmin},
-                                  period{pmax}, vm.count("edf"));
+                                  period{pmax}, options, vm.count("edf"),
+                                  vm.count("prefilter"), us{overhead});
       std::cout << double(usum) / 1000.0 << " " << task << " " << failures
                 << std::endl;
       std::cerr << failures << " deadline misses with " << task << " tasks "
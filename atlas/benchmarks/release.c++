@@ -0,0 +1,108 @@
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "atlas/atlas.h"
+
+#include "release.h"
+
+namespace {
+struct pending {
+  atlas::time_point r;
+  size_t task;
+  int64_t job;
+
+  bool operator>(const pending &rhs) const { return r > rhs.r; }
+};
+}
+
+release_engine::release_engine() {
+#ifndef ATLAS_SIMULATOR
+  /* steady_clock is CLOCK_MONOTONIC */
+  timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (timer < 0) {
+    std::ostringstream os;
+    os << "Error creating release timer (" << errno
+       << "): " << strerror(errno);
+    throw std::runtime_error(os.str());
+  }
+#endif
+}
+
+release_engine::~release_engine() {
+  if (timer >= 0)
+    close(timer);
+}
+
+void release_engine::sleep_until(const atlas::time_point &t) {
+#ifdef ATLAS_SIMULATOR
+  atlas::sleep_until(t);
+#else
+  using namespace std::chrono;
+  if (t <= atlas::clock::now())
+    return;
+
+  const auto since_epoch = t.time_since_epoch();
+  const auto secs = duration_cast<seconds>(since_epoch);
+  struct itimerspec spec {};
+  spec.it_value.tv_sec = static_cast<time_t>(secs.count());
+  spec.it_value.tv_nsec =
+      static_cast<long>(duration_cast<nanoseconds>(since_epoch - secs).count());
+  if (timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr)) {
+    std::ostringstream os;
+    os << "Error arming release timer (" << errno << "): " << strerror(errno);
+    throw std::runtime_error(os.str());
+  }
+
+  uint64_t expirations;
+  while (read(timer, &expirations, sizeof(expirations)) < 0) {
+    if (errno != EINTR) {
+      std::ostringstream os;
+      os << "Error waiting for release timer (" << errno
+         << "): " << strerror(errno);
+      throw std::runtime_error(os.str());
+    }
+  }
+#endif
+}
+
+jitter release_engine::run(const std::vector<task_attr> &tasks,
+                           const std::vector<int64_t> &jobs,
+                           const atlas::time_point t0,
+                           const release_fn &release) {
+  std::vector<pending> heap;
+  heap.reserve(tasks.size());
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    if (jobs.at(i) > 0)
+      heap.push_back({t0, i, 0});
+  }
+  std::priority_queue<pending, std::vector<pending>, std::greater<pending>>
+      releases(std::greater<pending>{}, std::move(heap));
+
+  jitter j;
+  while (!releases.empty()) {
+    sleep_until(releases.top().r);
+
+    /* release everything that is due, including what became due while
+     * releasing */
+    while (!releases.empty() && releases.top().r <= atlas::clock::now()) {
+      const auto next = releases.top();
+      releases.pop();
+
+      j.record(atlas::clock::now() - next.r);
+      release(next.task, next.job, next.r);
+      if (next.job + 1 < jobs.at(next.task))
+        releases.push(
+            {next.r + tasks.at(next.task).p, next.task, next.job + 1});
+    }
+  }
+
+  return j;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "atlas/atlas-clock.h"
+
+#include "common.h"
+#include "taskgen.h"
+
+/* Releases the jobs of periodic tasks at their release times. Pending
+ * releases are kept in a min-heap, so a release costs O(log n) for n tasks.
+ * Between releases the engine sleeps on an absolute timerfd, or in virtual
+ * time in the simulator, so wake-ups do not drift. */
+class release_engine {
+public:
+  /* Called with the task index, the job number and the release time of the
+   * job. */
+  using release_fn =
+      std::function<void(size_t, int64_t, const atlas::time_point &)>;
+
+  release_engine();
+  ~release_engine();
+  release_engine(const release_engine &) = delete;
+  release_engine &operator=(const release_engine &) = delete;
+
+  /* Releases jobs[i] jobs of tasks[i], the first at t0 and then one every
+   * period. Returns the release jitter of all jobs: how late release was
+   * called for each of them. */
+  jitter run(const std::vector<task_attr> &tasks,
+             const std::vector<int64_t> &jobs, const atlas::time_point t0,
+             const release_fn &release);
+
+private:
+  void sleep_until(const atlas::time_point &t);
+
+  int timer = -1;
+};
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+#include "schedulability.h"
+
+/* Slack for comparisons of utilizations in floating point. Sufficient tests
+ * subtract it, necessary tests add it, so rounding never turns an unknown
+ * task set into a decided one. */
+static constexpr double epsilon = 1e-9;
+
+std::ostream &operator<<(std::ostream &os, const verdict v) {
+  switch (v) {
+  case verdict::schedulable:
+    return os << "schedulable";
+  case verdict::unschedulable:
+    return os << "unschedulable";
+  case verdict::unknown:
+    return os << "unknown";
+  }
+  return os;
+}
+
+static double task_utilization(const task_attr &task) {
+  return std::chrono::duration<double>(task.e) /
+         std::chrono::duration<double>(task.p);
+}
+
+double utilization_sum(const std::vector<task_attr> &tasks) {
+  return std::accumulate(std::begin(tasks), std::end(tasks), 0.0,
+                         [](const double sum, const auto &task) {
+                           return sum + task_utilization(task);
+                         });
+}
+
+bool edf_utilization(const std::vector<task_attr> &tasks) {
+  return utilization_sum(tasks) <= 1.0 + epsilon;
+}
+
+execution_time demand_bound(const std::vector<task_attr> &tasks,
+                            const execution_time t) {
+  execution_time demand{0};
+  for (const auto &task : tasks)
+    demand += (t / task.p) * task.e;
+  return demand;
+}
+
+/* Length of the first busy period of a synchronous release, or limit if the
+ * busy period is longer. */
+static execution_time busy_period(const std::vector<task_attr> &tasks,
+                                  const execution_time limit) {
+  auto length = std::accumulate(
+      std::begin(tasks), std::end(tasks), execution_time{0},
+      [](const auto &sum, const auto &task) { return sum + task.e; });
+
+  for (;;) {
+    if (length >= limit)
+      return limit;
+    execution_time next{0};
+    for (const auto &task : tasks) {
+      const execution_time p = task.p;
+      next += ((length + p - execution_time{1}) / p) * task.e;
+    }
+    if (next == length)
+      return length;
+    length = next;
+  }
+}
+
+bool edf_demand(const std::vector<task_attr> &tasks) {
+  if (tasks.empty())
+    return true;
+
+  const auto length = busy_period(tasks, ::hyperperiod(tasks));
+  /* the deadlines are walked task by task instead of collected, as there
+   * may be millions of them; shared ones are checked more than once */
+  for (const auto &task : tasks) {
+    for (execution_time d = task.p; d <= length; d += task.p) {
+      if (demand_bound(tasks, d) > d)
+        return false;
+    }
+  }
+  return true;
+}
+
+bool feasible(const std::vector<task_attr> &tasks, const unsigned cores) {
+  const bool fits =
+      std::all_of(std::begin(tasks), std::end(tasks),
+                  [](const auto &task) { return task.e <= task.p; });
+  return fits && utilization_sum(tasks) <= cores + epsilon;
+}
+
+bool gedf_gfb(const std::vector<task_attr> &tasks, const unsigned cores) {
+  double umax = 0.0;
+  for (const auto &task : tasks)
+    umax = std::max(umax, task_utilization(task));
+  return umax <= 1.0 &&
+         utilization_sum(tasks) <= cores - (cores - 1) * umax - epsilon;
+}
+
+bool gedf_bcl(const std::vector<task_attr> &tasks, const unsigned cores) {
+  for (size_t k = 0; k < tasks.size(); ++k) {
+    const execution_time d = tasks[k].p;
+    const double slack = 1.0 - task_utilization(tasks[k]);
+    if (slack < 0.0)
+      return false;
+
+    double interference = 0.0;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      if (i == k)
+        continue;
+      const auto &task = tasks[i];
+      const execution_time p = task.p;
+      /* jobs of task i with their deadline in the window of task k, plus
+       * the carry-in of the job before them */
+      const auto jobs = (d >= p) ? (d - p) / p + 1 : 0;
+      const auto carry =
+          std::min(task.e, std::max(d - jobs * p, execution_time{0}));
+      const double beta =
+          std::chrono::duration<double>(jobs * task.e + carry) /
+          std::chrono::duration<double>(d);
+      interference += std::min(beta, slack);
+    }
+
+    if (interference >= cores * slack - epsilon)
+      return false;
+  }
+
+  return true;
+}
+
+verdict analyze(const std::vector<task_attr> &tasks, const unsigned cores,
+                const execution_time overhead) {
+  auto inflated = tasks;
+  for (auto &task : inflated)
+    task.e += overhead;
+
+  /* with implicit deadlines the utilization bound is exact for EDF on one
+   * core, so the demand test could not change the verdict */
+  if (cores <= 1) {
+    if (edf_utilization(inflated))
+      return verdict::schedulable;
+    if (!edf_utilization(tasks))
+      return verdict::unschedulable;
+    return verdict::unknown;
+  }
+
+  if (feasible(inflated, cores) &&
+      (gedf_gfb(inflated, cores) || gedf_bcl(inflated, cores)))
+    return verdict::schedulable;
+  if (!feasible(tasks, cores))
+    return verdict::unschedulable;
+  return verdict::unknown;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include "taskgen.h"
+
+/* Analytic schedulability tests for task sets of generate_taskset(). Tasks
+ * are periodic with implicit deadlines (d = p) and released synchronously,
+ * as in the periodic and concurrent benchmarks. */
+
+enum class verdict { schedulable, unschedulable, unknown };
+
+std::ostream &operator<<(std::ostream &os, const verdict v);
+
+/* Total utilization of the task set, computed from e and p. */
+double utilization_sum(const std::vector<task_attr> &tasks);
+
+/* EDF on one core: U <= 1. Exact for implicit deadlines. */
+bool edf_utilization(const std::vector<task_attr> &tasks);
+
+/* Sum of the execution times of all jobs with release and deadline in
+ * [0, t]. */
+execution_time demand_bound(const std::vector<task_attr> &tasks,
+                            const execution_time t);
+
+/* Processor-demand test for EDF on one core: dbf(t) <= t at every deadline
+ * in the first synchronous busy period, or the hyperperiod if that is
+ * shorter. Exact, but computed in integer time. For implicit deadlines it
+ * agrees with edf_utilization() at a much higher cost. */
+bool edf_demand(const std::vector<task_attr> &tasks);
+
+/* Necessary condition for any scheduler on m cores: U <= m and e <= p. */
+bool feasible(const std::vector<task_attr> &tasks, const unsigned cores);
+
+/* Sufficient test for global EDF on m cores by Goossens, Funk and Baruah:
+ * U <= m - (m - 1) * umax. */
+bool gedf_gfb(const std::vector<task_attr> &tasks, const unsigned cores);
+
+/* Sufficient test for global EDF on m cores by Bertogna, Cirinei and Lipari,
+ * bounding the interference in the scheduling window of each task. */
+bool gedf_bcl(const std::vector<task_attr> &tasks, const unsigned cores);
+
+/* Classifies a task set for EDF on the given number of cores. The task set
+ * is schedulable if it passes the sufficient tests with overhead added to
+ * each job, and unschedulable if it fails the exact or necessary tests
+ * without it. Everything in between depends on the system and has to be
+ * run. One core is decided by the utilization bound. */
+verdict analyze(const std::vector<task_attr> &tasks, const unsigned cores = 1,
+                const execution_time overhead = execution_time{0});
@@ -20,8 +20,9 @@ static auto run(unsigned jobs, size_t count) {
   }
 
   for (size_t i = 0; i < count; ++i) {
+    const auto deadline = atlas::clock::now() + 2s;
     auto s_start = steady_clock::now();
-    atlas::submit(tid, i + jobs, 1s, s_start + 2s);
+    atlas::submit(tid, i + jobs, 1s, deadline);
     auto s_end = steady_clock::now();
 
     submits[i] = duration_cast<nanoseconds>(s_end - s_start).count();
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "schedulability.h"
+#include "taskgen.h"
+
+/* Runs the schedulability analysis over a grid of task set parameters on all
+ * cores and appends one CSV row per grid point. Points already in the output
+ * file are skipped, so an interrupted sweep continues where it stopped. The
+ * task sets of a point are drawn from a generator seeded with the point, so
+ * they do not depend on the order or the thread the points are run in. */
+
+struct point {
+  size_t tasks;
+  int64_t usum;
+  int64_t umax;
+  int64_t pmin;
+  int64_t pmax;
+  unsigned cores;
+  size_t count;
+  uint64_t seed;
+  int64_t overhead;
+  taskgen_options options;
+
+  std::string key() const {
+    using namespace std::chrono;
+    std::ostringstream os;
+    os << tasks << "," << usum << "," << umax << "," << pmin << "," << pmax
+       << "," << cores << "," << count << "," << seed << "," << overhead
+       << "," << options.periods << "," << options.utilizations << ","
+       << duration_cast<seconds>(options.limit).count();
+    return os.str();
+  }
+};
+
+static constexpr const char *header =
+    "tasks,utilization,task_utilization,min_period,max_period,cores,count,"
+    "seed,overhead,periods,utilizations,limit,schedulable,unschedulable,"
+    "unknown";
+
+/* Key columns of the rows in an earlier output. */
+static std::set<std::string> finished(const std::string &file) {
+  static constexpr size_t key_columns = 12;
+  std::set<std::string> keys;
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line == header)
+      continue;
+    size_t end = 0;
+    for (size_t column = 0; column < key_columns && end != std::string::npos;
+         ++column)
+      end = line.find(',', end + (column != 0));
+    if (end != std::string::npos)
+      keys.insert(line.substr(0, end));
+  }
+  return keys;
+}
+
+/* FNV-1a */
+static uint64_t hash(const std::string &s) {
+  uint64_t h = 14695981039346656037ULL;
+  for (const auto c : s) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+struct outcome {
+  size_t schedulable{0};
+  size_t unschedulable{0};
+  size_t unknown{0};
+};
+
+static outcome analyze(const point &pt) {
+  using namespace std::chrono;
+  seed_taskgen(hash(pt.key()));
+
+  outcome o;
+  for (size_t j = 0; j < pt.count; ++j) {
+    const auto attr = generate_taskset(pt.tasks, U{pt.usum}, U{pt.umax},
+                                       period{pt.pmin}, period{pt.pmax},
+                                       pt.options);
+    switch (::analyze(attr, pt.cores, microseconds{pt.overhead})) {
+    case verdict::schedulable:
+      ++o.schedulable;
+      break;
+    case verdict::unschedulable:
+      ++o.unschedulable;
+      break;
+    case verdict::unknown:
+      ++o.unknown;
+      break;
+    }
+  }
+  return o;
+}
+
+int main(int argc, char *argv[]) {
+  namespace po = boost::program_options;
+
+  po::options_description desc(
+      "Classify generated task sets with the schedulability analysis.");
+
+  std::vector<size_t> tasks;
+  std::vector<int64_t> usums;
+  std::vector<int64_t> pmins;
+  std::vector<int64_t> pmaxs;
+  std::vector<unsigned> cores;
+  size_t count;
+  int64_t umax;
+  int64_t overhead;
+  uint64_t seed;
+  unsigned threads;
+  std::string output;
+  int64_t limit;
+  taskgen_options options;
+
+  // clang-format off
+  desc.add_options()
+    ("help", "Produce help message")
+    ("tasks", po::value(&tasks)->multitoken(),
+     "Range of the number of tasks in the task sets. (Default: 2)")
+    ("count", po::value(&count)->default_value(200),
+     "Number of task sets per grid point. (Default: 200)")
+    ("utilization", po::value(&usums)->multitoken(),
+     "Utilizations of the task sets * 1e-3. (Default: 1000)")
+    ("task-utilization", po::value(&umax)->default_value(1000),
+     "Maximum utilization of any task * 1e-3. (Default: 1000)")
+    ("min-period", po::value(&pmins)->multitoken(),
+     "Minimum periods of any task, paired with --max-period. (Default: 10ms)")
+    ("max-period", po::value(&pmaxs)->multitoken(),
+     "Maximum periods of any task. (Default: 100ms)")
+    ("cores", po::value(&cores)->multitoken(),
+     "Numbers of cores to analyze for. (Default: 1)")
+    ("overhead", po::value(&overhead)->default_value(200),
+     "Overhead per job in us that a task set has to tolerate to be "
+     "classified schedulable. (Default: 200us)")
+    ("periods", po::value(&options.periods)->default_value(period_mode::cooked),
+     "Period generation: cooked, log-uniform or harmonic. (Default: cooked)")
+    ("utilizations",
+     po::value(&options.utilizations)->default_value(utilization_mode::uunisort),
+     "Utilization generation: uunisort or uunifast. (Default: uunisort)")
+    ("limit", po::value(&limit)->default_value(0),
+     "Limit the hyperperiod to <num> seconds. (Default: 0, off)")
+    ("seed", po::value(&seed)->default_value(0),
+     "Seed of the task set generation. (Default: 0)")
+    ("threads", po::value(&threads)->default_value(std::thread::hardware_concurrency()),
+     "Number of worker threads. (Default: all cores)")
+    ("output", po::value(&output)->default_value("sweep.csv"),
+     "CSV file to append to. (Default: sweep.csv)");
+  // clang-format on
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc;
+    return EXIT_SUCCESS;
+  }
+
+  if (tasks.empty())
+    tasks.push_back(2);
+  if (usums.empty())
+    usums.push_back(1000);
+  if (pmins.empty())
+    pmins.push_back(10);
+  if (pmaxs.empty())
+    pmaxs.push_back(100);
+  if (cores.empty())
+    cores.push_back(1);
+  if (pmins.size() != pmaxs.size()) {
+    std::cerr << "--min-period and --max-period differ in length."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  threads = std::max(threads, 1U);
+  options.limit = std::chrono::seconds{limit};
+
+  const auto done = finished(output);
+  const bool empty =
+      std::ifstream(output).peek() == std::ifstream::traits_type::eof();
+  std::vector<point> points;
+  for (size_t task = tasks.front(); task <= tasks.back(); ++task) {
+    for (const auto &usum : usums) {
+      if (static_cast<int64_t>(task) * umax < usum)
+        continue;
+      for (size_t p = 0; p < pmins.size(); ++p) {
+        for (const auto &m : cores) {
+          const point pt{task,  usum, umax,     pmins[p], pmaxs[p],
+                         m,     count, seed, overhead, options};
+          if (!done.count(pt.key()))
+            points.push_back(pt);
+        }
+      }
+    }
+  }
+
+  std::ofstream out(output, std::ios::app);
+  if (!out) {
+    std::cerr << "Could not open " << output << "." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (empty)
+    out << header << std::endl;
+
+  std::cerr << points.size() << " grid points to analyze, " << done.size()
+            << " done." << std::endl;
+
+  std::mutex lock;
+  std::atomic<size_t> next{0};
+  size_t total = 0;
+  size_t unknown = 0;
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([&] {
+      for (size_t index; (index = next++) < points.size();) {
+        const auto &pt = points[index];
+        outcome o;
+        try {
+          o = analyze(pt);
+        } catch (const std::runtime_error &e) {
+          std::lock_guard<std::mutex> l(lock);
+          std::cerr << pt.key() << ": " << e.what() << std::endl;
+          continue;
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+        /* one flushed row per point, so a killed sweep loses at most the
+         * points in flight */
+        out << pt.key() << "," << o.schedulable << "," << o.unschedulable
+            << "," << o.unknown << std::endl;
+        total += pt.count;
+        unknown += o.unknown;
+        std::cerr << ".";
+        std::cerr.flush();
+      }
+    });
+  }
+  for (auto &&worker : workers)
+    worker.join();
+
+  std::cerr << std::endl
+            << unknown << " of " << total
+            << " task sets need to be run to be classified." << std::endl;
+}
@@ -13,6 +13,9 @@
 using namespace std::chrono;
 using execution_time = std::chrono::nanoseconds;
 
+#ifdef ATLAS_SIMULATOR
+static auto do_work(const execution_time &e) { atlas::sim::execute(e); }
+#else
 static auto do_work(const execution_time &e) {
   static constexpr execution_time work_unit{100us};
 #pragma clang diagnostic push
@@ -30,6 +33,7 @@ static auto do_work(const execution_time &e) {
     strstr(haystack.c_str(), "test");
   }
 }
+#endif
 
 struct datapoint {
   int group;
@@ -43,7 +47,7 @@ struct datapoint {
 static auto threadfn(const int group, const uint64_t myid, const atlas::clock::time_point gotime,
                      const atlas::clock::time_point deadline,
                      const execution_time e) {
-  std::this_thread::sleep_until(gotime);
+  atlas::sleep_until(gotime);
 
   uint64_t id;
   if (atlas::next(id) != 1) {
@@ -86,6 +90,10 @@ int main() {
     atlas::np::submit(threads.back(), 200+i, exec2 * 1.025, deadline);
   }
 
+#ifdef ATLAS_SIMULATOR
+  /* let virtual time advance while joining the threads */
+  atlas::sim::detach();
+#endif
   for (auto &&t : threads) {
     t.join();
   }
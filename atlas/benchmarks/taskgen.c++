@@ -5,12 +5,19 @@
 #include <stdexcept>
 #include <vector>
 #include <array>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <string>
 
 #include <boost/math/common_factor_rt.hpp>
 
 #include "taskgen.h"
 
-static std::mt19937_64 generator;
+/* One generator per thread, so task sets can be generated in parallel. */
+static thread_local std::mt19937_64 generator;
+
+void seed_taskgen(const uint64_t seed) { generator.seed(seed); }
 
 template <typename Rep, typename Res>
 static auto uunisort(size_t n, utilization<Rep, Res> usum,
@@ -39,6 +46,41 @@ static auto uunisort(size_t n, utilization<Rep, Res> usum,
   return utilizations;
 }
 
+/* UUniFast-discard by Davis and Burns: UUniFast draws utilizations uniformly
+ * from all vectors with the sum usum; vectors with a utilization above umax
+ * or below the resolution are discarded. Rounding of the prefix sums keeps
+ * the sum exact. */
+template <typename Rep, typename Res>
+static auto uunifast(const size_t n, const utilization<Rep, Res> usum,
+                     const utilization<Rep, Res> umax) {
+  static constexpr size_t attempts = 1000000;
+  std::uniform_real_distribution<double> distribution(0.0, 1.0);
+  std::vector<utilization<Rep, Res>> utilizations(n);
+
+  for (size_t attempt = 0; attempt < attempts; ++attempt) {
+    double sum = static_cast<double>(usum.utilization);
+    Rep prefix = 0;
+    for (size_t i = 0; i < n - 1; ++i) {
+      const double next =
+          sum * std::pow(distribution(generator), 1.0 / double(n - i - 1));
+      const auto rounded =
+          static_cast<Rep>(std::llround(usum.utilization - next));
+      utilizations.at(i) = utilization<Rep, Res>{rounded - prefix};
+      prefix = rounded;
+      sum = next;
+    }
+    utilizations.back() = utilization<Rep, Res>{usum.utilization - prefix};
+
+    if (std::all_of(std::begin(utilizations), std::end(utilizations),
+                    [&umax](const auto &u) {
+                      return utilization<Rep, Res>{0} < u && !(umax < u);
+                    }))
+      return utilizations;
+  }
+
+  throw std::runtime_error("UUniFast-discard found no utilizations <= umax");
+}
+
 #if 0
 template <typename Rep, typename Res>
 static auto uunisort(const size_t n, utilization<Rep, Res> u) {
@@ -123,10 +165,85 @@ static auto generate_period() {
   return period{periods[draw_from(0UL, periods.size() - 1)]};
 }
 
+/* Highly composite numbers. Periods dividing one of them have a
+ * hyperperiod no larger than it, yet there are many to choose from. */
+static constexpr std::array<int64_t, 26> divisor_rich_bases{
+    {60,    120,   180,   240,   360,    720,    840,    1260,   1680,
+     2520,  5040,  7560,  10080, 15120,  20160,  25200,  27720,  45360,
+     50400, 55440, 83160, 110880, 166320, 221760, 277200, 332640}};
+
+/* Divisors of a highly composite number in [p_min, p_max]. The number is
+ * the largest within limit, or else the smallest of at least 10 * p_max. */
+static auto divisor_rich_periods(const period &p_min, const period &p_max,
+                                 const hyperperiod_t limit) {
+  using namespace std::chrono;
+  int64_t base = 0;
+  if (limit != hyperperiod_t{0}) {
+    for (const auto &candidate : divisor_rich_bases) {
+      if (period{candidate} <= limit)
+        base = candidate;
+    }
+  } else {
+    const auto lower = 10 * p_max;
+    const auto it = std::find_if(
+        std::begin(divisor_rich_bases), std::end(divisor_rich_bases),
+        [&lower](const auto &candidate) { return period{candidate} >= lower; });
+    base = (it != std::end(divisor_rich_bases)) ? *it
+                                                : divisor_rich_bases.back();
+  }
+
+  std::vector<period> periods;
+  for (auto p = p_min.count(); base && p <= p_max.count() && p <= base; ++p) {
+    if (base % p == 0)
+      periods.emplace_back(p);
+  }
+  if (periods.empty())
+    throw std::runtime_error("No divisor-rich period in [p_min, p_max] within "
+                             "the hyperperiod limit");
+  return periods;
+}
+
+static double draw_log(const period &p_min, const period &p_max) {
+  std::uniform_real_distribution<double> distribution(
+      std::log(static_cast<double>(p_min.count())),
+      std::log(static_cast<double>(p_max.count())));
+  return distribution(generator);
+}
+
+/* The candidate closest to a log-uniform draw from [p_min, p_max]. */
+static auto draw_log_uniform(const std::vector<period> &periods) {
+  const auto x = draw_log(periods.front(), periods.back());
+  const auto it = std::lower_bound(
+      std::begin(periods), std::end(periods), x,
+      [](const auto &p, const double v) {
+        return std::log(static_cast<double>(p.count())) < v;
+      });
+  if (it == std::begin(periods))
+    return *it;
+  if (it == std::end(periods))
+    return periods.back();
+  const auto prev = std::prev(it);
+  return (x - std::log(static_cast<double>(prev->count())) <
+          std::log(static_cast<double>(it->count())) - x)
+             ? *prev
+             : *it;
+}
+
+/* A log-uniform draw from [p_min, p_max], rounded down to base * 2^k. */
+static auto draw_harmonic(const period &base, const period &p_min,
+                          const period &p_max) {
+  const auto x = std::exp(draw_log(p_min, p_max));
+  auto p = base;
+  while (p * 2 <= p_max && static_cast<double>((p * 2).count()) <= x)
+    p *= 2;
+  return p;
+}
+
 template <typename Rep, typename Res>
 auto generate_taskset_(const size_t n, const utilization<Rep, Res> usum,
                        const utilization<Rep, Res> umax, const period &p_min,
-                       const period &p_max) {
+                       const period &p_max, const taskgen_options &options) {
+  static constexpr size_t attempts = 10000;
   using namespace std::chrono;
   if (p_min > p_max)
     throw std::runtime_error("p_min larger than p_max");
@@ -164,47 +281,132 @@ auto generate_taskset_(const size_t n, const utilization<Rep, Res> usum,
 #endif
   }
 
-  const auto utilizations = uunisort(n, usum, umax);
+  const auto utilizations = (options.utilizations == utilization_mode::uunifast)
+                                ? uunifast(n, usum, umax)
+                                : uunisort(n, usum, umax);
   const auto all = (bin_count > n) ? n / bin_count * std::min(n, bin_count) : 0;
-  std::vector<task_attr> ts(n);
-
-  size_t i = 0;
-  auto next = std::transform(
-      std::begin(utilizations),
-      std::begin(utilizations) + static_cast<long>(all), std::begin(ts),
-      [&bins, &i](const auto &u) {
+  const auto divisors = (options.periods == period_mode::log_uniform)
+                            ? divisor_rich_periods(p_min, p_max, options.limit)
+                            : std::vector<period>{};
+
+  // period [us] * utilization [milli] -> execution time [ns]
+  const auto attr = [](const auto &u, const period &p) {
+    const auto e = execution_time{duration_cast<microseconds>(p).count() *
+                                  u.utilization};
+    return task_attr{e, p, u};
+  };
+
+  /* Only the periods are drawn again if the hyperperiod is too long, which
+   * leaves the distribution of the utilizations alone. */
+  for (size_t attempt = 0; attempt < attempts; ++attempt) {
+    std::vector<task_attr> ts(n);
+
+    switch (options.periods) {
+    case period_mode::cooked: {
+      size_t i = 0;
+      auto next = std::transform(
+          std::begin(utilizations),
+          std::begin(utilizations) + static_cast<long>(all), std::begin(ts),
+          [&bins, &i, &attr](const auto &u) {
 #define COOKED_PERIODS
 #ifdef COOKED_PERIODS
-        const auto p = generate_period();
+            const auto p = generate_period();
 #else
-        const auto p = period{draw_from(bins.at(i++ % bins.size()))};
+            const auto p = period{draw_from(bins.at(i++ % bins.size()))};
 #endif
-        // period [us] * utilization [milli] -> execution time [ns]
-        const auto e = execution_time{duration_cast<microseconds>(p).count() *
-                                      u.utilization};
-        return task_attr{e, p, u};
-      });
+            return attr(u, p);
+          });
 
-  std::transform(std::begin(utilizations) + static_cast<long>(all),
-                 std::end(utilizations), next, [&bins](const auto &u) {
+      std::transform(std::begin(utilizations) + static_cast<long>(all),
+                     std::end(utilizations), next, [&bins, &attr](const auto &u) {
 #ifdef COOKED_PERIODS
-                   const auto p = generate_period();
+                       const auto p = generate_period();
 #else
-                   const auto bin = draw_from(0U, bins.size() - 1);
-                   const auto p = period{draw_from(bins.at(bin))};
+                       const auto bin = draw_from(0U, bins.size() - 1);
+                       const auto p = period{draw_from(bins.at(bin))};
 #endif
-                   const auto e = execution_time{
-                       duration_cast<microseconds>(p).count() * u.utilization};
-                   return task_attr{e, p, u};
-                 });
+                       return attr(u, p);
+                     });
+      break;
+    }
+    case period_mode::log_uniform:
+      std::transform(std::begin(utilizations), std::end(utilizations),
+                     std::begin(ts), [&divisors, &attr](const auto &u) {
+                       return attr(u, draw_log_uniform(divisors));
+                     });
+      break;
+    case period_mode::harmonic: {
+      const auto base = period{
+          draw_from(p_min.count(), std::min(2 * p_min.count() - 1,
+                                            p_max.count()))};
+      std::transform(std::begin(utilizations), std::end(utilizations),
+                     std::begin(ts), [&](const auto &u) {
+                       return attr(u, draw_harmonic(base, p_min, p_max));
+                     });
+      break;
+    }
+    }
+
+    if (options.limit == hyperperiod_t{0} || ::hyperperiod(ts) <= options.limit)
+      return ts;
+  }
 
-  return ts;
+  throw std::runtime_error("No periods found within the hyperperiod limit");
 }
 
 std::vector<task_attr> generate_taskset(const size_t n, const U usum,
                                         const U umax, const period &p_min,
-                                        const period &p_max) {
-  return generate_taskset_(n, usum, umax, p_min, p_max);
+                                        const period &p_max,
+                                        const taskgen_options &options) {
+  return generate_taskset_(n, usum, umax, p_min, p_max, options);
+}
+
+std::ostream &operator<<(std::ostream &os, const period_mode mode) {
+  switch (mode) {
+  case period_mode::cooked:
+    return os << "cooked";
+  case period_mode::log_uniform:
+    return os << "log-uniform";
+  case period_mode::harmonic:
+    return os << "harmonic";
+  }
+  return os;
+}
+
+std::istream &operator>>(std::istream &is, period_mode &mode) {
+  std::string name;
+  is >> name;
+  if (name == "cooked")
+    mode = period_mode::cooked;
+  else if (name == "log-uniform")
+    mode = period_mode::log_uniform;
+  else if (name == "harmonic")
+    mode = period_mode::harmonic;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
+std::ostream &operator<<(std::ostream &os, const utilization_mode mode) {
+  switch (mode) {
+  case utilization_mode::uunisort:
+    return os << "uunisort";
+  case utilization_mode::uunifast:
+    return os << "uunifast";
+  }
+  return os;
+}
+
+std::istream &operator>>(std::istream &is, utilization_mode &mode) {
+  std::string name;
+  is >> name;
+  if (name == "uunisort")
+    mode = utilization_mode::uunisort;
+  else if (name == "uunifast")
+    mode = utilization_mode::uunifast;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
 }
 
 #if 0
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <chrono>
 #include <iostream>
 #include <utility>
@@ -90,8 +92,36 @@ task_set generate_taskset(const size_t n, const double u);
 task_set generate_taskset(const size_t n, const double u,
                           const std::chrono::nanoseconds &p);
 #endif
+/* How generate_taskset() draws periods from [p_min, p_max]:
+ * cooked: from a fixed set of divisors of 5.184s, ignoring the range;
+ * log-uniform: log-uniformly from the divisors of a highly composite number,
+ *              which bounds the hyperperiod by that number;
+ * harmonic: log-uniformly, rounded down to base * 2^k, so the hyperperiod is
+ *           the largest period. */
+enum class period_mode { cooked, log_uniform, harmonic };
+/* How generate_taskset() splits usum: uunisort draws each utilization
+ * uniformly from the range left by the others, uunifast uses
+ * UUniFast-discard. */
+enum class utilization_mode { uunisort, uunifast };
+
+std::ostream &operator<<(std::ostream &os, const period_mode mode);
+std::istream &operator>>(std::istream &is, period_mode &mode);
+std::ostream &operator<<(std::ostream &os, const utilization_mode mode);
+std::istream &operator>>(std::istream &is, utilization_mode &mode);
+
+struct taskgen_options {
+  period_mode periods = period_mode::cooked;
+  utilization_mode utilizations = utilization_mode::uunisort;
+  /* Periods are drawn again until the hyperperiod is at most limit. 0 for no
+   * limit. */
+  hyperperiod_t limit{0};
+};
+
 std::vector<task_attr> generate_taskset(const size_t n, U usum, U umax,
                                         const period &p_min,
-                                        const period &p_max);
+                                        const period &p_max,
+                                        const taskgen_options &options = {});
 hyperperiod_t hyperperiod(const std::vector<task_attr> &tasks);
+/* Seeds the generator of generate_taskset() in the calling thread. */
+void seed_taskgen(const uint64_t seed);
 
@@ -0,0 +1,687 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "simulator.h"
+
+using namespace std::chrono;
+
+namespace {
+
+struct job {
+  uint64_t id;
+  nanoseconds exectime;
+  nanoseconds deadline;
+  /* submission order, to break ties between equal deadlines */
+  uint64_t seq;
+  nanoseconds used{0};
+
+  bool operator<(const job &rhs) const {
+    return std::tie(deadline, seq) < std::tie(rhs.deadline, rhs.seq);
+  }
+};
+
+/* outside: running code outside of the simulator, which takes no virtual time
+ * dispatch: in next() with a job, until the job is scheduled
+ * idle: in next() without a job, until a job arrives or time advances
+ * executing: in atlas_sim_execute()
+ * sleeping: in atlas_sim_sleep_until() */
+enum class state { outside, dispatch, idle, executing, sleeping };
+
+struct pool;
+
+struct thread {
+  pid_t tid;
+  unsigned cpu = 0;
+  bool participant = false;
+  enum state state = state::outside;
+  std::condition_variable wakeup{};
+  /* submitted jobs, not yet returned by next() */
+  std::vector<job> jobs{};
+  /* the job returned by the last call of next() */
+  std::unique_ptr<job> current{};
+  nanoseconds remaining{0};
+  nanoseconds until{0};
+  struct pool *pool = nullptr;
+
+  explicit thread(const pid_t tid_) : tid(tid_) {}
+
+  /* ATLAS runs jobs within their reservation first, then overrunning jobs,
+   * then threads without a job */
+  int tier() const {
+    const job *j = candidate();
+    if (j == nullptr)
+      return 2;
+    return (j->used < j->exectime) ? 0 : 1;
+  }
+
+  const job *candidate() const {
+    if (state == state::dispatch)
+      return &*std::min_element(jobs.begin(), jobs.end());
+    return current.get();
+  }
+};
+
+struct pool {
+  std::vector<thread *> workers{};
+  std::vector<job> jobs{};
+};
+
+class simulator {
+  std::mutex lock;
+  std::condition_variable engine;
+  std::map<pid_t, std::unique_ptr<thread>> threads;
+  std::map<uint64_t, pool> pools;
+  std::atomic<int64_t> now{0};
+  uint64_t activity = 0;
+  size_t participants = 0;
+  uint64_t seq = 0;
+  uint64_t next_pool = 1;
+  unsigned cpus;
+  milliseconds grace;
+
+  static unsigned cpu_count() {
+    if (const char *env = std::getenv("ATLAS_SIM_CPUS"))
+      return std::max(1u, static_cast<unsigned>(std::atoi(env)));
+    cpu_set_t set;
+    if (sched_getaffinity(getpid(), sizeof(set), &set) == 0)
+      return static_cast<unsigned>(std::max(1, CPU_COUNT(&set)));
+    return 1;
+  }
+
+  static milliseconds grace_period() {
+    if (const char *env = std::getenv("ATLAS_SIM_GRACE"))
+      return milliseconds{std::max(1, std::atoi(env))};
+    return 10ms;
+  }
+
+  /* Threads pinned to one CPU run there, others on the least loaded one. */
+  unsigned place(const thread &t) const {
+    cpu_set_t set;
+    if (sched_getaffinity(t.tid, sizeof(set), &set) == 0 &&
+        CPU_COUNT(&set) == 1) {
+      for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set))
+          return cpu % cpus;
+    }
+
+    std::vector<size_t> load(cpus, 0);
+    for (const auto &other : threads)
+      if (other.second.get() != &t)
+        ++load.at(other.second->cpu);
+    return static_cast<unsigned>(
+        std::min_element(load.begin(), load.end()) - load.begin());
+  }
+
+  thread &find_or_create(const pid_t tid) {
+    auto &t = threads[tid];
+    if (!t) {
+      t = std::make_unique<thread>(tid);
+      t->cpu = place(*t);
+    }
+    return *t;
+  }
+
+  thread *find(const pid_t tid) {
+    auto t = threads.find(tid);
+    return (t == threads.end()) ? nullptr : t->second.get();
+  }
+
+  static void wake(thread &t) {
+    t.state = state::outside;
+    t.wakeup.notify_one();
+  }
+
+  void block(std::unique_lock<std::mutex> &l, thread &t, const state s) {
+    t.state = s;
+    engine.notify_one();
+    t.wakeup.wait(l, [&t] { return t.state == state::outside; });
+  }
+
+  /* Hands a job to a thread, waking it if it waits for one. */
+  void assign(thread &t, job j) {
+    t.jobs.push_back(std::move(j));
+    if (t.state == state::idle)
+      t.state = state::dispatch;
+    engine.notify_one();
+  }
+
+  void claim(thread &t) {
+    if (t.pool == nullptr || !t.jobs.empty() || t.pool->jobs.empty())
+      return;
+    auto first = std::min_element(t.pool->jobs.begin(), t.pool->jobs.end());
+    t.jobs.push_back(*first);
+    t.pool->jobs.erase(first);
+  }
+
+  /* The thread owning the CPU among those with a job, if any. Threads
+   * returned from next() keep the CPU while they run outside of the
+   * simulator. */
+  thread *top(const unsigned cpu) const {
+    thread *best = nullptr;
+    for (const auto &entry : threads) {
+      thread &t = *entry.second;
+      if (t.cpu != cpu || t.tier() == 2)
+        continue;
+      if (t.state == state::outside && !t.participant)
+        continue;
+      if (t.state != state::dispatch && t.state != state::executing &&
+          t.state != state::outside)
+        continue;
+      if (best == nullptr ||
+          std::make_tuple(t.tier(), *t.candidate()) <
+              std::make_tuple(best->tier(), *best->candidate()))
+        best = &t;
+    }
+    return best;
+  }
+
+  /* Threads that progress on the CPU: the top thread, or all threads
+   * without a job sharing the CPU. */
+  std::vector<thread *> running(const unsigned cpu) const {
+    thread *t = top(cpu);
+    if (t != nullptr) {
+      if (t->state == state::executing)
+        return {t};
+      return {};
+    }
+
+    std::vector<thread *> fair;
+    for (const auto &entry : threads)
+      if (entry.second->cpu == cpu && entry.second->state == state::executing)
+        fair.push_back(entry.second.get());
+    return fair;
+  }
+
+  /* Returns from next() for jobs which got their CPU. */
+  bool dispatch() {
+    bool dispatched = false;
+    for (unsigned cpu = 0; cpu < cpus; ++cpu) {
+      thread *t = top(cpu);
+      if (t == nullptr || t->state != state::dispatch)
+        continue;
+      auto first = std::min_element(t->jobs.begin(), t->jobs.end());
+      t->current = std::make_unique<job>(*first);
+      t->jobs.erase(first);
+      wake(*t);
+      dispatched = true;
+    }
+    return dispatched;
+  }
+
+  bool blocked() const {
+    return participants > 0 &&
+           std::none_of(threads.begin(), threads.end(), [](const auto &t) {
+             return t.second->participant &&
+                    t.second->state == state::outside;
+           });
+  }
+
+  /* Advances virtual time to the next event. Without a pending event, idle
+   * threads return from next() if forced. */
+  bool step(const bool force) {
+    constexpr auto never = nanoseconds::max();
+    const nanoseconds current{now.load()};
+    nanoseconds event = never;
+
+    for (const auto &entry : threads)
+      if (entry.second->state == state::sleeping)
+        event = std::min(event, entry.second->until);
+
+    for (unsigned cpu = 0; cpu < cpus; ++cpu) {
+      const auto run = running(cpu);
+      if (run.size() == 1 && run.front()->current) {
+        const thread &t = *run.front();
+        auto until = t.remaining;
+        if (t.current->used < t.current->exectime)
+          until = std::min(until, t.current->exectime - t.current->used);
+        event = std::min(event, current + until);
+      } else {
+        for (const thread *t : run)
+          event = std::min(event, current + t->remaining *
+                                                static_cast<int64_t>(run.size()));
+      }
+    }
+
+    bool idle = false;
+    for (const auto &entry : threads)
+      idle = idle || entry.second->state == state::idle;
+
+    if (event == never) {
+      if (!force || !idle)
+        return false;
+      for (const auto &entry : threads)
+        if (entry.second->state == state::idle)
+          wake(*entry.second);
+      return true;
+    }
+
+    const auto elapsed = event - current;
+    for (unsigned cpu = 0; cpu < cpus; ++cpu) {
+      const auto run = running(cpu);
+      for (thread *t : run) {
+        if (run.size() == 1 && t->current) {
+          t->remaining -= elapsed;
+          t->current->used += elapsed;
+        } else {
+          t->remaining -= elapsed / static_cast<int64_t>(run.size());
+        }
+      }
+    }
+    now = event.count();
+
+    for (const auto &entry : threads) {
+      thread &t = *entry.second;
+      if ((t.state == state::executing && t.remaining <= 0ns) ||
+          (t.state == state::sleeping && t.until <= event) ||
+          t.state == state::idle)
+        wake(t);
+    }
+    return true;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> l(lock);
+    for (;;) {
+      if (dispatch())
+        continue;
+      if (blocked() && step(false))
+        continue;
+
+      const auto seen = activity;
+      const auto active = [this, seen] { return activity != seen; };
+      if (participants == 0)
+        engine.wait(l, active);
+      else if (!engine.wait_for(l, grace, active))
+        step(true);
+    }
+  }
+
+public:
+  simulator() : cpus(cpu_count()), grace(grace_period()) {
+    std::thread(&simulator::run, this).detach();
+  }
+
+  /* the record of the calling thread, which takes part from now on */
+  thread &self();
+  void exit(pid_t tid);
+
+  nanoseconds time() const { return nanoseconds{now.load()}; }
+
+  long submit(pid_t tid, uint64_t id, const struct timeval *exectime,
+              const struct timeval *deadline);
+  long next(uint64_t *next);
+  long remove(pid_t tid, uint64_t id);
+  long update(pid_t tid, uint64_t id, const struct timeval *exectime,
+              const struct timeval *deadline);
+  long tp_create(uint64_t *id);
+  long tp_destroy(uint64_t id);
+  long tp_join(uint64_t id);
+  long tp_submit(uint64_t tpid, uint64_t id, const struct timeval *exectime,
+                 const struct timeval *deadline);
+  void sleep_until(nanoseconds t);
+  void execute(nanoseconds duration);
+  void detach();
+};
+
+simulator &sim() {
+  static simulator *instance = new simulator;
+  return *instance;
+}
+
+pid_t thread_id() {
+  static thread_local const pid_t tid =
+      static_cast<pid_t>(syscall(SYS_gettid));
+  return tid;
+}
+
+/* Leaves the simulation when the thread exits. */
+struct registration {
+  registration() = default;
+  registration(const registration &) = delete;
+  registration &operator=(const registration &) = delete;
+  ~registration() { sim().exit(thread_id()); }
+};
+
+long fail(const int error) {
+  errno = error;
+  return -1;
+}
+
+/* Copies from and to user pointers, failing like the kernel would on invalid
+ * ones instead of crashing. */
+bool copy_from(void *dst, const void *src, const size_t size) {
+  struct iovec local = {dst, size};
+  struct iovec remote = {const_cast<void *>(src), size};
+  return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) ==
+         static_cast<ssize_t>(size);
+}
+
+bool copy_to(void *dst, const void *src, const size_t size) {
+  struct iovec local = {const_cast<void *>(src), size};
+  struct iovec remote = {dst, size};
+  return process_vm_writev(getpid(), &local, 1, &remote, 1, 0) ==
+         static_cast<ssize_t>(size);
+}
+
+bool read_time(const struct timeval *tv, nanoseconds &t) {
+  struct timeval value;
+  if (tv == nullptr || !copy_from(&value, tv, sizeof(value)))
+    return false;
+  t = seconds{value.tv_sec} + microseconds{value.tv_usec};
+  return true;
+}
+
+int check_tid(const pid_t tid) {
+  if (tid <= 0)
+    return ESRCH;
+  if (syscall(SYS_tgkill, getpid(), tid, 0) == 0)
+    return 0;
+  /* the thread exists, but in another process */
+  if (kill(tid, 0) == 0 || errno == EPERM)
+    return EPERM;
+  return ESRCH;
+}
+
+job *find_job(thread &t, const uint64_t id) {
+  if (t.current && t.current->id == id)
+    return t.current.get();
+  auto j = std::find_if(t.jobs.begin(), t.jobs.end(),
+                        [id](const job &j_) { return j_.id == id; });
+  return (j == t.jobs.end()) ? nullptr : &*j;
+}
+
+thread &simulator::self() {
+  static thread_local registration r;
+  (void)r;
+  thread &t = find_or_create(thread_id());
+  if (!t.participant) {
+    t.participant = true;
+    ++participants;
+    t.cpu = place(t);
+  }
+  ++activity;
+  return t;
+}
+
+void simulator::exit(const pid_t tid) {
+  std::lock_guard<std::mutex> l(lock);
+  thread *t = find(tid);
+  if (t == nullptr)
+    return;
+  if (t->participant)
+    --participants;
+  if (t->pool != nullptr) {
+    auto &workers = t->pool->workers;
+    workers.erase(std::remove(workers.begin(), workers.end(), t),
+                  workers.end());
+  }
+  threads.erase(tid);
+  ++activity;
+  engine.notify_one();
+}
+
+void simulator::detach() {
+  std::lock_guard<std::mutex> l(lock);
+  thread *t = find(thread_id());
+  if (t == nullptr || !t->participant)
+    return;
+  t->participant = false;
+  --participants;
+  ++activity;
+  engine.notify_one();
+}
+
+long simulator::submit(const pid_t tid, const uint64_t id,
+                       const struct timeval *exectime,
+                       const struct timeval *deadline) {
+  if (const int error = check_tid(tid))
+    return fail(error);
+  job j{id, 0ns, 0ns, 0};
+  if (!read_time(exectime, j.exectime) || !read_time(deadline, j.deadline))
+    return fail(EFAULT);
+
+  std::lock_guard<std::mutex> l(lock);
+  self();
+  thread &t = find_or_create(tid);
+  if (std::any_of(t.jobs.begin(), t.jobs.end(),
+                  [id](const job &j_) { return j_.id == id; }))
+    return fail(EINVAL);
+  j.seq = seq++;
+  assign(t, j);
+  return 0;
+}
+
+long simulator::next(uint64_t *next) {
+  std::unique_lock<std::mutex> l(lock);
+  thread &t = self();
+  t.current.reset();
+  claim(t);
+
+  if (!t.jobs.empty()) {
+    /* fail before taking the job, like the kernel does */
+    uint64_t value;
+    if (!copy_from(&value, next, sizeof(value)) ||
+        !copy_to(next, &value, sizeof(value)))
+      return fail(EFAULT);
+  }
+
+  block(l, t, t.jobs.empty() ? state::idle : state::dispatch);
+  if (!t.current)
+    return 0;
+  if (!copy_to(next, &t.current->id, sizeof(t.current->id)))
+    return fail(EFAULT);
+  return 1;
+}
+
+long simulator::remove(const pid_t tid, const uint64_t id) {
+  if (const int error = check_tid(tid))
+    return fail(error);
+
+  std::lock_guard<std::mutex> l(lock);
+  self();
+  thread *t = find(tid);
+  if (t == nullptr || find_job(*t, id) == nullptr)
+    return fail(EINVAL);
+  if (t->current && t->current->id == id) {
+    t->current.reset();
+  } else {
+    t->jobs.erase(std::find_if(t->jobs.begin(), t->jobs.end(),
+                               [id](const job &j) { return j.id == id; }));
+    if (t->state == state::dispatch && t->jobs.empty())
+      t->state = state::idle;
+  }
+  engine.notify_one();
+  return 0;
+}
+
+long simulator::update(const pid_t tid, const uint64_t id,
+                       const struct timeval *exectime,
+                       const struct timeval *deadline) {
+  if (const int error = check_tid(tid))
+    return fail(error);
+  nanoseconds e{0}, d{0};
+  if ((exectime == nullptr && deadline == nullptr) ||
+      (exectime != nullptr && !read_time(exectime, e)) ||
+      (deadline != nullptr && !read_time(deadline, d)))
+    return fail(EFAULT);
+
+  std::lock_guard<std::mutex> l(lock);
+  self();
+  thread *t = find(tid);
+  job *j = (t == nullptr) ? nullptr : find_job(*t, id);
+  if (j == nullptr)
+    return fail(EINVAL);
+  if (exectime != nullptr)
+    j->exectime = e;
+  if (deadline != nullptr)
+    j->deadline = d;
+  engine.notify_one();
+  return 0;
+}
+
+long simulator::tp_create(uint64_t *id) {
+  if (id == nullptr)
+    return fail(EINVAL);
+
+  std::lock_guard<std::mutex> l(lock);
+  self();
+  const uint64_t tpid = next_pool;
+  if (!copy_to(id, &tpid, sizeof(tpid)))
+    return fail(EFAULT);
+  ++next_pool;
+  pools[tpid];
+  return 0;
+}
+
+long simulator::tp_destroy(const uint64_t id) {
+  std::lock_guard<std::mutex> l(lock);
+  self();
+  auto p = pools.find(id);
+  if (p == pools.end())
+    return fail(EINVAL);
+  if (!p->second.workers.empty())
+    return fail(EBUSY);
+  pools.erase(p);
+  return 0;
+}
+
+long simulator::tp_join(const uint64_t id) {
+  std::lock_guard<std::mutex> l(lock);
+  thread &t = self();
+  auto p = pools.find(id);
+  if (p == pools.end())
+    return fail(EINVAL);
+
+  /* workers are pinned, one per CPU */
+  cpu_set_t set;
+  if (t.pool != nullptr || sched_getaffinity(0, sizeof(set), &set) != 0 ||
+      CPU_COUNT(&set) != 1)
+    return fail(EBUSY);
+  t.cpu = place(t);
+  auto &workers = p->second.workers;
+  if (std::any_of(workers.begin(), workers.end(),
+                  [&t](const thread *w) { return w->cpu == t.cpu; }))
+    return fail(EBUSY);
+
+  workers.push_back(&t);
+  t.pool = &p->second;
+  return 0;
+}
+
+long simulator::tp_submit(const uint64_t tpid, const uint64_t id,
+                          const struct timeval *exectime,
+                          const struct timeval *deadline) {
+  job j{id, 0ns, 0ns, 0};
+  const bool valid =
+      read_time(exectime, j.exectime) && read_time(deadline, j.deadline);
+
+  std::lock_guard<std::mutex> l(lock);
+  self();
+  auto p = pools.find(tpid);
+  if (p == pools.end())
+    return fail(EINVAL);
+  if (p->second.workers.empty())
+    return fail(EBUSY);
+  if (!valid)
+    return fail(EFAULT);
+
+  j.seq = seq++;
+  auto &workers = p->second.workers;
+  auto idle = std::find_if(workers.begin(), workers.end(), [](thread *w) {
+    return w->state == state::idle;
+  });
+  if (idle != workers.end())
+    assign(**idle, j);
+  else
+    p->second.jobs.push_back(j);
+  return 0;
+}
+
+void simulator::sleep_until(const nanoseconds t) {
+  std::unique_lock<std::mutex> l(lock);
+  thread &self_ = self();
+  if (t <= time())
+    return;
+  self_.until = t;
+  block(l, self_, state::sleeping);
+}
+
+void simulator::execute(const nanoseconds duration) {
+  std::unique_lock<std::mutex> l(lock);
+  thread &self_ = self();
+  if (duration <= 0ns)
+    return;
+  self_.remaining = duration;
+  block(l, self_, state::executing);
+}
+
+nanoseconds from_timespec(const struct timespec *ts) {
+  return seconds{ts->tv_sec} + nanoseconds{ts->tv_nsec};
+}
+}
+
+extern "C" {
+
+long atlas_sim_submit(pid_t tid, uint64_t id,
+                      const struct timeval *const exectime,
+                      const struct timeval *const deadline) {
+  return sim().submit(tid, id, exectime, deadline);
+}
+
+long atlas_sim_next(uint64_t *next) { return sim().next(next); }
+
+long atlas_sim_remove(pid_t tid, uint64_t id) { return sim().remove(tid, id); }
+
+long atlas_sim_update(pid_t tid, uint64_t id,
+                      const struct timeval *const exectime,
+                      const struct timeval *const deadline) {
+  return sim().update(tid, id, exectime, deadline);
+}
+
+long atlas_sim_tp_create(uint64_t *id) { return sim().tp_create(id); }
+
+long atlas_sim_tp_destroy(uint64_t id) { return sim().tp_destroy(id); }
+
+long atlas_sim_tp_join(uint64_t id) { return sim().tp_join(id); }
+
+long atlas_sim_tp_submit(uint64_t tpid, uint64_t id,
+                         const struct timeval *const exectime,
+                         const struct timeval *const deadline) {
+  return sim().tp_submit(tpid, id, exectime, deadline);
+}
+
+struct timespec atlas_sim_now(void) {
+  const auto now = sim().time();
+  const auto secs = duration_cast<seconds>(now);
+  struct timespec ts;
+  ts.tv_sec = static_cast<time_t>(secs.count());
+  ts.tv_nsec = static_cast<long>((now - secs).count());
+  return ts;
+}
+
+void atlas_sim_sleep_until(const struct timespec *t) {
+  sim().sleep_until(from_timespec(t));
+}
+
+void atlas_sim_execute(const struct timespec *duration) {
+  sim().execute(from_timespec(duration));
+}
+
+void atlas_sim_detach(void) { sim().detach(); }
+}
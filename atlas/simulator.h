@@ -0,0 +1,111 @@
+#pragma once
+
+/* Userspace simulator of the ATLAS system calls in virtual time.
+ *
+ * The simulator keeps jobs, thread pools and a per-CPU schedule like the
+ * kernel does, but runs the CPUs on a virtual clock. Work is not executed,
+ * but declared with atlas_sim_execute(); the calling thread blocks until the
+ * simulated CPU gave it that much service. Virtual time advances only when
+ * every thread taking part in the simulation is blocked in the simulator
+ * (in atlas_next(), atlas_sim_execute() or atlas_sim_sleep_until()), so
+ * code between those calls takes no virtual time. A thread takes part from
+ * each call into the simulator until it exits or calls atlas_sim_detach(),
+ * e.g. before joining other threads. If a taking part thread blocks
+ * elsewhere, time advances after ATLAS_SIM_GRACE milliseconds (default 10)
+ * of inactivity.
+ *
+ * The simulated CPUs are those of the affinity mask of the process, or
+ * ATLAS_SIM_CPUS. Threads pinned to a single CPU run there; others are
+ * placed on the CPU with the fewest threads.
+ *
+ * Build with -DATLAS_SIMULATOR to route the functions in atlas/atlas.h to the
+ * simulator and link the atlas-sim library. */
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __cplusplus
+#include <chrono>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+long atlas_sim_submit(pid_t tid, uint64_t id,
+                      const struct timeval *const exectime,
+                      const struct timeval *const deadline);
+long atlas_sim_next(uint64_t *next);
+long atlas_sim_remove(pid_t tid, uint64_t id);
+long atlas_sim_update(pid_t tid, uint64_t id,
+                      const struct timeval *const exectime,
+                      const struct timeval *const deadline);
+long atlas_sim_tp_create(uint64_t *id);
+long atlas_sim_tp_destroy(uint64_t id);
+long atlas_sim_tp_join(uint64_t id);
+long atlas_sim_tp_submit(uint64_t tpid, uint64_t id,
+                         const struct timeval *const exectime,
+                         const struct timeval *const deadline);
+
+/* Virtual time, starting at 0. */
+struct timespec atlas_sim_now(void);
+/* Blocks the calling thread until the virtual time t. */
+void atlas_sim_sleep_until(const struct timespec *t);
+/* Runs the calling thread for duration of virtual CPU time. */
+void atlas_sim_execute(const struct timespec *duration);
+/* Stops the calling thread from holding back virtual time. */
+void atlas_sim_detach(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+
+namespace atlas {
+namespace sim {
+
+class clock {
+public:
+  using rep = std::chrono::nanoseconds::rep;
+  using period = std::chrono::nanoseconds::period;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<clock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() {
+    const struct timespec now = atlas_sim_now();
+    return time_point{std::chrono::seconds{now.tv_sec} +
+                      std::chrono::nanoseconds{now.tv_nsec}};
+  }
+};
+
+namespace detail {
+template <class Rep, class Period>
+struct timespec to_timespec(const std::chrono::duration<Rep, Period> &d) {
+  using namespace std::chrono;
+  const auto secs = duration_cast<seconds>(d);
+  return {static_cast<time_t>(secs.count()),
+          static_cast<long>(duration_cast<nanoseconds>(d - secs).count())};
+}
+}
+
+template <class Duration>
+void sleep_until(const std::chrono::time_point<clock, Duration> &t) {
+  const struct timespec ts = detail::to_timespec(t.time_since_epoch());
+  atlas_sim_sleep_until(&ts);
+}
+
+template <class Rep, class Period>
+void execute(const std::chrono::duration<Rep, Period> &duration) {
+  const struct timespec ts = detail::to_timespec(duration);
+  atlas_sim_execute(&ts);
+}
+
+static inline void detach() { atlas_sim_detach(); }
+}
+}
+
+#endif /* __cplusplus */
@@ -49,7 +49,7 @@ protected:
   uint64_t id{0};
   virtual void SetUp() {
     atlas::np::submit(std::this_thread::get_id(), ++id, 1s,
-                      steady_clock::now() + 1s);
+                      atlas::clock::now() + 1s);
   }
   virtual void TearDown() {
     /* grab the job, if not done by the testcase */
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "atlas/benchmarks/schedulability.h"
+
+/* Tests of the schedulability analysis on task sets with known verdicts. */
+
+using namespace std::chrono;
+
+/* Task of e ms every p ms. */
+static task_attr task(const int64_t e, const int64_t p) {
+  return {milliseconds{e}, milliseconds{p}, U{1000 * e / p}};
+}
+
+TEST(SchedulabilityTest, FullUtilizationIsSchedulable) {
+  const std::vector<task_attr> tasks{task(5, 10), task(10, 20), task(0, 30)};
+  EXPECT_DOUBLE_EQ(utilization_sum(tasks), 1.0);
+  EXPECT_TRUE(edf_utilization(tasks));
+  EXPECT_TRUE(edf_demand(tasks));
+  EXPECT_EQ(analyze(tasks), verdict::schedulable);
+  /* with overhead it no longer fits, but may still run */
+  EXPECT_EQ(analyze(tasks, 1, microseconds{100}), verdict::unknown);
+}
+
+TEST(SchedulabilityTest, OverloadIsUnschedulable) {
+  const std::vector<task_attr> tasks{task(6, 10), task(10, 20)};
+  EXPECT_FALSE(edf_utilization(tasks));
+  EXPECT_FALSE(edf_demand(tasks));
+  EXPECT_EQ(analyze(tasks), verdict::unschedulable);
+}
+
+TEST(SchedulabilityTest, DemandBound) {
+  const std::vector<task_attr> tasks{task(2, 5), task(3, 7)};
+  EXPECT_EQ(demand_bound(tasks, milliseconds{4}), milliseconds{0});
+  EXPECT_EQ(demand_bound(tasks, milliseconds{5}), milliseconds{2});
+  EXPECT_EQ(demand_bound(tasks, milliseconds{14}), milliseconds{10});
+}
+
+TEST(SchedulabilityTest, Feasible) {
+  EXPECT_TRUE(feasible({task(6, 10), task(6, 10), task(8, 10)}, 2));
+  EXPECT_FALSE(feasible({task(6, 10), task(6, 10), task(9, 10)}, 2));
+  /* a job longer than its period fits on no number of cores */
+  EXPECT_FALSE(feasible({task(12, 10)}, 4));
+}
+
+TEST(SchedulabilityTest, GoossensFunkBaruah) {
+  /* U = 1.15 <= 2 - 0.5 */
+  const std::vector<task_attr> tasks{task(2, 10), task(18, 40), task(10, 20)};
+  EXPECT_TRUE(gedf_gfb(tasks, 2));
+  /* each task's window is filled by carry-in from the two others */
+  EXPECT_FALSE(gedf_bcl(tasks, 2));
+  EXPECT_EQ(analyze(tasks, 2), verdict::schedulable);
+}
+
+TEST(SchedulabilityTest, BertognaCirineiLipari) {
+  /* U = 1.6 > 2 - 0.9, but the interference in each window is bounded by
+   * its slack: 0.1 + 0.033 < 2 * 0.1 for the heavy task */
+  const std::vector<task_attr> tasks{task(27, 30), task(20, 30), task(1, 30)};
+  EXPECT_FALSE(gedf_gfb(tasks, 2));
+  EXPECT_TRUE(gedf_bcl(tasks, 2));
+  EXPECT_EQ(analyze(tasks, 2), verdict::schedulable);
+}
+
+TEST(SchedulabilityTest, DhallEffect) {
+  /* light tasks due first delay the heavy one on both cores */
+  const std::vector<task_attr> tasks{task(2, 10), task(2, 10), task(10, 11)};
+  EXPECT_TRUE(feasible(tasks, 2));
+  EXPECT_FALSE(gedf_gfb(tasks, 2));
+  EXPECT_FALSE(gedf_bcl(tasks, 2));
+  EXPECT_EQ(analyze(tasks, 2), verdict::unknown);
+  EXPECT_EQ(analyze({task(10, 10), task(10, 10), task(1, 10)}, 2),
+            verdict::unschedulable);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,149 @@
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "predictor/predictor.h"
+#include "trace.h"
+
+/* Measures the first jobs of new job types with and without a bootstrap
+ * policy. The first half of a trace trains the recorded types; the second
+ * half is replayed as new types, which may be seeded from the recorded ones.
+ * Reports misses, best-effort jobs and efficiency over the first 1000 jobs
+ * of each new type.
+ * Usage: bootstrap <trace> */
+
+using namespace std::chrono;
+using config = atlas::estimator::config;
+using trace::record;
+
+static constexpr uint64_t first_jobs = 1000;
+/* the warm-up is also reported separately */
+static constexpr uint64_t early_jobs = 20;
+/* new types are the recorded ones with this bit set */
+static constexpr uint64_t new_type = 1ULL << 40;
+
+struct result {
+  uint64_t jobs = 0;
+  uint64_t best_effort = 0;
+  uint64_t misses = 0;
+  uint64_t early = 0;
+  uint64_t early_misses = 0;
+  nanoseconds executed{0};
+  nanoseconds reserved{0};
+};
+
+static void replay(atlas::estimator &estimator,
+                   std::vector<record>::const_iterator begin,
+                   std::vector<record>::const_iterator end,
+                   const uint64_t offset, result *result) {
+  std::map<uint64_t, std::deque<nanoseconds>> reservations;
+  std::map<uint64_t, uint64_t> jobs;
+
+  for (auto r = begin; r != end; ++r) {
+    const uint64_t type = r->type | offset;
+    auto &pending = reservations[type];
+    if (r->action == 'p') {
+      /* job id 0, because each job-type processes in FIFO order */
+      pending.push_back(estimator.predict(type, 0, r->values.data() + 2,
+                                          r->values.size() - 2));
+    } else if (r->action == 't' && !pending.empty()) {
+      const auto exectime =
+          duration_cast<nanoseconds>(duration<double>{r->values.at(0)} + 0.5ns);
+      const auto reservation = pending.front();
+      pending.pop_front();
+      estimator.train(type, 0, exectime);
+
+      const uint64_t job = jobs[type]++;
+      if (result == nullptr || job >= first_jobs)
+        continue;
+      ++result->jobs;
+      if (reservation.count() == 0) {
+        ++result->best_effort;
+        continue;
+      }
+      const bool miss = exectime > reservation;
+      result->misses += miss;
+      if (job < early_jobs) {
+        ++result->early;
+        result->early_misses += miss;
+      }
+      result->executed += exectime;
+      result->reserved += reservation;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <trace>" << std::endl;
+    return 1;
+  }
+
+  const auto records = trace::load(argv[1]);
+  auto half = records.begin() + static_cast<ptrdiff_t>(records.size() / 2);
+  while (half != records.end() && half->action != 'p')
+    ++half;
+
+  /* twice the longest execution time seen is a conservative budget */
+  std::map<uint64_t, nanoseconds> budgets;
+  for (auto r = records.begin(); r != half; ++r)
+    if (r->action == 't')
+      budgets[r->type] = std::max(
+          budgets[r->type],
+          2 * duration_cast<nanoseconds>(duration<double>{r->values.at(0)}));
+
+  struct policy {
+    std::string name;
+    size_t bootstrap;
+    bool budget;
+    bool seeded;
+  };
+  const std::vector<policy> policies = {
+      {"none", 0, false, false},
+      {"best-effort", first_jobs, false, false},
+      {"budget", first_jobs, true, false},
+      {"seeded", 0, false, true},
+      {"seeded+budget", first_jobs, true, true}};
+
+  std::cout << std::left << std::setw(16) << "bootstrap" << std::right
+            << std::setw(8) << "jobs" << std::setw(13) << "best-effort"
+            << std::setw(12) << "misses" << std::setw(13) << "efficiency"
+            << std::setw(22) << ("misses in first " + std::to_string(early_jobs))
+            << std::endl;
+
+  for (const auto &policy : policies) {
+    atlas::estimator estimator(nullptr, nullptr);
+    replay(estimator, records.begin(), half, 0, nullptr);
+
+    for (const auto &type : budgets) {
+      config c;
+      c.bootstrap = policy.bootstrap;
+      if (policy.budget)
+        c.bootstrap_budget = type.second;
+      estimator.configure(type.first | new_type, c);
+      if (policy.seeded)
+        estimator.seed(type.first | new_type, type.first);
+    }
+
+    result result;
+    replay(estimator, half, records.end(), new_type, &result);
+
+    const auto percent = [](const double part, const double whole) {
+      return (whole > 0.0) ? 100.0 * part / whole : 0.0;
+    };
+    std::cout << std::left << std::setw(16) << policy.name << std::right
+              << std::setw(8) << result.jobs << std::setw(13)
+              << result.best_effort << std::fixed << std::setprecision(2)
+              << std::setw(11)
+              << percent(result.misses, result.jobs - result.best_effort)
+              << "%" << std::setw(12)
+              << percent(result.executed.count(), result.reserved.count())
+              << "%" << std::setw(21)
+              << percent(result.early_misses, result.early) << "%"
+              << std::endl;
+  }
+}
@@ -0,0 +1,53 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "predictor/predictor.h"
+
+/* Measures how long it takes to save and load the state of an estimator with
+ * many trained job types.
+ * Usage: cold_start [types] [metrics] [file] */
+
+using namespace std::chrono;
+
+int main(int argc, char *argv[]) {
+  const uint64_t types = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 30000;
+  const size_t count = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 15;
+  const char *fname = (argc > 3) ? argv[3] : "cold_start.state";
+
+  std::mt19937_64 gen;
+  std::uniform_real_distribution<double> dist(0.0, 1000.0);
+  std::vector<double> metrics(count);
+
+  {
+    atlas::estimator estimator(nullptr, nullptr);
+    for (uint64_t type = 0; type < types; ++type) {
+      for (uint64_t id = 0; id < 4; ++id) {
+        for (auto &metric : metrics)
+          metric = dist(gen);
+        estimator.predict(type, id, metrics.data(), count);
+        estimator.train(type, id, microseconds(static_cast<int>(dist(gen))));
+      }
+    }
+
+    const auto start = steady_clock::now();
+    estimator.save(fname);
+    const auto end = steady_clock::now();
+    std::cout << "Saving " << types << " types with " << count << " metrics: "
+              << duration_cast<milliseconds>(end - start).count() << "ms"
+              << std::endl;
+  }
+
+  {
+    const auto start = steady_clock::now();
+    atlas::estimator estimator(fname, nullptr);
+    const auto end = steady_clock::now();
+    std::cout << "Loading: " << duration_cast<milliseconds>(end - start).count()
+              << "ms" << std::endl;
+  }
+
+  std::remove(fname);
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "llsp.h"
+}
+
+/* Measures the cost of adding a sample to an LLSP solver with 1 to 64
+ * metrics. Usage: llsp_add [samples per metric count] */
+
+using namespace std::chrono;
+
+struct llsp_disposer {
+  void operator()(llsp_t *llsp) { llsp_dispose(llsp); }
+};
+
+static nanoseconds run(const size_t metrics, const size_t samples) {
+  std::unique_ptr<llsp_t, llsp_disposer> llsp{llsp_new(metrics)};
+  std::mt19937_64 gen(metrics);
+  std::uniform_real_distribution<double> dist(0.0, 1000.0);
+
+  /* pre-generate samples, so only llsp_add is timed */
+  std::vector<double> values(samples * (metrics + 1));
+  for (auto &value : values) {
+    value = dist(gen);
+  }
+
+  /* warm up caches and fill the matrix */
+  for (size_t i = 0; i < metrics + 1; ++i) {
+    llsp_add(llsp.get(), &values[i * (metrics + 1)], values[i * (metrics + 1) + metrics]);
+  }
+
+  const auto start = steady_clock::now();
+  for (size_t i = 0; i < samples; ++i) {
+    const double *sample = &values[i * (metrics + 1)];
+    llsp_add(llsp.get(), sample, sample[metrics]);
+  }
+  const auto end = steady_clock::now();
+
+  return duration_cast<nanoseconds>(end - start);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t samples = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+  std::cout << "metrics ns/add" << std::endl;
+  for (size_t metrics = 1; metrics <= 64; ++metrics) {
+    const auto elapsed = run(metrics, samples);
+    std::cout << std::setw(7) << metrics << " " << std::fixed << std::setprecision(1)
+              << static_cast<double>(elapsed.count()) / samples << std::endl;
+  }
+}
@@ -0,0 +1,128 @@
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "predictor/predictor.h"
+#include "trace.h"
+
+/* Replays a recorded trace, such as predictor_test_values, through each
+ * prediction model and reports how well the reservations fit the execution
+ * times.
+ * Usage: replay <trace> */
+
+using namespace std::chrono;
+using config = atlas::estimator::config;
+
+using trace::record;
+
+struct result {
+  uint64_t jobs = 0;
+  uint64_t misses = 0;
+  nanoseconds executed{0};
+  nanoseconds reserved{0};
+
+  void print(std::ostream &os) const {
+    os << std::setw(8) << jobs << std::setw(10) << std::fixed
+       << std::setprecision(2) << 100.0 * misses / jobs << "%" << std::setw(12)
+       << 100.0 * executed.count() / reserved.count() << "%";
+  }
+};
+
+static std::map<uint64_t, result> replay(const std::vector<record> &trace,
+                                         const config &config) {
+  atlas::estimator estimator(nullptr, nullptr);
+  std::map<uint64_t, std::deque<nanoseconds>> reservations;
+  std::map<uint64_t, result> results;
+
+  for (const auto &record : trace) {
+    auto &pending = reservations[record.type];
+    if (record.action == 'p') {
+      /* the recorded prediction and reservation precede the metrics */
+      if (results.find(record.type) == results.end()) {
+        estimator.configure(record.type, config);
+        results[record.type];
+      }
+      const auto &values = record.values;
+      /* job id 0, because each job-type processes in FIFO order */
+      pending.push_back(estimator.predict(record.type, 0, values.data() + 2,
+                                          values.size() - 2));
+    } else if (record.action == 't') {
+      const auto exectime = duration_cast<nanoseconds>(
+          duration<double>{record.values.at(0)} + 0.5ns);
+      auto &result = results[record.type];
+      ++result.jobs;
+      result.misses += (exectime > pending.front()) ? 1 : 0;
+      result.executed += exectime;
+      result.reserved += pending.front();
+      pending.pop_front();
+      estimator.train(record.type, 0, exectime);
+    }
+  }
+
+  return results;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <trace>" << std::endl;
+    return 1;
+  }
+
+  const auto records = trace::load(argv[1]);
+
+  std::vector<std::pair<std::string, config>> models;
+  {
+    config c;
+    models.emplace_back("llsp", c);
+    c.padding = 0.95;
+    models.emplace_back("llsp pad 0.95", c);
+    c.padding = 0.99;
+    models.emplace_back("llsp pad 0.99", c);
+    c.padding = 0.0;
+    c.type = config::model::ewma;
+    models.emplace_back("ewma", c);
+    c.type = config::model::quantile;
+    c.quantile = 0.9;
+    models.emplace_back("quantile 0.90", c);
+    c.quantile = 0.95;
+    models.emplace_back("quantile 0.95", c);
+    c.quantile = 0.99;
+    models.emplace_back("quantile 0.99", c);
+    c.type = config::model::window_max;
+    models.emplace_back("window max 16", c);
+    c.window = 64;
+    models.emplace_back("window max 64", c);
+  }
+
+  std::cout << std::left << std::setw(16) << "model" << std::right
+            << std::setw(20) << "type" << std::setw(8) << "jobs"
+            << std::setw(11) << "misses" << std::setw(13) << "efficiency"
+            << std::endl;
+
+  for (const auto &model : models) {
+    const auto results = replay(records, model.second);
+    result total;
+
+    for (const auto &type : results) {
+      std::cout << std::left << std::setw(16) << model.first << std::right
+                << std::setw(20) << std::hex << std::showbase << type.first
+                << std::dec << std::noshowbase;
+      type.second.print(std::cout);
+      std::cout << std::endl;
+
+      total.jobs += type.second.jobs;
+      total.misses += type.second.misses;
+      total.executed += type.second.executed;
+      total.reserved += type.second.reserved;
+    }
+
+    std::cout << std::left << std::setw(16) << model.first << std::right
+              << std::setw(20) << "all";
+    total.print(std::cout);
+    std::cout << std::endl;
+  }
+}
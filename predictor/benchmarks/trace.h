@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "predictor/trace.h"
+
+/* Loads a recorded trace, such as predictor_test_values, in the text or the
+ * binary format of predictor/trace.h. */
+
+namespace trace {
+
+struct record {
+  char action;
+  uint64_t type;
+  std::vector<double> values;
+};
+
+static inline std::vector<record> load(const char *fname) {
+  std::vector<record> trace;
+
+  if (atlas::trace::is_binary(fname)) {
+    atlas::trace::reader reader(fname);
+    trace.reserve(reader.records());
+    while (const auto *r = reader.next())
+      trace.push_back({static_cast<char>(r->action), r->type,
+                       {r->values(), r->values() + r->count}});
+    return trace;
+  }
+
+  std::ifstream file(fname);
+  if (!file)
+    throw std::runtime_error(std::string("Unable to open ") + fname);
+
+  std::string line;
+  record r;
+  while (std::getline(file, line))
+    if (atlas::trace::parse(line.c_str(), r.action, r.type, r.values))
+      trace.push_back(r);
+
+  return trace;
+}
+}
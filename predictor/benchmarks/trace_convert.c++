@@ -0,0 +1,40 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "predictor/trace.h"
+
+/* Converts a text trace, such as predictor_test_values, to a binary trace.
+ * Usage: trace_convert <text trace> <binary trace> */
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <text trace> <binary trace>"
+              << std::endl;
+    return 1;
+  }
+
+  std::ifstream file(argv[1]);
+  if (!file) {
+    std::cerr << "Unable to open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  atlas::trace::writer writer(argv[2]);
+  std::string line;
+  std::vector<double> values;
+  char action;
+  uint64_t type;
+  uint64_t records = 0;
+
+  while (std::getline(file, line)) {
+    if (!atlas::trace::parse(line.c_str(), action, type, values))
+      continue;
+    writer.append(type, action, values);
+    ++records;
+  }
+
+  writer.commit();
+  std::cout << records << " records converted." << std::endl;
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "predictor/model.h"
+#include "predictor/trace.h"
+
+/* Replays a binary trace through the default prediction model and verifies
+ * that every prediction is bit-identical to the recorded one. Job types are
+ * independent, so the trace is sharded by type across threads.
+ * Usage: trace_replay <binary trace> [threads] */
+
+using namespace std::chrono;
+using atlas::trace::record;
+
+struct mismatch {
+  uint64_t type;
+  uint64_t index; /* of the prediction within its type */
+  double recorded;
+  double replayed;
+};
+
+struct shard {
+  std::vector<const record *> records;
+  uint64_t predictions = 0;
+  std::vector<mismatch> mismatches;
+};
+
+/* Replays the records of some job types, as the estimator would with its
+ * default configuration: a constant metric is appended and the model is
+ * solved after every training. */
+static void replay(shard &shard) {
+  struct type {
+    std::unique_ptr<atlas::model> model;
+    std::shared_ptr<const atlas::coefficients> coefficients;
+    size_t count;
+    uint64_t predictions = 0;
+    std::deque<std::vector<double>> jobs;
+  };
+
+  const atlas::estimator::config config;
+  std::unordered_map<uint64_t, type> types;
+
+  for (const record *r : shard.records) {
+    if (r->action == record::prediction) {
+      auto it = types.find(r->type);
+      if (it == types.end()) {
+        it = types.emplace(r->type, type{}).first;
+        it->second.model = atlas::make_model(config, r->metric_count());
+        it->second.coefficients = it->second.model->snapshot();
+        it->second.count = r->metric_count();
+      }
+      auto &t = it->second;
+      if (r->metric_count() != t.count)
+        throw std::runtime_error("Metric count of type " +
+                                 std::to_string(r->type) + " changed.");
+
+      std::vector<double> metrics(r->metrics(), r->metrics() + t.count);
+      metrics.push_back(1.0);
+      const double predicted = t.coefficients->predict(metrics.data());
+      if (std::memcmp(&predicted, r->values(), sizeof(predicted)) != 0)
+        shard.mismatches.push_back(
+            {r->type, t.predictions, r->predicted(), predicted});
+      ++t.predictions;
+      ++shard.predictions;
+      t.jobs.push_back(std::move(metrics));
+    } else {
+      auto it = types.find(r->type);
+      if (it == types.end() || it->second.jobs.empty())
+        throw std::runtime_error("Training without prediction for type " +
+                                 std::to_string(r->type));
+      auto &t = it->second;
+      t.model->add(t.jobs.front().data(), r->exectime());
+      t.model->solve();
+      t.coefficients = t.model->snapshot();
+      t.jobs.pop_front();
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <binary trace> [threads]"
+              << std::endl;
+    return 1;
+  }
+
+  const size_t threads =
+      (argc > 2) ? std::strtoul(argv[2], nullptr, 10)
+                 : std::max(std::thread::hardware_concurrency(), 1U);
+  const auto start = steady_clock::now();
+
+  atlas::trace::reader reader(argv[1]);
+
+  /* count the records of each type to balance the shards */
+  std::unordered_map<uint64_t, size_t> sizes;
+  while (const record *r = reader.next())
+    ++sizes[r->type];
+
+  std::vector<std::pair<size_t, uint64_t>> order;
+  for (const auto &type : sizes)
+    order.emplace_back(type.second, type.first);
+  std::sort(order.rbegin(), order.rend());
+
+  /* largest types first, each to the least loaded shard */
+  std::vector<shard> shards(std::max<size_t>(std::min(threads, order.size()), 1));
+  std::unordered_map<uint64_t, shard *> assignment;
+  using load = std::pair<size_t, size_t>;
+  std::priority_queue<load, std::vector<load>, std::greater<load>> loads;
+  for (size_t s = 0; s < shards.size(); ++s)
+    loads.emplace(0, s);
+  for (const auto &type : order) {
+    auto least = loads.top();
+    loads.pop();
+    assignment[type.second] = &shards[least.second];
+    shards[least.second].records.reserve(least.first + type.first);
+    loads.emplace(least.first + type.first, least.second);
+  }
+
+  reader.rewind();
+  while (const record *r = reader.next())
+    assignment[r->type]->records.push_back(r);
+
+  const auto loaded = steady_clock::now();
+
+  std::vector<std::thread> workers;
+  std::mutex error_lock;
+  std::string error;
+  for (auto &shard : shards)
+    workers.emplace_back([&shard, &error_lock, &error] {
+      try {
+        replay(shard);
+      } catch (const std::exception &e) {
+        std::lock_guard<std::mutex> l(error_lock);
+        error = e.what();
+      }
+    });
+  for (auto &worker : workers)
+    worker.join();
+
+  const auto end = steady_clock::now();
+
+  if (!error.empty()) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+
+  uint64_t predictions = 0;
+  uint64_t mismatches = 0;
+  for (const auto &shard : shards) {
+    predictions += shard.predictions;
+    for (const auto &m : shard.mismatches)
+      if (mismatches++ < 10)
+        std::cerr << std::hexfloat << "Type " << m.type << " prediction "
+                  << m.index << ": recorded " << m.recorded << ", replayed "
+                  << m.replayed << std::defaultfloat << std::endl;
+  }
+
+  std::cout << reader.records() << " records, " << sizes.size()
+            << " types, " << shards.size() << " shards" << std::endl;
+  std::cout << predictions << " predictions, " << mismatches
+            << " mismatches" << std::endl;
+  std::cout << "index " << duration<double, std::milli>(loaded - start).count()
+            << "ms, replay " << duration<double, std::milli>(end - loaded).count()
+            << "ms" << std::endl;
+
+  return (mismatches == 0) ? 0 : 2;
+}
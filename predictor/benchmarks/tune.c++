@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "predictor/predictor.h"
+#include "trace.h"
+
+/* Replays a recorded trace, such as predictor_test_values, with every LLSP
+ * aging factor and column contribution of a grid and reports the parameters
+ * with the smallest prediction error for each job type. Grid points are
+ * replayed in parallel.
+ * Usage: tune <trace> [threads] */
+
+using namespace std::chrono;
+using config = atlas::estimator::config;
+
+using trace::record;
+
+static const double agings[] = {0.0,   0.001, 0.002, 0.005, 0.01,
+                                0.02,  0.05,  0.1,   0.2};
+static const double contributions[] = {1.0, 1.02, 1.05, 1.1, 1.2, 1.5, 2.0};
+
+struct error {
+  uint64_t jobs = 0;
+  double absolute = 0.0; /* sum of absolute prediction errors in seconds */
+  double executed = 0.0; /* sum of execution times in seconds */
+
+  /* mean absolute error relative to the mean execution time */
+  double relative() const { return absolute / executed; }
+};
+
+static std::map<uint64_t, error> replay(const std::vector<record> &trace,
+                                        const config &config) {
+  atlas::estimator estimator(nullptr, nullptr);
+  std::map<uint64_t, std::deque<double>> predictions;
+  std::map<uint64_t, error> errors;
+
+  for (const auto &record : trace) {
+    auto &pending = predictions[record.type];
+    if (record.action == 'p') {
+      if (errors.find(record.type) == errors.end()) {
+        estimator.configure(record.type, config);
+        errors[record.type];
+      }
+      const auto &values = record.values;
+      /* job id 0, because each job-type processes in FIFO order */
+      const auto reservation = estimator.predict(
+          record.type, 0, values.data() + 2, values.size() - 2);
+      const auto prediction = reservation - estimator.padding(record.type);
+      pending.push_back(duration_cast<duration<double>>(prediction).count());
+    } else if (record.action == 't') {
+      const double exectime = record.values.at(0);
+      auto &error = errors[record.type];
+      ++error.jobs;
+      error.absolute += std::abs(exectime - pending.front());
+      error.executed += exectime;
+      pending.pop_front();
+      estimator.train(record.type, 0,
+                      duration_cast<nanoseconds>(duration<double>{exectime} +
+                                                 0.5ns));
+    }
+  }
+
+  return errors;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <trace> [threads]" << std::endl;
+    return 1;
+  }
+
+  const auto records = trace::load(argv[1]);
+  const unsigned threads =
+      (argc > 2) ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10))
+                 : std::max(std::thread::hardware_concurrency(), 1U);
+
+  std::vector<config> grid;
+  for (const double aging : agings)
+    for (const double contribution : contributions) {
+      config c;
+      c.aging = aging;
+      c.contribution = contribution;
+      grid.push_back(c);
+    }
+
+  std::vector<std::map<uint64_t, error>> results(grid.size());
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (unsigned worker = 0; worker < threads; ++worker)
+    workers.emplace_back([&] {
+      for (size_t point; (point = next++) < grid.size();)
+        results[point] = replay(records, grid[point]);
+    });
+  for (auto &worker : workers)
+    worker.join();
+
+  const config defaults;
+  const auto default_point = static_cast<size_t>(
+      std::find_if(grid.begin(), grid.end(),
+                   [&](const config &c) {
+                     return c.aging == defaults.aging &&
+                            c.contribution == defaults.contribution;
+                   }) -
+      grid.begin());
+
+  std::cout << std::right << std::setw(20) << "type" << std::setw(8) << "jobs"
+            << std::setw(10) << "aging" << std::setw(14) << "contribution"
+            << std::setw(10) << "error" << std::setw(10) << "default"
+            << std::endl;
+
+  for (const auto &type : results.front()) {
+    size_t best = 0;
+    for (size_t point = 1; point < grid.size(); ++point)
+      if (results[point][type.first].relative() <
+          results[best][type.first].relative())
+        best = point;
+
+    std::cout << std::setw(20) << std::hex << std::showbase << type.first
+              << std::dec << std::noshowbase << std::setw(8) << type.second.jobs
+              << std::fixed << std::setprecision(3) << std::setw(10)
+              << grid[best].aging << std::setprecision(2) << std::setw(14)
+              << grid[best].contribution << std::setw(9)
+              << 100.0 * results[best][type.first].relative() << "%";
+    if (default_point < grid.size())
+      std::cout << std::setw(9)
+                << 100.0 * results[default_point][type.first].relative() << "%";
+    std::cout << std::endl;
+  }
+}
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "predictor/predictor.h"
+#include "predictor/shared.h"
+#include "trace.h"
+
+/* Measures how often a newly started process misses its reservations while
+ * its estimator warms up. A first estimator replays the first half of a
+ * trace; a second one, standing in for a new worker process, replays the
+ * second half, once with its own state and once sharing the first one's
+ * through shared memory.
+ * Usage: warmup <trace> */
+
+using namespace std::chrono;
+using trace::record;
+
+/* miss rates over the first jobs of each type */
+static constexpr size_t windows = 4;
+static constexpr uint64_t window_jobs[windows] = {10, 100, 1000, UINT64_MAX};
+
+struct misses {
+  uint64_t jobs[windows] = {};
+  uint64_t missed[windows] = {};
+
+  void add(const uint64_t job, const bool miss) {
+    for (size_t i = 0; i < windows; ++i)
+      if (job < window_jobs[i]) {
+        ++jobs[i];
+        missed[i] += miss;
+      }
+  }
+};
+
+static misses replay(atlas::estimator &estimator,
+                     std::vector<record>::const_iterator begin,
+                     std::vector<record>::const_iterator end) {
+  std::map<uint64_t, std::deque<nanoseconds>> reservations;
+  std::map<uint64_t, uint64_t> jobs;
+  misses misses;
+
+  for (auto r = begin; r != end; ++r) {
+    auto &pending = reservations[r->type];
+    if (r->action == 'p') {
+      /* job id 0, because each job-type processes in FIFO order */
+      pending.push_back(estimator.predict(r->type, 0, r->values.data() + 2,
+                                          r->values.size() - 2));
+    } else if (r->action == 't' && !pending.empty()) {
+      const auto exectime =
+          duration_cast<nanoseconds>(duration<double>{r->values.at(0)} + 0.5ns);
+      misses.add(jobs[r->type]++, exectime > pending.front());
+      pending.pop_front();
+      estimator.train(r->type, 0, exectime);
+    }
+  }
+
+  return misses;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <trace>" << std::endl;
+    return 1;
+  }
+
+  const auto records = trace::load(argv[1]);
+  /* the new process starts with a prediction */
+  auto half = records.begin() + static_cast<ptrdiff_t>(records.size() / 2);
+  while (half != records.end() && half->action != 'p')
+    ++half;
+
+  const std::string name = "/atlas-warmup-" + std::to_string(getpid());
+  atlas::estimator veteran(nullptr, name.c_str());
+  replay(veteran, records.begin(), half);
+
+  atlas::estimator unshared(nullptr, nullptr);
+  const auto cold = replay(unshared, half, records.end());
+  atlas::estimator shared(nullptr, name.c_str());
+  const auto warm = replay(shared, half, records.end());
+
+  atlas::shared::segment::unlink(name);
+
+  std::cout << std::left << std::setw(12) << "new process" << std::right;
+  for (size_t i = 0; i + 1 < windows; ++i)
+    std::cout << std::setw(12) << ("first " + std::to_string(window_jobs[i]));
+  std::cout << std::setw(12) << "all" << std::endl;
+
+  for (const auto &result :
+       {std::make_pair("unshared", cold), std::make_pair("shared", warm)}) {
+    std::cout << std::left << std::setw(12) << result.first << std::right
+              << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < windows; ++i)
+      std::cout << std::setw(11)
+                << 100.0 * result.second.missed[i] / result.second.jobs[i]
+                << "%";
+    std::cout << std::endl;
+  }
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+extern "C" {
+#include "llsp.h"
+}
+
+#include "llsp-internal.h"
+
+namespace atlas {
+namespace fixed {
+
+/* LLSP solver for a metric count known at compile time.
+ *
+ * This is the algorithm of llsp.c with all storage inline and all loop bounds
+ * known to the compiler. With T = double it computes exactly what the C
+ * solver computes. T = float halves the memory footprint at the expense of
+ * precision.
+ */
+template <size_t N, typename T = double> class llsp {
+  static_assert(N > 0, "LLSP needs at least one metric.");
+  static_assert(std::is_floating_point<T>::value,
+                "LLSP needs a floating point type.");
+
+  /* float values below this are considered to be 0 */
+  static constexpr T epsilon = static_cast<T>(1E-10);
+
+  static constexpr size_t columns = N + 1;   // metrics and target
+  static constexpr size_t rows = columns + 1; // extra row for new samples and trisolve
+  static constexpr size_t scratch = columns;  // extra column for column dropping
+  static constexpr size_t vector = 32 / sizeof(T);
+  static constexpr size_t stride = (scratch + vector) / vector * vector;
+
+  T data_[rows][stride] = {};
+  size_t sort_[columns];
+  size_t good_[columns];
+  size_t good_columns_ = columns;
+  double last_measured_ = 0.0;
+  double aging_ = AGING_FACTOR;
+  double contribution_ = COLUMN_CONTRIBUTION;
+  T result_[N] = {};
+
+  T &at(const size_t *view, const size_t row, const size_t column) {
+    return data_[row][view[column]];
+  }
+
+  static void rotate(const T *in_i, const T *in_j, T *out_i, T *out_j,
+                     const T c, const T s) {
+    for (size_t x = 0; x < stride; ++x) {
+      const T a_ix = in_i[x];
+      const T a_jx = in_j[x];
+      const T r_i = c * a_ix - s * a_jx;
+      const T r_j = s * a_ix + c * a_jx;
+
+      // reset to an actual zero for stability
+      out_i[x] = (std::abs(r_i) < epsilon) ? T(0) : r_i;
+      out_j[x] = (std::abs(r_j) < epsilon) ? T(0) : r_j;
+    }
+  }
+
+  static T norm(const T a_jj, const T a_ij) {
+    return ((a_jj < T(0)) ? T(-1) : T(1)) * std::sqrt(a_jj * a_jj + a_ij * a_ij);
+  }
+
+  void insert(const size_t row) {
+    T *const current = data_[row];
+    T *const incoming = data_[columns];
+    const size_t anchor = sort_[row];
+
+    if (std::abs(current[anchor]) < epsilon) { // already zero
+      /* the incoming row takes the place of the row */
+      current[anchor] = T(0);
+      for (size_t column = 0; column < stride; ++column) {
+        const T temp = current[column];
+        current[column] = incoming[column];
+        incoming[column] = temp;
+      }
+      return;
+    }
+
+    const T a_ij = current[anchor];
+    const T a_jj = incoming[anchor];
+    const T rho = norm(a_jj, a_ij);
+    const T c = a_jj / rho;
+    const T s = a_ij / rho;
+
+    rotate(current, incoming, incoming, current, c, s);
+
+    // the real calculation should produce the same, but this is more stable
+    incoming[anchor] = T(0);
+    current[anchor] = (std::abs(rho) < epsilon) ? T(0) : rho;
+  }
+
+  void fixup(const size_t *view, const size_t count, const size_t row,
+             const size_t column) {
+    T *const row_i = data_[row];
+    T *const row_j = data_[column];
+    const size_t anchor = view[column];
+
+    if (std::abs(row_i[anchor]) < epsilon) { // already zero
+      row_i[anchor] = T(0); // reset to an actual zero for stability
+      return;
+    }
+
+    const T a_ij = row_i[anchor];
+    const T a_jj = row_j[anchor];
+    const T rho = norm(a_jj, a_ij);
+    const T c = a_jj / rho;
+    const T s = a_ij / rho;
+
+    if (column + 1 < count)
+      rotate(row_i, row_j, row_i, row_j, c, s);
+
+    // the real calculation should produce the same, but this is more stable
+    row_i[anchor] = T(0);
+    row_j[anchor] = (std::abs(rho) < epsilon) ? T(0) : rho;
+  }
+
+  void copy_to_scratch(const size_t source) {
+    for (size_t row = 0; row < rows; ++row)
+      data_[row][scratch] = data_[row][source];
+  }
+
+  /* see stabilize() in llsp.c */
+  void stabilize() {
+    constexpr size_t index_last = columns - 1;
+
+    bool drop[columns];
+    T previous_residual = T(0);
+
+    good_columns_ = columns;
+    copy_to_scratch(sort_[index_last]);
+
+    for (size_t column = columns; column-- > 0;) {
+      good_[column] = scratch;
+      fixup(good_, good_columns_, column + 1, column);
+
+      const T residual = std::abs(at(good_, column, column));
+      if (residual >= epsilon && previous_residual >= epsilon)
+        drop[column] = (residual / previous_residual < contribution_);
+      else if (residual >= epsilon && previous_residual < epsilon)
+        drop[column] = false;
+      else
+        drop[column] = true;
+
+      previous_residual = residual;
+      good_columns_--;
+    }
+
+    /* move all to-be-dropped columns to the right */
+    size_t keep_columns = index_last;
+    for (size_t drop_column = index_last; drop_column-- > 0;) {
+      if (!drop[drop_column])
+        continue;
+
+      keep_columns--;
+
+      if (drop_column < keep_columns) {
+        const size_t temp = sort_[drop_column];
+        std::memmove(&sort_[drop_column], &sort_[drop_column + 1],
+                     (keep_columns - drop_column) * sizeof(size_t));
+        sort_[keep_columns] = temp;
+
+        for (size_t column = drop_column; column < keep_columns; ++column)
+          fixup(sort_, columns, column + 1, column);
+      }
+    }
+
+    /* setup good-column matrix */
+    good_columns_ = columns;
+    std::memcpy(good_, sort_, keep_columns * sizeof(size_t));
+    copy_to_scratch(sort_[index_last]);
+
+    for (size_t column = columns; column-- > keep_columns;) {
+      good_[column] = scratch;
+      at(good_, column, column) = T(0);
+    }
+  }
+
+  /* see trisolve() in llsp.c */
+  void trisolve() {
+    const size_t result_row = good_columns_;
+    for (size_t column = 0; column < good_columns_ - 1; ++column)
+      at(good_, result_row, column) = T(0);
+
+    for (size_t row = result_row - 1; row-- > 0;) {
+      if (std::abs(at(good_, row, row)) >= epsilon) {
+        size_t column = good_columns_ - 1;
+
+        T intermediate = at(good_, row, column);
+        for (column--; column > row; column--)
+          intermediate -= at(good_, result_row, column) * at(good_, row, column);
+        at(good_, result_row, column) = intermediate / at(good_, row, column);
+
+        for (size_t left = 0; left < row; ++left)
+          // must be upper triangular matrix
+          assert(at(good_, row, left) == T(0));
+      } else
+        at(good_, row, row) = T(0); // reset to an actual zero for stability
+    }
+  }
+
+public:
+  using value_type = T;
+  static constexpr size_t metrics = N;
+
+  llsp() {
+    for (size_t column = 0; column < columns; ++column) {
+      sort_[column] = column;
+      good_[column] = scratch;
+    }
+  }
+
+  /* see llsp_set_aging() and llsp_set_column_contribution() */
+  void set_aging(const double aging) { aging_ = aging; }
+  void set_column_contribution(const double contribution) {
+    contribution_ = contribution;
+  }
+
+  void add(const double *metrics_, const double target) {
+    const T factor = static_cast<T>(1.0 - aging_);
+
+    /* age out the past a little bit */
+    for (size_t row = 0; row < columns; ++row)
+      for (size_t column = 0; column < stride; ++column)
+        data_[row][column] *= factor;
+
+    /* put the new row into the extra row below the solving matrix */
+    T *const incoming = data_[columns];
+    for (size_t column = 0; column < stride; ++column)
+      incoming[column] = T(0);
+    for (size_t column = 0; column < N; ++column)
+      incoming[column] = static_cast<T>(metrics_[column]);
+    incoming[N] = static_cast<T>(target);
+
+    /* givens rotate the new row into the triangular matrix */
+    for (size_t row = 0; row < columns; ++row)
+      insert(row);
+
+    last_measured_ = target;
+  }
+
+  const T *solve() {
+    stabilize();
+    trisolve();
+
+    for (size_t column = 0; column < N; ++column)
+      result_[column] = data_[good_columns_][column];
+    return result_;
+  }
+
+  double predict(const double *metrics_) const {
+    double result = 0.0;
+    for (size_t i = 0; i < N; ++i)
+      result += static_cast<double>(result_[i]) * metrics_[i];
+
+    return (result >= 1E-10) ? result : last_measured_;
+  }
+
+  const T *result() const { return result_; }
+  double last_measured() const { return last_measured_; }
+
+  /* Copies the state to or from a C solver with the same metric count, whose
+   * layout is used for persistence and comparison. */
+  void store(llsp_t &state) const {
+    assert(state.metrics == N);
+    for (size_t row = 0; row < rows; ++row)
+      for (size_t column = 0; column <= scratch; ++column)
+        state.data[row * state.full.stride + column] = data_[row][column];
+    std::copy(sort_, sort_ + columns, state.sort.column);
+    std::copy(good_, good_ + columns, state.good.column);
+    state.good.columns = good_columns_;
+    state.aging = aging_;
+    state.contribution = contribution_;
+    state.last_measured = last_measured_;
+    std::copy(result_, result_ + N, state.result);
+  }
+
+  void restore(const llsp_t &state) {
+    assert(state.metrics == N);
+    for (size_t row = 0; row < rows; ++row)
+      for (size_t column = 0; column <= scratch; ++column)
+        data_[row][column] =
+            static_cast<T>(state.data[row * state.full.stride + column]);
+    std::copy(state.sort.column, state.sort.column + columns, sort_);
+    std::copy(state.good.column, state.good.column + columns, good_);
+    good_columns_ = state.good.columns;
+    aging_ = state.aging;
+    contribution_ = state.contribution;
+    last_measured_ = state.last_measured;
+    for (size_t column = 0; column < N; ++column)
+      result_[column] = static_cast<T>(state.result[column]);
+  }
+};
+}
+}
@@ -1,16 +1,28 @@
 #pragma once
 
+/* Matrix data is stored row-major in one contiguous, aligned block. Each row
+ * is padded to a multiple of the SIMD vector width and has room for one extra
+ * scratch column used for column dropping. Views refer to the physical
+ * columns by index, so columns can be reordered and aliased cheaply. */
+#define LLSP_ALIGNMENT 64
+#define LLSP_VECTOR 4
+
 struct matrix {
-  double **matrix;         // matrix data, indexed columns first, rows second
+  double  *data;           // row-major matrix data, shared by all views
+  size_t   stride;         // distance between rows in doubles
+  size_t  *column;         // physical column index of each logical column
   size_t   columns;        // column count
 };
 
 struct llsp_s {
   size_t        metrics;   // metrics count
-  double       *data;      // pointer to the malloc'ed data block, matrix is transposed
-  struct matrix full;      // pointers to the individual columns for easy column dropping
+  double       *data;      // pointer to the aligned data block
+  size_t       *index;     // pointer to the malloc'ed column index block
+  struct matrix full;      // columns in their original order
   struct matrix sort;      // matrix columns with dropped metrics moved to the right
   struct matrix good;      // reduced matrix with low-contribution columns dropped
+  double        aging;       // aging factor, AGING_FACTOR by default
+  double        contribution;  // minimum column contribution, COLUMN_CONTRIBUTION by default
   double        last_measured;
   double        result[];  // the resulting coefficients
 };
@@ -11,6 +11,11 @@
 #include <assert.h>
 #include <sys/types.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
 #include "llsp.h"
 #include "llsp-internal.h"
 
@@ -18,125 +23,308 @@
 #define EPSILON 1E-10
 
 static void givens_fixup(struct matrix m, size_t row, size_t column);
-static void stabilize(struct matrix *sort, struct matrix *good);
+static void givens_insert(struct matrix m, double *incoming, size_t row);
+static void stabilize(struct matrix *sort, struct matrix *good, double contribution);
 static void trisolve(struct matrix m);
 
 #pragma mark -
 
 
+#pragma mark Kernels
+
+/* The kernels operate on whole, padded rows. They compute exactly the same
+ * operations as the scalar code, so all variants produce identical results. */
+struct kernels {
+	/* multiplies count elements by factor */
+	void (*scale)(double *data, size_t count, double factor);
+	/* rotates two rows: out_i = c * in_i - s * in_j, out_j = s * in_i + c * in_j */
+	void (*rotate)(const double *in_i, const double *in_j, double *out_i, double *out_j,
+	               double c, double s, size_t count);
+	/* dot product, accumulated in index order */
+	double (*dot)(const double *a, const double *b, size_t count);
+};
+
+static void scale_scalar(double *data, size_t count, double factor)
+{
+	for (size_t element = 0; element < count; element++)
+		data[element] *= factor;
+}
+
+static void rotate_scalar(const double *in_i, const double *in_j, double *out_i, double *out_j,
+                          double c, double s, size_t count)
+{
+	for (size_t x = 0; x < count; x++) {
+		const double a_ix = in_i[x];
+		const double a_jx = in_j[x];
+		out_i[x] = c * a_ix - s * a_jx;
+		out_j[x] = s * a_ix + c * a_jx;
+
+		// reset to an actual zero for stability
+		if (fabs(out_i[x]) < EPSILON)
+			out_i[x] = 0.0;
+		if (fabs(out_j[x]) < EPSILON)
+			out_j[x] = 0.0;
+	}
+}
+
+static double dot_scalar(const double *a, const double *b, size_t count)
+{
+	double result = 0.0;
+	for (size_t i = 0; i < count; i++)
+		result += a[i] * b[i];
+	return result;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void scale_sse2(double *data, size_t count, double factor)
+{
+	const __m128d f = _mm_set1_pd(factor);
+	for (size_t element = 0; element < count; element += 2)
+		_mm_store_pd(data + element, _mm_mul_pd(_mm_load_pd(data + element), f));
+}
+
+__attribute__((target("sse2")))
+static void rotate_sse2(const double *in_i, const double *in_j, double *out_i, double *out_j,
+                        double c, double s, size_t count)
+{
+	const __m128d vc = _mm_set1_pd(c);
+	const __m128d vs = _mm_set1_pd(s);
+	const __m128d eps = _mm_set1_pd(EPSILON);
+	const __m128d sign = _mm_set1_pd(-0.0);
+
+	for (size_t x = 0; x < count; x += 2) {
+		const __m128d a_ix = _mm_load_pd(in_i + x);
+		const __m128d a_jx = _mm_load_pd(in_j + x);
+		__m128d r_i = _mm_sub_pd(_mm_mul_pd(vc, a_ix), _mm_mul_pd(vs, a_jx));
+		__m128d r_j = _mm_add_pd(_mm_mul_pd(vs, a_ix), _mm_mul_pd(vc, a_jx));
+
+		// reset to an actual zero for stability
+		r_i = _mm_andnot_pd(_mm_cmplt_pd(_mm_andnot_pd(sign, r_i), eps), r_i);
+		r_j = _mm_andnot_pd(_mm_cmplt_pd(_mm_andnot_pd(sign, r_j), eps), r_j);
+		_mm_store_pd(out_i + x, r_i);
+		_mm_store_pd(out_j + x, r_j);
+	}
+}
+
+__attribute__((target("sse2")))
+static double dot_sse2(const double *a, const double *b, size_t count)
+{
+	double products[2] __attribute__((aligned(16)));
+	double result = 0.0;
+	size_t i = 0;
+
+	for (; i + 2 <= count; i += 2) {
+		_mm_store_pd(products, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		result += products[0];
+		result += products[1];
+	}
+	for (; i < count; i++)
+		result += a[i] * b[i];
+
+	return result;
+}
+
+__attribute__((target("avx2")))
+static void scale_avx2(double *data, size_t count, double factor)
+{
+	const __m256d f = _mm256_set1_pd(factor);
+	for (size_t element = 0; element < count; element += 4)
+		_mm256_store_pd(data + element, _mm256_mul_pd(_mm256_load_pd(data + element), f));
+}
+
+__attribute__((target("avx2")))
+static void rotate_avx2(const double *in_i, const double *in_j, double *out_i, double *out_j,
+                        double c, double s, size_t count)
+{
+	const __m256d vc = _mm256_set1_pd(c);
+	const __m256d vs = _mm256_set1_pd(s);
+	const __m256d eps = _mm256_set1_pd(EPSILON);
+	const __m256d sign = _mm256_set1_pd(-0.0);
+
+	for (size_t x = 0; x < count; x += 4) {
+		const __m256d a_ix = _mm256_load_pd(in_i + x);
+		const __m256d a_jx = _mm256_load_pd(in_j + x);
+		__m256d r_i = _mm256_sub_pd(_mm256_mul_pd(vc, a_ix), _mm256_mul_pd(vs, a_jx));
+		__m256d r_j = _mm256_add_pd(_mm256_mul_pd(vs, a_ix), _mm256_mul_pd(vc, a_jx));
+
+		// reset to an actual zero for stability
+		r_i = _mm256_andnot_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign, r_i), eps, _CMP_LT_OQ), r_i);
+		r_j = _mm256_andnot_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign, r_j), eps, _CMP_LT_OQ), r_j);
+		_mm256_store_pd(out_i + x, r_i);
+		_mm256_store_pd(out_j + x, r_j);
+	}
+}
+
+__attribute__((target("avx2")))
+static double dot_avx2(const double *a, const double *b, size_t count)
+{
+	double products[4] __attribute__((aligned(32)));
+	double result = 0.0;
+	size_t i = 0;
+
+	/* multiply in parallel, but accumulate in order to stay bit-identical */
+	for (; i + 4 <= count; i += 4) {
+		_mm256_store_pd(products, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		result += products[0];
+		result += products[1];
+		result += products[2];
+		result += products[3];
+	}
+	for (; i < count; i++)
+		result += a[i] * b[i];
+
+	return result;
+}
+
+#endif
+
+static struct kernels kernels = { scale_scalar, rotate_scalar, dot_scalar };
+
+/* Selects the widest kernels supported by the CPU. Setting LLSP_KERNEL to
+ * "scalar", "sse2" or "avx2" restricts the choice, e.g. for comparisons. */
+__attribute__((constructor))
+static void select_kernels(void)
+{
+	const char *limit = getenv("LLSP_KERNEL");
+	if (limit && strcmp(limit, "scalar") == 0)
+		return;
+
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && !(limit && strcmp(limit, "sse2") == 0)) {
+		kernels.scale = scale_avx2;
+		kernels.rotate = rotate_avx2;
+		kernels.dot = dot_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		kernels.scale = scale_sse2;
+		kernels.rotate = rotate_sse2;
+		kernels.dot = dot_sse2;
+	}
+#endif
+}
+
+#pragma mark -
+
+
 #pragma mark LLSP API Functions
 
 llsp_t *llsp_new(size_t count)
 {
 	llsp_t *llsp;
-	
+
 	if (count < 1) return NULL;
-	
+
 	size_t llsp_size = sizeof(llsp_t) + count * sizeof(double);  // extra room for coefficients
 	llsp = malloc(llsp_size);
 	if (!llsp) return NULL;
 	memset(llsp, 0, llsp_size);
-	
+
 	llsp->metrics = count;
-	llsp->full.columns = count + 1;
-	llsp->sort.columns = count + 1;
-	llsp->good.columns = count + 1;
-	
-	if (!llsp->data) {
-		const size_t column_count = llsp->full.columns;
-		const size_t row_count = llsp->full.columns + 1;  // extra row for shifting down and trisolve
-		const size_t data_size = column_count * row_count * sizeof(double);
-		const size_t column_size = row_count * sizeof(double);
-		const size_t matrix_size = column_count * sizeof(double *);
-		const size_t index_last = column_count - 1;
-
-		llsp->data        = malloc(data_size);
-		llsp->full.matrix = malloc(matrix_size);
-		llsp->sort.matrix = malloc(matrix_size);
-		llsp->good.matrix = malloc(matrix_size);
-		if (!llsp->data || !llsp->full.matrix || !llsp->sort.matrix || !llsp->good.matrix)
-			abort();
-		
-		for (size_t column = 0; column < llsp->full.columns; column++)
-			llsp->full.matrix[column] =
-			llsp->sort.matrix[column] = llsp->data + column * row_count;
-		
-		/* we need an extra column for the column dropping scan */
-		llsp->good.matrix[index_last] = malloc(column_size);
-		if (!llsp->good.matrix[index_last]) abort();
-		
-		for (size_t column = 0; column < llsp->full.columns; column++) {
-			llsp->good.matrix[column] = llsp->good.matrix[index_last];
-		}
+	llsp->aging = AGING_FACTOR;
+	llsp->contribution = COLUMN_CONTRIBUTION;
+
+	const size_t column_count = count + 1;
+	const size_t row_count = column_count + 1;  // extra row for new samples and trisolve
+	const size_t scratch = column_count;  // extra column for the column dropping scan
+	const size_t stride = (scratch + LLSP_VECTOR) / LLSP_VECTOR * LLSP_VECTOR;
+	const size_t data_size = row_count * stride * sizeof(double);
+	const size_t index_size = 3 * column_count * sizeof(size_t);
+
+	llsp->data = aligned_alloc(LLSP_ALIGNMENT,
+	                           (data_size + LLSP_ALIGNMENT - 1) / LLSP_ALIGNMENT * LLSP_ALIGNMENT);
+	llsp->index = malloc(index_size);
+	if (!llsp->data || !llsp->index)
+		abort();
+	memset(llsp->data, 0, data_size);
 
-		memset(llsp->data, 0, data_size);
+	struct matrix *views[] = { &llsp->full, &llsp->sort, &llsp->good };
+	for (size_t view = 0; view < 3; view++) {
+		views[view]->data = llsp->data;
+		views[view]->stride = stride;
+		views[view]->column = llsp->index + view * column_count;
+		views[view]->columns = column_count;
 	}
-	
+
+	for (size_t column = 0; column < column_count; column++) {
+		llsp->full.column[column] =
+		llsp->sort.column[column] = column;
+		llsp->good.column[column] = scratch;
+	}
+
 	return llsp;
 }
 
+void llsp_set_aging(llsp_t *llsp, double aging_factor)
+{
+	llsp->aging = aging_factor;
+}
+
+void llsp_set_column_contribution(llsp_t *llsp, double contribution)
+{
+	llsp->contribution = contribution;
+}
+
 void llsp_add(llsp_t *llsp, const double *metrics, double target)
 {
 	const size_t column_count = llsp->full.columns;
-	const size_t row_count = llsp->full.columns + 1;  // extra row for shifting down and trisolve
-	const size_t data_size = column_count * row_count * sizeof(double);
+	const size_t stride = llsp->full.stride;
+	double *const incoming = llsp->data + column_count * stride;  // extra row
 
 	/* age out the past a little bit */
-	for (size_t element = 0; element < row_count * column_count; element++)
-		llsp->data[element] *= 1.0 - AGING_FACTOR;
-	
-	/* add new row to the top of the solving matrix */
-	memmove(llsp->data + 1, llsp->data, data_size - sizeof(double));
+	kernels.scale(llsp->data, column_count * stride, 1.0 - llsp->aging);
+
+	/* put the new row into the extra row below the solving matrix */
+	memset(incoming, 0, stride * sizeof(double));
 	for (size_t column = 0; column < llsp->metrics; column++)
-		llsp->full.matrix[column][0] = metrics[column];
-	llsp->full.matrix[llsp->metrics][0] = target;
-	
-	/* givens fixup of the subdiagonal */
-	for (size_t i = 0; i < llsp->sort.columns; i++)
-		givens_fixup(llsp->sort, i + 1, i);
-	
+		incoming[llsp->full.column[column]] = metrics[column];
+	incoming[llsp->full.column[llsp->metrics]] = target;
+
+	/* givens rotate the new row into the triangular matrix */
+	for (size_t i = 0; i < column_count; i++)
+		givens_insert(llsp->sort, incoming, i);
+
 	llsp->last_measured = target;
 }
 
 const double *llsp_solve(llsp_t *llsp)
 {
 	double *result = NULL;
-	
+
 	if (llsp->data) {
-		stabilize(&llsp->sort, &llsp->good);
+		stabilize(&llsp->sort, &llsp->good, llsp->contribution);
 		trisolve(llsp->good);
-		
+
 		/* collect coefficients */
-		size_t result_row = llsp->good.columns;
+		const double *result_row = llsp->data + llsp->good.columns * llsp->full.stride;
 		for (size_t column = 0; column < llsp->metrics; column++)
-			llsp->result[column] = llsp->full.matrix[column][result_row];
+			llsp->result[column] = result_row[llsp->full.column[column]];
 		result = llsp->result;
 	}
-	
+
 	return result;
 }
 
 double llsp_predict(llsp_t *llsp, const double *metrics)
 {
 	/* calculate prediction by dot product */
-	double result = 0.0;
-	for (size_t i = 0; i < llsp->metrics; i++)
-		result += llsp->result[i] * metrics[i];
-	
+	double result = kernels.dot(llsp->result, metrics, llsp->metrics);
+
 	if (result >= EPSILON)
 		return result;
 	else
 		return llsp->last_measured;
 }
 
+double llsp_dot(const double *coefficients, const double *metrics, size_t count)
+{
+	return kernels.dot(coefficients, metrics, count);
+}
+
 void llsp_dispose(llsp_t *llsp)
 {
-	const size_t index_last = llsp->good.columns - 1;
-	
-	free(llsp->good.matrix[index_last]);
-	free(llsp->full.matrix);
-	free(llsp->sort.matrix);
-	free(llsp->good.matrix);
+	free(llsp->index);
 	free(llsp->data);
 	free(llsp);
 }
@@ -146,99 +334,137 @@ void llsp_dispose(llsp_t *llsp)
 
 #pragma mark Helper Functions
 
+#define AT(m, row, column) ((m).data[(row) * (m).stride + (m).column[column]])
+
 static void givens_fixup(struct matrix m, size_t row, size_t column)
 {
-	if (fabs(m.matrix[column][row]) < EPSILON) {  // alread zero
-		m.matrix[column][row] = 0.0;  // reset to an actual zero for stability
+	double *const row_i = m.data + row * m.stride;
+	double *const row_j = m.data + column * m.stride;
+	const size_t anchor = m.column[column];
+
+	if (fabs(row_i[anchor]) < EPSILON) {  // alread zero
+		row_i[anchor] = 0.0;  // reset to an actual zero for stability
 		return;
 	}
-	
-	const size_t i = row;
-	const size_t j = column;
-	const double a_ij = m.matrix[j][i];
-	const double a_jj = m.matrix[j][j];
+
+	const double a_ij = row_i[anchor];
+	const double a_jj = row_j[anchor];
 	const double rho = ((a_jj < 0.0) ? -1.0 : 1.0) * sqrt(a_jj * a_jj + a_ij * a_ij);
 	const double c = a_jj / rho;
 	const double s = a_ij / rho;
-	
-	for (size_t x = column; x < m.columns; x++) {
-		if (x == column) {
-			// the real calculation below should produce the same, but this is more stable
-			m.matrix[x][i] = 0.0;
-			m.matrix[x][j] = rho;
-		} else {
-			const double a_ix = m.matrix[x][i];
-			const double a_jx = m.matrix[x][j];	
-			m.matrix[x][i] = c * a_ix - s * a_jx;
-			m.matrix[x][j] = s * a_ix + c * a_jx;
+
+	/* Left of the diagonal, both rows are exactly zero and stay zero, so the
+	 * rotation can run over the whole, padded rows. Views with aliased columns
+	 * (good) are only fixed up in their last column, which needs no rotation
+	 * besides the diagonal element. */
+	if (column + 1 < m.columns)
+		kernels.rotate(row_i, row_j, row_i, row_j, c, s, m.stride);
+
+	// the real calculation should produce the same, but this is more stable
+	row_i[anchor] = 0.0;
+	row_j[anchor] = (fabs(rho) < EPSILON) ? 0.0 : rho;
+}
+
+/* Rotates the incoming row against a row of the triangular matrix to zero
+ * the incoming element below the diagonal. This is the same rotation
+ * givens_fixup would do if the new row was shifted in on top of the matrix,
+ * but the triangular rows stay in place and the residual stays in the
+ * incoming row, so no bulk data movement is needed. */
+static void givens_insert(struct matrix m, double *incoming, size_t row)
+{
+	double *const current = m.data + row * m.stride;
+	const size_t anchor = m.column[row];
+
+	if (fabs(current[anchor]) < EPSILON) {  // already zero
+		/* the incoming row takes the place of the row */
+		current[anchor] = 0.0;  // reset to an actual zero for stability
+		for (size_t column = 0; column < m.stride; column++) {
+			const double temp = current[column];
+			current[column] = incoming[column];
+			incoming[column] = temp;
 		}
-		
-		// reset to an actual zero for stability
-		if (fabs(m.matrix[x][i]) < EPSILON)
-			m.matrix[x][i] = 0.0;
-		if (fabs(m.matrix[x][j]) < EPSILON)
-			m.matrix[x][j] = 0.0;
+		return;
 	}
+
+	const double a_ij = current[anchor];
+	const double a_jj = incoming[anchor];
+	const double rho = ((a_jj < 0.0) ? -1.0 : 1.0) * sqrt(a_jj * a_jj + a_ij * a_ij);
+	const double c = a_jj / rho;
+	const double s = a_ij / rho;
+
+	kernels.rotate(current, incoming, incoming, current, c, s, m.stride);
+
+	// the real calculation should produce the same, but this is more stable
+	incoming[anchor] = 0.0;
+	current[anchor] = (fabs(rho) < EPSILON) ? 0.0 : rho;
 }
 
-static void stabilize(struct matrix *sort, struct matrix *good)
+/* copies a column of the sort view to the scratch column */
+static void copy_to_scratch(const struct matrix *sort, size_t column, size_t scratch)
+{
+	const size_t row_count = sort->columns + 1;
+	const size_t source = sort->column[column];
+	for (size_t row = 0; row < row_count; row++)
+		sort->data[row * sort->stride + scratch] = sort->data[row * sort->stride + source];
+}
+
+static void stabilize(struct matrix *sort, struct matrix *good, double contribution)
 {
 	const size_t column_count = sort->columns;
-	const size_t row_count = sort->columns + 1;  // extra row for shifting down and trisolve
-	const size_t column_size = row_count * sizeof(double);
 	const size_t index_last = column_count - 1;
-	
+	const size_t scratch = good->column[index_last];
+
 	bool drop[column_count];
 	double previous_residual = 0.0;
-	
+
 	good->columns = sort->columns;
-	memcpy(good->matrix[index_last], sort->matrix[index_last], column_size);
-	
+	copy_to_scratch(sort, index_last, scratch);
+
 	/* Drop columns from right to left and watch the residual error.
 	 * We would actually copy the whole matrix, but when dropping from the right,
 	 * Givens fixup always affects only the last column, so we hand just the
 	 * last column through all possible positions. */
 	for (size_t column = index_last; (ssize_t)column >= 0; column--) {
-		good->matrix[column] = good->matrix[index_last];
+		good->column[column] = scratch;
 		givens_fixup(*good, column + 1, column);
-		
-		double residual = fabs(good->matrix[column][column]);
+
+		double residual = fabs(AT(*good, column, column));
 		if (residual >= EPSILON && previous_residual >= EPSILON)
-			drop[column] = (residual / previous_residual < COLUMN_CONTRIBUTION);
+			drop[column] = (residual / previous_residual < contribution);
 		else if (residual >= EPSILON && previous_residual < EPSILON)
 			drop[column] = false;
 		else
 			drop[column] = true;
-		
+
 		previous_residual = residual;
 		good->columns--;
 	}
 	/* The drop result for the last column is never used. The last column
 	 * represents our target vector, so we must never drop it. */
-	
+
 	/* move all to-be-dropped columns to the right */
 	size_t keep_columns = index_last;  // number of columns to keep, starts with all
 	for (size_t drop_column = index_last - 1; (ssize_t)drop_column >= 0; drop_column--) {
 		if (!drop[drop_column]) continue;
-		
+
 		keep_columns--;
-		
+
 		if (drop_column < keep_columns) {  // column must move
-			double *temp = sort->matrix[drop_column];
-			memmove(&sort->matrix[drop_column], &sort->matrix[drop_column + 1],
-					(keep_columns - drop_column) * sizeof(double *));
-			sort->matrix[keep_columns] = temp;
-			
+			size_t temp = sort->column[drop_column];
+			memmove(&sort->column[drop_column], &sort->column[drop_column + 1],
+					(keep_columns - drop_column) * sizeof(size_t));
+			sort->column[keep_columns] = temp;
+
 			for (size_t column = drop_column; column < keep_columns; column++)
 				givens_fixup(*sort, column + 1, column);
 		}
 	}
-	
+
 	/* setup good-column matrix */
 	good->columns = sort->columns;
-	memcpy(good->matrix, sort->matrix, keep_columns * sizeof(double *));  // non-drop columns
-	memcpy(good->matrix[index_last], sort->matrix[index_last], column_size);   // copy last column
-	
+	memcpy(good->column, sort->column, keep_columns * sizeof(size_t));  // non-drop columns
+	copy_to_scratch(sort, index_last, scratch);   // copy last column
+
 	/* Conceptually, we now drop the to-be-dropped columns from the right.
 	 * Again, dropping the from the right only affects the residual error
 	 * in the last column, so only it changes. Further, we no longer need
@@ -251,8 +477,8 @@ static void stabilize(struct matrix *sort, struct matrix *good)
 	 * column-reduced matrix, because the diagonal elements for all
 	 * dropped columns are zero. */
 	for (size_t column = index_last; (ssize_t)column >= (ssize_t)keep_columns; column--) {
-		good->matrix[column] = good->matrix[index_last];
-		good->matrix[column][column] = 0.0;
+		good->column[column] = scratch;
+		AT(*good, column, column) = 0.0;
 	}
 }
 
@@ -260,23 +486,23 @@ static void trisolve(struct matrix m)
 {
 	size_t result_row = m.columns;  // use extra row to solve the coefficients
 	for (size_t column = 0; column < m.columns - 1; column++)
-		m.matrix[column][result_row] = 0.0;
-	
+		AT(m, result_row, column) = 0.0;
+
 	for (size_t row = result_row - 2; (ssize_t)row >= 0; row--) {
 		size_t column = row;
-		
-		if (fabs(m.matrix[column][row]) >= EPSILON) {
+
+		if (fabs(AT(m, row, column)) >= EPSILON) {
 			column = m.columns - 1;
-			
-			double intermediate = m.matrix[column][row];
+
+			double intermediate = AT(m, row, column);
 			for (column--; column > row; column--)
-				intermediate -= m.matrix[column][result_row] * m.matrix[column][row];
-			m.matrix[column][result_row] = intermediate / m.matrix[column][row];
+				intermediate -= AT(m, result_row, column) * AT(m, row, column);
+			AT(m, result_row, column) = intermediate / AT(m, row, column);
 
 			for (column--; (ssize_t)column >= 0; column--)
 				// must be upper triangular matrix
-				assert(m.matrix[column][row] == 0.0);
+				assert(AT(m, row, column) == 0.0);
 		} else
-			m.matrix[column][row] = 0.0;  // reset to an actual zero for stability
+			AT(m, row, column) = 0.0;  // reset to an actual zero for stability
 	}
 }
@@ -29,6 +29,11 @@ typedef struct llsp_s llsp_t;
 /* Allocated a new LLSP handle with the given number of metrics. */
 llsp_t *llsp_new(size_t count);
 
+/* Override AGING_FACTOR and COLUMN_CONTRIBUTION for one LLSP, so job types
+ * with drifting or stable behavior can age at different rates. */
+void llsp_set_aging(llsp_t *llsp, double aging_factor);
+void llsp_set_column_contribution(llsp_t *llsp, double contribution);
+
 /* This function adds another tuple of (metrics, measured target value) to the
  * LLSP solution. The metrics array must have as many values as stated in count
  * on llsp_new(). */
@@ -43,5 +48,10 @@ const double *llsp_solve(llsp_t *llsp);
  * populated with a set of prediction coefficients by running llsp_solve(). */
 double llsp_predict(llsp_t *llsp, const double *metrics);
 
+/* Computes the dot product of count coefficients and metrics the same way
+ * llsp_predict() does. This allows predictions from a copy of the
+ * coefficients without the LLSP context. */
+double llsp_dot(const double *coefficients, const double *metrics, size_t count);
+
 /* Frees the LLSP context. */
 void llsp_dispose(llsp_t *llsp);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "predictor.h"
+
+extern "C" {
+#include "llsp.h"
+}
+
+namespace atlas {
+
+/* Immutable copy of a model's prediction. Predictions are computed exactly
+ * like llsp_predict(), so a snapshot can be used without holding the model. */
+struct coefficients {
+  std::vector<double> values;
+  double last_measured;
+
+  double predict(const double *metrics) const {
+    static constexpr double epsilon = 1E-10; /* EPSILON in llsp.c */
+    const double result = llsp_dot(values.data(), metrics, values.size());
+    return (result >= epsilon) ? result : last_measured;
+  }
+};
+
+/* Metric counts up to this, including the constant metric, are handled by a
+ * fixed-size solver; larger ones use the dynamic solver. */
+static constexpr size_t max_fixed_metrics = 16;
+
+/* Metrics of a job, followed by the constant metric. Metric counts with a
+ * fixed-size solver are stored in place, larger ones on the heap. */
+class metric_vector {
+  std::array<double, max_fixed_metrics> local;
+  std::unique_ptr<double[]> heap;
+  size_t count = 0;
+
+public:
+  metric_vector() = default;
+  metric_vector(const double *metrics, const size_t count_)
+      : count(count_ + 1) {
+    double *values = local.data();
+    if (count > local.size()) {
+      heap.reset(new double[count]);
+      values = heap.get();
+    }
+    std::copy_n(metrics, count_, values);
+    values[count_] = 1.0;
+  }
+  metric_vector(const metric_vector &rhs) : count(rhs.count) {
+    if (count > local.size())
+      heap.reset(new double[count]);
+    std::copy_n(rhs.data(), count, heap ? heap.get() : local.data());
+  }
+  metric_vector(metric_vector &&) = default;
+  metric_vector &operator=(const metric_vector &rhs) {
+    return *this = metric_vector(rhs);
+  }
+  metric_vector &operator=(metric_vector &&) = default;
+
+  const double *data() const { return heap ? heap.get() : local.data(); }
+  size_t size() const { return count; }
+};
+
+/* Prediction model of a job type.
+ *
+ * Models publish their predictions as linear coefficients over the metrics.
+ * The estimator appends a constant 1.0 to the metrics, so models that do not
+ * use the metrics publish their prediction as the last coefficient.
+ */
+class model {
+public:
+  using kind = estimator::config::model;
+
+  virtual ~model() = default;
+  virtual kind type() const = 0;
+  /* Returns true if the model was created from an equivalent configuration. */
+  virtual bool matches(const estimator::config &config) const = 0;
+  virtual void add(const double *metrics, double target) = 0;
+  /* Updates the coefficients after samples were added. */
+  virtual void solve() = 0;
+  virtual std::shared_ptr<const coefficients> snapshot() const = 0;
+  /* Saves and loads the state, including the model parameters. */
+  virtual void save(std::vector<uint64_t> &state) const = 0;
+  virtual void load(const uint64_t *state, size_t size) = 0;
+};
+
+/* Throws if the configuration is invalid. */
+void validate(const estimator::config &config);
+
+/* Creates a model for count metrics, not including the constant metric. */
+std::unique_ptr<model> make_model(const estimator::config &config,
+                                  size_t count);
+}
@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "model.h"
+#include "llsp-internal.h"
+#include "llsp-fixed.h"
+#include "persistence.h"
+
+namespace atlas {
+
+static uint64_t to_word(const double value) {
+  uint64_t word;
+  std::memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+static double to_double(const uint64_t word) {
+  double value;
+  std::memcpy(&value, &word, sizeof(value));
+  return value;
+}
+
+static void check_size(const size_t size, const size_t expected) {
+  if (size != expected)
+    throw std::runtime_error("Saved model state has the wrong size.");
+}
+
+/* prediction of a model that does not depend on the metrics */
+static std::shared_ptr<const coefficients>
+constant(const size_t count, const double value, const double last_measured) {
+  std::vector<double> values(count + 1, 0.0);
+  values[count] = value;
+  return std::make_shared<const coefficients>(
+      coefficients{std::move(values), last_measured});
+}
+
+struct llsp_disposer {
+  void operator()(llsp_t *llsp) { llsp_dispose(llsp); }
+};
+
+/* LLSP of the C solver, for any metric count. */
+class dynamic_llsp final : public model {
+  std::unique_ptr<llsp_t, llsp_disposer> llsp;
+
+public:
+  dynamic_llsp(const estimator::config &config, const size_t count)
+      : llsp(llsp_new(count + 1)) {
+    llsp_set_aging(llsp.get(), config.aging);
+    llsp_set_column_contribution(llsp.get(), config.contribution);
+  }
+
+  kind type() const override { return kind::llsp; }
+  bool matches(const estimator::config &config) const override {
+    return config.type == kind::llsp && config.aging == llsp->aging &&
+           config.contribution == llsp->contribution;
+  }
+  void add(const double *metrics, double target) override {
+    llsp_add(llsp.get(), metrics, target);
+  }
+  void solve() override { llsp_solve(llsp.get()); }
+  std::shared_ptr<const coefficients> snapshot() const override {
+    const auto *result = llsp->result;
+    return std::make_shared<const coefficients>(coefficients{
+        {result, result + llsp->metrics}, llsp->last_measured});
+  }
+  void save(std::vector<uint64_t> &state) const override {
+    persistence::save(*llsp, state);
+  }
+  void load(const uint64_t *state, const size_t size) override {
+    persistence::load(state, size, *llsp);
+  }
+};
+
+/* LLSP for a metric count known at compile time. The state is saved in the
+ * layout of the C solver, so both are interchangeable. */
+template <size_t N, typename T> class fixed_llsp final : public model {
+  fixed::llsp<N, T> llsp;
+  double aging;
+  double contribution;
+
+  /* conversion buffer in the layout of the C solver */
+  static llsp_t &scratch() {
+    static thread_local std::unique_ptr<llsp_t, llsp_disposer> state{
+        llsp_new(N)};
+    return *state;
+  }
+
+public:
+  fixed_llsp(const estimator::config &config)
+      : aging(config.aging), contribution(config.contribution) {
+    llsp.set_aging(aging);
+    llsp.set_column_contribution(contribution);
+  }
+
+  kind type() const override { return kind::llsp; }
+  bool matches(const estimator::config &config) const override {
+    return config.type == kind::llsp && config.aging == aging &&
+           config.contribution == contribution;
+  }
+  void add(const double *metrics, double target) override {
+    llsp.add(metrics, target);
+  }
+  void solve() override { llsp.solve(); }
+  std::shared_ptr<const coefficients> snapshot() const override {
+    const T *result = llsp.result();
+    return std::make_shared<const coefficients>(
+        coefficients{{result, result + N}, llsp.last_measured()});
+  }
+  void save(std::vector<uint64_t> &state) const override {
+    llsp.store(scratch());
+    persistence::save(scratch(), state);
+  }
+  void load(const uint64_t *state, const size_t size) override {
+    persistence::load(state, size, scratch());
+    llsp.restore(scratch());
+    aging = scratch().aging;
+    contribution = scratch().contribution;
+  }
+};
+
+/* Precision of the fixed-size solvers. Setting ATLAS_PREDICTOR_PRECISION to
+ * "float" halves their memory footprint. */
+static bool single_precision() {
+  static const bool single = [] {
+    const char *env = std::getenv("ATLAS_PREDICTOR_PRECISION");
+    if (env == nullptr || std::strcmp(env, "double") == 0)
+      return false;
+    if (std::strcmp(env, "float") == 0)
+      return true;
+    throw std::runtime_error(std::string("Unknown predictor precision ") + env);
+  }();
+  return single;
+}
+
+using llsp_factory = std::unique_ptr<model> (*)(const estimator::config &);
+
+template <size_t N, typename T>
+static std::unique_ptr<model> make_fixed(const estimator::config &config) {
+  return std::make_unique<fixed_llsp<N, T>>(config);
+}
+
+template <typename T, size_t... N>
+static constexpr std::array<llsp_factory, sizeof...(N)>
+fixed_llsps(std::index_sequence<N...>) {
+  return {{&make_fixed<N + 1, T>...}};
+}
+
+static std::unique_ptr<model> make_llsp(const estimator::config &config,
+                                        const size_t count) {
+  static constexpr auto doubles =
+      fixed_llsps<double>(std::make_index_sequence<max_fixed_metrics>());
+  static constexpr auto floats =
+      fixed_llsps<float>(std::make_index_sequence<max_fixed_metrics>());
+  /* the estimator appends a constant metric */
+  const size_t metrics = count + 1;
+
+  if (metrics <= max_fixed_metrics)
+    return (single_precision() ? floats : doubles)[metrics - 1](config);
+  else
+    return std::make_unique<dynamic_llsp>(config, count);
+}
+
+/* Exponentially weighted moving average of the execution times. */
+class ewma final : public model {
+  size_t count;
+  double weight;
+  uint64_t samples = 0;
+  double average = 0.0;
+  double last_measured = 0.0;
+
+public:
+  ewma(const estimator::config &config, const size_t count_)
+      : count(count_), weight(config.weight) {}
+
+  kind type() const override { return kind::ewma; }
+  bool matches(const estimator::config &config) const override {
+    return config.type == kind::ewma && config.weight == weight;
+  }
+  void add(const double *, double target) override {
+    average = (samples++ == 0) ? target : average + weight * (target - average);
+    last_measured = target;
+  }
+  void solve() override {}
+  std::shared_ptr<const coefficients> snapshot() const override {
+    return constant(count, average, last_measured);
+  }
+  void save(std::vector<uint64_t> &state) const override {
+    state.insert(state.end(), {to_word(weight), samples, to_word(average),
+                               to_word(last_measured)});
+  }
+  void load(const uint64_t *state, const size_t size) override {
+    check_size(size, 4);
+    weight = to_double(state[0]);
+    samples = state[1];
+    average = to_double(state[2]);
+    last_measured = to_double(state[3]);
+  }
+};
+
+/* Online linear quantile regression.
+ *
+ * Each sample moves the prediction for its metrics by a step of rate times
+ * the typical execution time: up by quantile if the sample was
+ * underestimated, down by 1 - quantile otherwise. The prediction settles
+ * where the given fraction of samples lies below it.
+ */
+class quantile_regression final : public model {
+  double quantile;
+  double rate;
+  uint64_t samples = 0;
+  /* running average of the execution times, scales the steps */
+  double scale = 0.0;
+  double last_measured = 0.0;
+  std::vector<double> weights;
+
+public:
+  quantile_regression(const estimator::config &config, const size_t count)
+      : quantile(config.quantile), rate(config.rate), weights(count + 1, 0.0) {}
+
+  kind type() const override { return kind::quantile; }
+  bool matches(const estimator::config &config) const override {
+    return config.type == kind::quantile && config.quantile == quantile &&
+           config.rate == rate;
+  }
+  void add(const double *metrics, double target) override {
+    last_measured = target;
+
+    if (samples++ == 0) {
+      /* start from the first sample rather than from zero */
+      weights.back() = target;
+      scale = std::abs(target);
+      return;
+    }
+
+    scale += (std::abs(target) - scale) / 16;
+
+    const double prediction =
+        llsp_dot(weights.data(), metrics, weights.size());
+    double norm = 0.0;
+    for (size_t i = 0; i < weights.size(); ++i)
+      norm += metrics[i] * metrics[i];
+
+    const double gradient = (target > prediction) ? quantile : quantile - 1.0;
+    const double step = rate * scale * gradient / norm;
+    for (size_t i = 0; i < weights.size(); ++i)
+      weights[i] += step * metrics[i];
+  }
+  void solve() override {}
+  std::shared_ptr<const coefficients> snapshot() const override {
+    return std::make_shared<const coefficients>(
+        coefficients{weights, last_measured});
+  }
+  void save(std::vector<uint64_t> &state) const override {
+    state.insert(state.end(), {to_word(quantile), to_word(rate), samples,
+                               to_word(scale), to_word(last_measured)});
+    for (const double weight : weights)
+      state.push_back(to_word(weight));
+  }
+  void load(const uint64_t *state, const size_t size) override {
+    check_size(size, 5 + weights.size());
+    quantile = to_double(state[0]);
+    rate = to_double(state[1]);
+    samples = state[2];
+    scale = to_double(state[3]);
+    last_measured = to_double(state[4]);
+    std::transform(state + 5, state + size, weights.begin(), to_double);
+  }
+};
+
+/* Maximum execution time of the last few jobs. */
+class window_max final : public model {
+  size_t count;
+  std::vector<double> window;
+  size_t next = 0;
+  size_t filled = 0;
+  double last_measured = 0.0;
+
+public:
+  window_max(const estimator::config &config, const size_t count_)
+      : count(count_), window(config.window, 0.0) {}
+
+  kind type() const override { return kind::window_max; }
+  bool matches(const estimator::config &config) const override {
+    return config.type == kind::window_max && config.window == window.size();
+  }
+  void add(const double *, double target) override {
+    window[next] = target;
+    next = (next + 1) % window.size();
+    filled = std::min(filled + 1, window.size());
+    last_measured = target;
+  }
+  void solve() override {}
+  std::shared_ptr<const coefficients> snapshot() const override {
+    const auto end = std::begin(window) + static_cast<ptrdiff_t>(filled);
+    const double maximum =
+        (filled > 0) ? *std::max_element(std::begin(window), end) : 0.0;
+    return constant(count, maximum, last_measured);
+  }
+  void save(std::vector<uint64_t> &state) const override {
+    state.insert(state.end(),
+                 {window.size(), next, filled, to_word(last_measured)});
+    for (const double sample : window)
+      state.push_back(to_word(sample));
+  }
+  void load(const uint64_t *state, const size_t size) override {
+    if (size < 4 || state[0] == 0 || state[1] >= state[0] ||
+        state[2] > state[0])
+      throw std::runtime_error("Corrupt sliding window state.");
+    check_size(size, 4 + state[0]);
+    window.resize(state[0]);
+    next = state[1];
+    filled = state[2];
+    last_measured = to_double(state[3]);
+    std::transform(state + 4, state + size, window.begin(), to_double);
+  }
+};
+
+void validate(const estimator::config &config) {
+  if (!(config.padding >= 0.0 && config.padding < 1.0))
+    throw std::runtime_error("Padding quantile must be in [0, 1).");
+  if (config.padding > 0.0 && config.padding_window == 0)
+    throw std::runtime_error("Padding window must not be empty.");
+  if (!(config.outlier > 0.0))
+    throw std::runtime_error("Outlier threshold must be positive.");
+  if (config.bootstrap_budget.count() < 0)
+    throw std::runtime_error("Bootstrap budget must not be negative.");
+  if (!(config.bootstrap_error > 0.0))
+    throw std::runtime_error("Bootstrap error bound must be positive.");
+
+  switch (config.type) {
+  case model::kind::llsp:
+    if (!(config.aging >= 0.0 && config.aging < 1.0))
+      throw std::runtime_error("LLSP aging factor must be in [0, 1).");
+    if (!(config.contribution >= 1.0))
+      throw std::runtime_error("LLSP column contribution must be at least 1.");
+    return;
+  case model::kind::ewma:
+    if (!(config.weight > 0.0 && config.weight <= 1.0))
+      throw std::runtime_error("EWMA weight must be in (0, 1].");
+    return;
+  case model::kind::quantile:
+    if (!(config.quantile > 0.0 && config.quantile < 1.0))
+      throw std::runtime_error("Quantile must be in (0, 1).");
+    if (!(config.rate > 0.0))
+      throw std::runtime_error("Quantile regression rate must be positive.");
+    return;
+  case model::kind::window_max:
+    if (config.window == 0)
+      throw std::runtime_error("Sliding window must not be empty.");
+    return;
+  }
+
+  throw std::runtime_error("Unknown prediction model " +
+                           std::to_string(static_cast<int>(config.type)));
+}
+
+std::unique_ptr<model> make_model(const estimator::config &config,
+                                  const size_t count) {
+  validate(config);
+
+  switch (config.type) {
+  case model::kind::llsp:
+    return make_llsp(config, count);
+  case model::kind::ewma:
+    return std::make_unique<ewma>(config, count);
+  case model::kind::quantile:
+    return std::make_unique<quantile_regression>(config, count);
+  case model::kind::window_max:
+    return std::make_unique<window_max>(config, count);
+  }
+
+  throw std::runtime_error("Unknown prediction model.");
+}
+}
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "persistence.h"
+
+extern "C" {
+#include "llsp.h"
+}
+
+#include "llsp-internal.h"
+
+namespace atlas {
+namespace persistence {
+
+[[noreturn]] static void throw_errno(const std::string &what) {
+  throw std::runtime_error(what + ": Error " + std::to_string(errno) + " " +
+                           strerror(errno));
+}
+
+/* size of a saved LLSP in 64 bit words */
+static constexpr size_t llsp_words(const size_t columns) {
+  return 2 + 1 + 2 * columns + 1 + (columns - 1) + (columns + 1) * (columns + 1);
+}
+
+static uint64_t to_word(const double value) {
+  uint64_t word;
+  std::memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+writer::writer(std::string path_) : path(std::move(path_)) {
+  /* a unique name instead of mkstemp(), so open() applies the umask like
+   * for any new file */
+  static std::atomic<uint64_t> serial{0};
+  do {
+    temporary = path + "." + std::to_string(getpid()) + "." +
+                std::to_string(serial++);
+    fd = open(temporary.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC,
+              0666);
+  } while (fd < 0 && errno == EEXIST);
+  if (fd < 0)
+    throw_errno("Creating " + temporary);
+
+  /* the record count is filled in on commit */
+  const header h{magic, version, byte_order, 0};
+  buffer.resize(sizeof(h) / sizeof(uint64_t));
+  std::memcpy(buffer.data(), &h, sizeof(h));
+}
+
+writer::~writer() {
+  if (fd >= 0) {
+    close(fd);
+    unlink(temporary.c_str());
+  }
+}
+
+void writer::flush() {
+  const char *data = reinterpret_cast<const char *>(buffer.data());
+  size_t left = buffer.size() * sizeof(uint64_t);
+
+  while (left) {
+    const ssize_t written = write(fd, data, left);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_errno("Writing " + temporary);
+    }
+    data += written;
+    left -= static_cast<size_t>(written);
+  }
+
+  buffer.clear();
+}
+
+void save(const struct llsp_s &llsp, std::vector<uint64_t> &words) {
+  const size_t columns = llsp.metrics + 1;
+  const size_t stride = llsp.full.stride;
+
+  words.reserve(words.size() + llsp_words(columns));
+  words.push_back(to_word(llsp.aging));
+  words.push_back(to_word(llsp.contribution));
+  words.push_back(llsp.good.columns);
+  words.insert(words.end(), llsp.sort.column, llsp.sort.column + columns);
+  words.insert(words.end(), llsp.good.column, llsp.good.column + columns);
+  words.push_back(to_word(llsp.last_measured));
+  for (size_t column = 0; column < llsp.metrics; ++column)
+    words.push_back(to_word(llsp.result[column]));
+  for (size_t row = 0; row <= columns; ++row)
+    for (size_t column = 0; column <= columns; ++column)
+      words.push_back(to_word(llsp.data[row * stride + column]));
+}
+
+void load(const uint64_t *word, const size_t size, struct llsp_s &llsp) {
+  const size_t columns = llsp.metrics + 1;
+  const size_t stride = llsp.full.stride;
+
+  if (size != llsp_words(columns))
+    throw std::runtime_error("LLSP does not match the metric count.");
+
+  double aging, contribution;
+  std::memcpy(&aging, word++, sizeof(double));
+  std::memcpy(&contribution, word++, sizeof(double));
+  const uint64_t good_columns = *word++;
+  const uint64_t *sort = word;
+  const uint64_t *good = sort + columns;
+  word = good + columns;
+
+  /* indices are used unchecked by the solvers */
+  const auto invalid = [columns](const uint64_t column) {
+    return column > columns;
+  };
+  if (good_columns > columns || std::any_of(sort, sort + columns, invalid) ||
+      std::any_of(good, good + columns, invalid))
+    throw std::runtime_error("Corrupt estimator state record.");
+
+  std::copy_n(sort, columns, llsp.sort.column);
+  std::copy_n(good, columns, llsp.good.column);
+  llsp.good.columns = good_columns;
+  llsp.aging = aging;
+  llsp.contribution = contribution;
+
+  std::memcpy(&llsp.last_measured, word++, sizeof(double));
+  std::memcpy(llsp.result, word, llsp.metrics * sizeof(double));
+  word += llsp.metrics;
+
+  for (size_t row = 0; row <= columns; ++row, word += columns + 1)
+    std::memcpy(llsp.data + row * stride, word, (columns + 1) * sizeof(double));
+}
+
+void writer::append(const uint64_t type, const uint64_t count,
+                    const uint64_t model, const std::vector<uint64_t> &state) {
+  buffer.push_back(type);
+  buffer.push_back(count);
+  buffer.push_back(model);
+  buffer.push_back((state.size() + 4) * sizeof(uint64_t));
+  buffer.insert(buffer.end(), state.begin(), state.end());
+
+  ++records;
+
+  static constexpr size_t flush_words = 1 << 17;
+  if (buffer.size() >= flush_words)
+    flush();
+}
+
+/* The directory holding path, whose entry rename() changes. */
+static std::string directory(const std::string &path) {
+  const auto slash = path.rfind('/');
+  if (slash == std::string::npos)
+    return ".";
+  return (slash == 0) ? "/" : path.substr(0, slash);
+}
+
+void writer::commit() {
+  flush();
+
+  if (pwrite(fd, &records, sizeof(records), offsetof(header, records)) !=
+      sizeof(records))
+    throw_errno("Writing " + temporary);
+  if (fsync(fd) != 0)
+    throw_errno("Syncing " + temporary);
+  if (close(fd) != 0) {
+    fd = -1;
+    unlink(temporary.c_str());
+    throw_errno("Closing " + temporary);
+  }
+  fd = -1;
+
+  if (rename(temporary.c_str(), path.c_str()) != 0) {
+    const int error = errno;
+    unlink(temporary.c_str());
+    errno = error;
+    throw_errno("Renaming " + temporary + " to " + path);
+  }
+
+  /* the rename is only durable once the directory is synced */
+  const auto dir = directory(path);
+  const int dirfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd < 0)
+    throw_errno("Opening " + dir);
+  if (fsync(dirfd) != 0) {
+    const int error = errno;
+    close(dirfd);
+    errno = error;
+    throw_errno("Syncing " + dir);
+  }
+  close(dirfd);
+}
+
+reader::reader(const std::string &path) : base(MAP_FAILED), size(0) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw_errno("Opening " + path);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw_errno("Reading " + path);
+  }
+  size = static_cast<size_t>(info.st_size);
+
+  if (size >= sizeof(header))
+    base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+
+  if (size < sizeof(header))
+    throw std::runtime_error(path + " is not an estimator state file.");
+  if (base == MAP_FAILED)
+    throw_errno("Mapping " + path);
+
+  const header *h = static_cast<const header *>(base);
+  if (h->magic != magic) {
+    munmap(base, size);
+    throw std::runtime_error(path + " is not an estimator state file.");
+  }
+  if (h->version != version || h->byte_order != byte_order) {
+    munmap(base, size);
+    throw std::runtime_error(path + " has version " +
+                             std::to_string(h->version) + ", expected " +
+                             std::to_string(version) + ".");
+  }
+
+  cursor = static_cast<const char *>(base) + sizeof(header);
+  remaining = h->records;
+}
+
+reader::~reader() { munmap(base, size); }
+
+uint64_t reader::records() const {
+  return static_cast<const header *>(base)->records;
+}
+
+const record *reader::next() {
+  if (remaining == 0)
+    return nullptr;
+
+  const char *end = static_cast<const char *>(base) + size;
+  const record *r = reinterpret_cast<const record *>(cursor);
+  if (static_cast<size_t>(end - cursor) < sizeof(record) ||
+      r->size < sizeof(record) || r->size % sizeof(uint64_t) != 0 ||
+      static_cast<size_t>(end - cursor) < r->size)
+    throw std::runtime_error("Truncated or corrupt estimator state record.");
+  if (previous != nullptr && previous->type >= r->type)
+    throw std::runtime_error("Estimator state records are not sorted.");
+
+  cursor += r->size;
+  --remaining;
+  previous = r;
+  return r;
+}
+}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct llsp_s;
+
+namespace atlas {
+namespace persistence {
+
+/* Estimator state file.
+ *
+ * A header is followed by one record per job type, sorted by type. Every
+ * field is 64 bits wide and stored in native byte order, so a file can be
+ * mapped and read in place. A record names the model of the job type and
+ * carries the model's state:
+ *
+ *   record { type, count, model, size }
+ *   state  { size / 8 - 4 words, as saved by the model }
+ *
+ * LLSP models save their state in the layout of llsp.c, without row padding.
+ * With C = count + 2 LLSP columns:
+ *
+ *   llsp   { aging, contribution, good columns, sort[C], good[C],
+ *            last measured, result[C - 1], data[(C + 1) * (C + 1)] }
+ *
+ * The version is bumped on every incompatible change; files with a different
+ * version or byte order are rejected.
+ */
+static constexpr uint64_t magic = 0x5453454153544c41; /* "ATLASEST" */
+static constexpr uint32_t version = 3;
+static constexpr uint32_t byte_order = 0x01020304;
+
+struct header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t records;
+};
+
+struct record {
+  uint64_t type;
+  uint64_t count;
+  uint64_t model;
+  uint64_t size; /* including this record header */
+
+  const uint64_t *state() const {
+    return reinterpret_cast<const uint64_t *>(this + 1);
+  }
+  size_t words() const { return size / sizeof(uint64_t) - 4; }
+};
+
+/* Converts the state of an LLSP to and from its saved layout. */
+void save(const struct llsp_s &llsp, std::vector<uint64_t> &words);
+void load(const uint64_t *words, size_t size, struct llsp_s &llsp);
+
+/* Writes a state file next to its destination and renames it into place on
+ * commit, so readers and crashes only ever see a complete file. */
+class writer {
+  std::string path;
+  std::string temporary;
+  int fd;
+  uint64_t records = 0;
+  std::vector<uint64_t> buffer;
+
+  void flush();
+
+public:
+  explicit writer(std::string path);
+  ~writer();
+  writer(const writer &) = delete;
+  writer &operator=(const writer &) = delete;
+
+  void append(uint64_t type, uint64_t count, uint64_t model,
+              const std::vector<uint64_t> &state);
+  void commit();
+};
+
+/* Maps a state file and walks its records. */
+class reader {
+  void *base;
+  size_t size;
+  const char *cursor;
+  uint64_t remaining;
+  const record *previous = nullptr;
+
+public:
+  explicit reader(const std::string &path);
+  ~reader();
+  reader(const reader &) = delete;
+  reader &operator=(const reader &) = delete;
+
+  uint64_t records() const;
+  /* Returns the next record or nullptr after the last one. */
+  const record *next();
+};
+}
+}
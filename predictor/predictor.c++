@@ -3,29 +3,23 @@
 #include <algorithm>
 #include <deque>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <sstream>
 #include <string>
-#include <fstream>
 #include <exception>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
 
-#include <assert.h>
+#include <unistd.h>
+#include <cmath>
 #include <cstring>
 
-#ifdef HAVE_BOOST_SERIALIZATION
-#include <boost/archive/text_oarchive.hpp>
-#include <boost/archive/text_iarchive.hpp>
-#include <boost/serialization/vector.hpp>
-#include <boost/serialization/export.hpp>
-#endif
-
 #include "predictor.h"
-
-extern "C" {
-#include "llsp.h"
-}
-
-#include "llsp-internal.h"
+#include "model.h"
+#include "persistence.h"
+#include "shared.h"
 
 [[noreturn]] static void throw_estimator_not_found(const uint64_t type) {
   std::ostringstream os;
@@ -33,210 +27,415 @@ extern "C" {
   throw std::runtime_error(os.str());
 }
 
-static bool operator==(const struct llsp_s &lhs, const struct llsp_s &rhs) {
-  bool equal = true;
-  if (lhs.metrics != rhs.metrics) {
-    std::cout << "metrics differ" << std::endl;
-    equal = false;
+[[noreturn]] static void throw_metric_count_mismatch(const uint64_t type,
+                                                     const size_t expected,
+                                                     const size_t count) {
+  std::ostringstream os;
+  os << "Estimator for type " << std::hex << type << " expects " << std::dec
+     << expected << " metrics, got " << count << ".";
+  throw std::runtime_error(os.str());
+}
+
+namespace atlas {
+
+static constexpr std::chrono::nanoseconds
+overallocation(std::chrono::nanoseconds prediction) {
+  using namespace std::chrono;
+  using namespace std::literals::chrono_literals;
+  return (prediction > 1ms) ? (prediction * 1025) / 1000 : prediction + 25us;
+}
+
+/* Reservation of a job type in its bootstrap, whose model is not trusted
+ * yet: best-effort, or at least the bootstrap budget if set. */
+static std::chrono::nanoseconds
+bootstrap_reservation(const std::chrono::nanoseconds reservation,
+                      const std::chrono::nanoseconds budget) {
+  return (budget.count() > 0) ? std::max(budget, reservation)
+                              : std::chrono::nanoseconds{0};
+}
+
+/* Number of samples after which the trainer solves an LLSP even if no
+ * prediction asked for fresh coefficients. Defaults to solving after every
+ * sample, which keeps the numerics identical to synchronous training. */
+static size_t solve_interval() {
+  static const size_t interval = [] {
+    const char *env = std::getenv("ATLAS_PREDICTOR_SOLVE_INTERVAL");
+    return (env != nullptr) ? std::max(std::stoul(env), 1UL) : 1UL;
+  }();
+  return interval;
+}
+
+/* Recent prediction errors of a job type. The reservation padding is a
+ * quantile of the errors after rejecting outliers, such as jobs inflated by
+ * preemption, by their distance from the median in median absolute
+ * deviations. */
+class residuals {
+  /* fewer errors than this are too few to derive a padding */
+  static constexpr size_t minimum = 8;
+
+  double quantile;
+  double outlier;
+  std::vector<double> window;
+  size_t next = 0;
+  size_t filled = 0;
+
+public:
+  residuals(const estimator::config &config)
+      : quantile(config.padding), outlier(config.outlier),
+        window(config.padding_window, 0.0) {}
+
+  bool matches(const estimator::config &config) const {
+    return config.padding == quantile && config.outlier == outlier &&
+           config.padding_window == window.size();
   }
 
-  if ((lhs.data == nullptr) != (rhs.data == nullptr)) {
-    std::cout << "Initialization state differs" << std::endl;
-    return false;
+  void add(const double residual) {
+    window[next] = residual;
+    next = (next + 1) % window.size();
+    filled = std::min(filled + 1, window.size());
   }
 
-  const size_t metrics = lhs.metrics;
-  const size_t data_size = (metrics + 1) * (metrics + 2) * sizeof(double);
-  if (memcmp(lhs.data, rhs.data, data_size) != 0) {
-    std::cout << "data differs" << std::endl;
-    for (size_t i = 0; i < data_size / sizeof(double); ++i) {
-      std::cout << lhs.data + i << " " << lhs.data[i] << " " << rhs.data + i
-                << " " << rhs.data[i] << std::endl;
-    }
-    equal = false;
+  /* Returns the padding in seconds, or a negative value if unknown. */
+  double padding() const {
+    if (filled < minimum)
+      return -1.0;
+
+    std::vector<double> errors(window.begin(),
+                               window.begin() + static_cast<ptrdiff_t>(filled));
+    const auto middle = errors.begin() + static_cast<ptrdiff_t>(filled / 2);
+    std::nth_element(errors.begin(), middle, errors.end());
+    const double median = *middle;
+
+    std::vector<double> deviations(errors.size());
+    std::transform(errors.begin(), errors.end(), deviations.begin(),
+                   [median](const double error) {
+                     return std::abs(error - median);
+                   });
+    const auto middle_deviation =
+        deviations.begin() + static_cast<ptrdiff_t>(filled / 2);
+    std::nth_element(deviations.begin(), middle_deviation, deviations.end());
+    /* scaled to estimate the standard deviation of normal errors */
+    const double limit = outlier * 1.4826 * *middle_deviation;
+
+    if (limit > 0.0)
+      errors.erase(std::remove_if(errors.begin(), errors.end(),
+                                  [median, limit](const double error) {
+                                    return std::abs(error - median) > limit;
+                                  }),
+                   errors.end());
+
+    const auto rank = static_cast<size_t>(
+        std::ceil(quantile * static_cast<double>(errors.size())));
+    const auto nth =
+        errors.begin() + static_cast<ptrdiff_t>(std::max(rank, 1UL) - 1);
+    std::nth_element(errors.begin(), nth, errors.end());
+    return std::max(*nth, 0.0);
   }
+};
+
+static std::unique_ptr<residuals> make_residuals(const estimator::config &config) {
+  return (config.padding > 0.0) ? std::make_unique<residuals>(config) : nullptr;
+}
+
+/* Training pipeline of a single job type.
+ *
+ * Workers push completed samples onto a lock-free list and return
+ * immediately. The samples are folded into the model by the background
+ * trainer or by the next prediction of this type, whichever comes first. The
+ * model is only solved when a prediction needs fresh coefficients or after
+ * every solve_interval() samples. Solutions are published as immutable
+ * snapshots, so predictions of an up-to-date type never take a lock.
+ */
+class pipeline {
+  struct sample {
+    sample *next;
+    metric_vector metrics;
+    double target;
+    /* error of the prediction for this sample */
+    double residual;
+  };
 
-  if (lhs.full.columns != rhs.full.columns ||
-      lhs.sort.columns != rhs.sort.columns ||
-      lhs.good.columns != rhs.good.columns) {
-    std::cout << "column mismatch" << std::endl;
-    equal = false;
+  mutable std::mutex lock;
+  std::unique_ptr<class model> model;
+  std::unique_ptr<class residuals> residuals;
+  /* adaptive padding in ns, negative for the fixed overallocation */
+  std::atomic<int64_t> padding{-1};
+  /* padding of the last reservation */
+  std::atomic<int64_t> last_padding{0};
+  std::atomic<sample *> pending{nullptr};
+  /* samples pushed, but not yet reflected in the published solution */
+  std::atomic<size_t> outstanding{0};
+  size_t unsolved = 0;
+  std::shared_ptr<const coefficients> published;
+
+  /* state shared with other processes, if any */
+  shared::slot *slot = nullptr;
+  uint64_t origin = 0;
+  /* ring position of the next shared sample to fold */
+  std::atomic<uint64_t> cursor{0};
+  /* samples the model was trained with */
+  std::atomic<uint64_t> samples{0};
+
+  void publish() {
+    std::atomic_store(&published, model->snapshot());
+    if (residuals) {
+      const double seconds = residuals->padding();
+      padding = (seconds < 0.0) ? -1 : static_cast<int64_t>(seconds * 1E9);
+    } else
+      padding = -1;
   }
 
-  {
-    for (size_t i = 0; i < lhs.full.columns; ++i) {
-      if (lhs.full.matrix[i] - lhs.data != rhs.full.matrix[i] - rhs.data) {
-        std::cout << "full offsets differ " << i << " of " << lhs.full.columns
-                  << std::endl;
-        std::cout << lhs.data << " " << lhs.full.matrix[i] - lhs.data << "; "
-                  << rhs.data << " " << rhs.full.matrix[i] - rhs.data << " "
-                  << rhs.full.matrix[i] << std::endl;
-        equal = false;
-      }
+  /* must be called with lock held */
+  void drain() {
+    sample *head = pending.exchange(nullptr);
+
+    /* the list is LIFO; restore submission order */
+    sample *fifo = nullptr;
+    while (head != nullptr) {
+      sample *next = head->next;
+      head->next = fifo;
+      fifo = head;
+      head = next;
     }
-  }
 
-  {
-    for (size_t i = 0; i < lhs.sort.columns; ++i) {
-      if (lhs.sort.matrix[i] - lhs.data != rhs.sort.matrix[i] - rhs.data) {
-        std::cout << "sort offsets differ" << std::endl;
-        equal = false;
-      }
+    while (fifo != nullptr) {
+      std::unique_ptr<sample> s(fifo);
+      fifo = fifo->next;
+      model->add(s->metrics.data(), s->target);
+      ++samples;
+      if (residuals)
+        residuals->add(s->residual);
+      if (++unsolved >= solve_interval())
+        solve();
     }
+
+    if (slot)
+      absorb();
   }
 
-  {
-    for (size_t i = 0; i < lhs.good.columns; ++i) {
-      if (lhs.good.matrix[i] - lhs.data == rhs.good.matrix[i] - rhs.data) {
-        continue;
-      } else if (lhs.good.matrix[i] == lhs.good.matrix[lhs.good.columns - 1] &&
-                 rhs.good.matrix[i] == rhs.good.matrix[rhs.good.columns - 1]) {
-        continue;
-      } else {
-        std::cout << "good offsets differ: " << std::endl;
-        std::cout << lhs.good.matrix[i] << " " << lhs.data << " ("
-                  << lhs.good.matrix[i] - lhs.data << ") "
-                  << lhs.good.matrix[lhs.good.columns - 1] << std::endl;
-        std::cout << rhs.good.matrix[i] << " " << rhs.data << " ("
-                  << rhs.good.matrix[i] - rhs.data << ") "
-                  << rhs.good.matrix[rhs.good.columns - 1] << std::endl;
-        equal = false;
-      }
-    }
+  /* Folds the samples of other processes. Must be called with lock held. */
+  void absorb() {
+    cursor = slot->absorb(cursor, origin,
+                          [this](const double *metrics, const double target) {
+                            model->add(metrics, target);
+                            ++samples;
+                            ++outstanding;
+                            if (++unsolved >= solve_interval())
+                              solve();
+                          });
+  }
+
+  /* must be called with lock held */
+  void solve() {
+    model->solve();
+    publish();
+    outstanding -= unsolved;
+    unsolved = 0;
 
-    if (memcmp(lhs.good.matrix[metrics], rhs.good.matrix[metrics],
-               (metrics + 2) * sizeof(double)) != 0) {
-      std::cout << "extra differs" << std::endl;
-      std::cout << lhs.good.matrix[metrics] << " " << rhs.good.matrix[metrics]
-                << std::endl;
-      std::cout << rhs.data << std::endl;
-      equal = false;
+    if (slot) {
+      const auto &solution = *std::atomic_load(&published);
+      slot->publish(solution.values, solution.last_measured, samples, cursor);
     }
   }
 
-  if (memcmp(&lhs.last_measured, &rhs.last_measured, sizeof(double)) != 0) {
-    std::cout << "last_measured differ" << std::endl;
-    equal = false;
+  bool stale() const {
+    return outstanding.load() != 0 ||
+           (slot && slot->head.load(std::memory_order_relaxed) != cursor.load());
   }
 
-  if (memcmp(lhs.result, rhs.result, metrics) != 0) {
-    std::cout << "result differ" << std::endl;
-    equal = false;
+  /* Returns true if the shared coefficients come from a model trained with
+   * more samples and are not outdated by the samples since. */
+  bool shared_prediction(const double *metrics, double &prediction) const {
+    static thread_local coefficients solution;
+    uint64_t trained, position;
+
+    if (!slot->read(solution.values, solution.last_measured, trained, position))
+      return false;
+    if (trained <= samples.load() || position + shared::ring_size < cursor.load())
+      return false;
+
+    prediction = solution.predict(metrics);
+    return true;
   }
 
-  return equal;
-}
+public:
+  /* intrusive link for the trainer's ready list */
+  pipeline *next_ready = nullptr;
+  std::atomic_bool scheduled{false};
 
-class llsp {
-  struct llsp_disposer {
-    void operator()(llsp_t *llsp) { llsp_dispose(llsp); }
-  };
-  std::shared_ptr<llsp_t> llsp_;
-
-#ifdef HAVE_BOOST_SERIALIZATION
-  friend class boost::serialization::access;
-
-  template <class Archive>
-  void serialize(Archive &archive, struct matrix &m, double *const data,
-                 const bool extra = false) const {
-    size_t unused = 0;
-
-    archive & m.columns;
-    const size_t columns = m.columns;
-    const size_t last_col = m.columns - 1;
-
-    if (extra) {
-      const size_t rows = llsp_->metrics + 2;
-      archive & boost::serialization::make_array(m.matrix[last_col], rows);
-      unused = static_cast<size_t>(
-          std::count(m.matrix, m.matrix + columns, m.matrix[last_col]));
-      archive & unused;
-    }
+  pipeline(const estimator::config &config, const size_t count)
+      : model(make_model(config, count)), residuals(make_residuals(config)) {
+    publish();
+  }
+  ~pipeline() { drain(); }
+
+  /* Returns true if the pipeline needs to be scheduled on the trainer. */
+  bool push(metric_vector metrics, const double target,
+            const double residual) {
+    if (slot)
+      slot->push(origin, metrics.data(), target);
+    auto *s = new sample{pending.load(), std::move(metrics), target, residual};
+    ++outstanding;
+    while (!pending.compare_exchange_weak(s->next, s))
+      ;
+    return !scheduled.exchange(true);
+  }
 
-    for (size_t i = 0; i < columns - unused; ++i) {
-      auto offset = static_cast<ptrdiff_t>(m.matrix[i] - data);
-      archive & offset;
-      m.matrix[i] = data + offset;
-    }
+  void fold() {
+    std::lock_guard<std::mutex> l(lock);
+    drain();
+  }
 
-    for (size_t i = columns - unused; i < columns; ++i) {
-      m.matrix[i] = m.matrix[last_col];
-    }
+  void flush() {
+    std::lock_guard<std::mutex> l(lock);
+    drain();
+    if (unsolved)
+      solve();
   }
 
-  template <class Archive>
-  void serialize(Archive &archive, const unsigned int) {
-    archive & llsp_->metrics;
+  double predict(const double *metrics) {
+    if (stale())
+      flush();
 
-    {
-      const size_t count = llsp_->metrics;
-      const size_t data_size = (count + 1) * (count + 2);
+    double prediction;
+    if (slot && shared_prediction(metrics, prediction))
+      return prediction;
+    return std::atomic_load(&published)->predict(metrics);
+  }
 
-      archive & boost::serialization::make_array(llsp_->data, data_size);
-    }
+  std::chrono::nanoseconds
+  reservation(const std::chrono::nanoseconds prediction) const {
+    const int64_t adaptive = padding.load();
+    return (adaptive < 0) ? overallocation(prediction)
+                          : prediction + std::chrono::nanoseconds{adaptive};
+  }
 
-    {
-      /* full matrix view */
-      serialize(archive, llsp_->full, llsp_->data);
-      /*  sort matrix view */
-      serialize(archive, llsp_->sort, llsp_->data);
-      /*  good matrix view */
-      serialize(archive, llsp_->good, llsp_->data, true);
-    }
+  std::chrono::nanoseconds reserve(const std::chrono::nanoseconds prediction) {
+    const auto reserved = reservation(prediction);
+    last_padding = (reserved - prediction).count();
+    return reserved;
+  }
 
-    archive & llsp_->last_measured;
+  std::chrono::nanoseconds padded() const {
+    return std::chrono::nanoseconds{last_padding.load()};
+  }
 
-    {
-      for (size_t i = 0; i < llsp_->metrics; ++i) {
-        archive & llsp_->result[i];
-      }
-    }
+  /* Replaces the model. Samples not folded yet go to the new model. */
+  void reset(std::unique_ptr<class model> replacement) {
+    std::lock_guard<std::mutex> l(lock);
+    drain();
+    model = std::move(replacement);
+    publish();
+    outstanding -= unsolved;
+    unsolved = 0;
+    samples = 0;
   }
-#endif
 
-  public:
-  llsp(const size_t count) : llsp_(llsp_new(count + 1), llsp_disposer{}) {}
-  void add(const double *metrics, double target) {
-    llsp_add(llsp_.get(), metrics, target);
+  /* Shares samples and coefficients through a shared memory slot. The model
+   * is trained with the recent samples of other processes right away. */
+  void share(shared::slot *slot_, const uint64_t origin_) {
+    std::lock_guard<std::mutex> l(lock);
+    slot = slot_;
+    origin = origin_;
+    cursor = 0;
+    absorb();
+    if (unsolved)
+      solve();
   }
-  const double *solve() { return llsp_solve(llsp_.get()); }
-  double predict(const double *metrics) {
-    return llsp_predict(llsp_.get(), metrics);
+
+  bool configured(const estimator::config &config) const {
+    std::lock_guard<std::mutex> l(lock);
+    return model->matches(config);
   }
 
-  bool operator==(const llsp& rhs) const {
-    return *llsp_ == *rhs.llsp_;
+  /* Switches between fixed and adaptive padding. */
+  void pad(const estimator::config &config) {
+    std::lock_guard<std::mutex> l(lock);
+    if (!residuals || !residuals->matches(config)) {
+      drain();
+      residuals = make_residuals(config);
+      publish();
+    }
   }
-};
 
-namespace atlas {
+  /* Folds and solves all pending samples and saves the model state. */
+  estimator::config::model save(std::vector<uint64_t> &state) {
+    std::lock_guard<std::mutex> l(lock);
+    drain();
+    if (unsolved)
+      solve();
+    model->save(state);
+    return model->type();
+  }
 
-static constexpr std::chrono::nanoseconds
-overallocation(std::chrono::nanoseconds prediction) {
-  using namespace std::chrono;
-  using namespace std::literals::chrono_literals;
-  return (prediction > 1ms) ? (prediction * 1025) / 1000 : prediction + 25us;
-}
+  void load(const uint64_t *state, const size_t size) {
+    std::lock_guard<std::mutex> l(lock);
+    model->load(state, size);
+    publish();
+  }
+
+  estimator::config::model kind() const {
+    std::lock_guard<std::mutex> l(lock);
+    return model->type();
+  }
+
+  bool operator==(const pipeline &rhs) const {
+    std::lock(lock, rhs.lock);
+    std::lock_guard<std::mutex> l(lock, std::adopt_lock);
+    std::lock_guard<std::mutex> r(rhs.lock, std::adopt_lock);
+    std::vector<uint64_t> lhs_state, rhs_state;
+    model->save(lhs_state);
+    rhs.model->save(rhs_state);
+    return model->type() == rhs.model->type() && lhs_state == rhs_state;
+  }
+};
 
 struct estimator_ctx {
   uint64_t type;
   size_t count;
-  class llsp llsp;
+  std::shared_ptr<class pipeline> pipeline;
 
   struct job {
     uint64_t id;
-    std::vector<double> metrics;
+    metric_vector metrics;
     std::chrono::nanoseconds prediction;
 
     job(const uint64_t id_, const double *metrics_, const size_t count_)
-        : id(id_), metrics(count_ + 1, 1.0), prediction(0) {
-      std::copy_n(metrics_, count_, std::begin(metrics));
-      assert(metrics.at(count_) == 1.0);
-    }
+        : id(id_), metrics(metrics_, count_), prediction(0) {}
   };
 
   std::deque<job> jobs;
 
+  /* jobs left in the bootstrap, 0 once the model is trusted */
+  size_t bootstrap;
+  /* mean relative prediction error of the bootstrap jobs */
+  double error = 0.0;
+  size_t observed = 0;
+  /* consecutive jobs that changed the mean error by less than the bound */
+  size_t stable = 0;
+
+  /* Ends the bootstrap once the mean prediction error settled, i.e. it moved
+   * by less than the given fraction for a few jobs in a row, or after the
+   * configured number of jobs. */
+  void bootstrapped(const std::chrono::nanoseconds exectime,
+                    const std::chrono::nanoseconds prediction,
+                    const double bound) {
+    static constexpr size_t stable_jobs = 8;
+    const auto deviation = (exectime > prediction) ? exectime - prediction
+                                                   : prediction - exectime;
+    const double relative =
+        static_cast<double>(deviation.count()) /
+        static_cast<double>(std::max(exectime.count(), INT64_C(1)));
+    const double previous = error;
+
+    error += (relative - error) / static_cast<double>(++observed);
+    stable = (observed > 1 && std::abs(error - previous) <= bound * previous)
+                 ? stable + 1
+                 : 0;
+    if (--bootstrap == 0 || stable >= stable_jobs)
+      bootstrap = 0;
+  }
+
   auto remove(const uint64_t id) {
     auto it = std::find_if(std::begin(jobs), std::end(jobs),
                            [id](const auto &job) { return job.id == id; });
@@ -254,57 +453,71 @@ struct estimator_ctx {
   }
 
   bool operator==(const estimator_ctx &rhs) const {
-    return type == rhs.type && count == rhs.count && llsp == rhs.llsp;
-  }
-
-#ifdef HAVE_BOOST_SERIALIZATION
-  template <class Archive>
-  void serialize(Archive &archive, const unsigned int) {
-    archive & llsp;
+    return type == rhs.type && count == rhs.count &&
+           *pipeline == *rhs.pipeline;
   }
-#endif
 
-  estimator_ctx(const uint64_t type_, const size_t count_)
-      : type(type_), count(count_), llsp(count) {}
-  estimator_ctx() : estimator_ctx(static_cast<uint64_t>(-1), 0) {}
+  estimator_ctx(const uint64_t type_, const size_t count_,
+                const estimator::config &config)
+      : type(type_), count(count_),
+        pipeline(std::make_shared<class pipeline>(config, count)),
+        bootstrap(config.bootstrap) {}
 };
-}
 
-#ifdef HAVE_BOOST_SERIALIZATION
-namespace boost {
-namespace serialization {
-template <class Archive>
-inline void save_construct_data(Archive &ar, const atlas::estimator_ctx *e,
-                                const unsigned int) {
-  ar << e->type << e->count;
+/* Interval of the background checkpoints of the estimator state in seconds,
+ * from ATLAS_PREDICTOR_CHECKPOINT. 0 disables them. */
+static std::chrono::seconds checkpoint_interval() {
+  const char *env = std::getenv("ATLAS_PREDICTOR_CHECKPOINT");
+  return std::chrono::seconds{(env != nullptr) ? std::stoul(env) : 60UL};
 }
 
-template <class Archive>
-inline void load_construct_data(Archive &ar, atlas::estimator_ctx *e,
-                                const unsigned int) {
-  uint64_t type;
-  size_t count;
-  ar >> type >> count;
-  ::new (e) atlas::estimator_ctx(type, count);
+/* Job types shared through a segment, from ATLAS_PREDICTOR_SHM_TYPES. */
+static size_t shared_types() {
+  const char *env = std::getenv("ATLAS_PREDICTOR_SHM_TYPES");
+  return (env != nullptr) ? std::max(std::stoul(env), 1UL) : 256UL;
 }
-}
-}
-#endif
 
-namespace atlas {
+/* Tells the samples of estimators apart, also within one process. */
+static uint64_t shared_origin() {
+  static std::atomic<uint32_t> instances{0};
+  return (static_cast<uint64_t>(getpid()) << 32) | ++instances;
+}
 
 struct estimator::impl {
+  /* declared first, so it outlives the pipelines */
+  std::unique_ptr<shared::segment> segment;
+  uint64_t origin = shared_origin();
   std::vector<estimator_ctx> estimators;
+  /* models of job types, including the ones not seen yet */
+  std::map<uint64_t, config> configs;
+  /* related types new types start from */
+  std::map<uint64_t, uint64_t> seeds;
   mutable std::mutex lock;
   std::string filename;
 
-  auto do_find(uint64_t type) {
-    auto it =
-        std::lower_bound(std::begin(estimators), std::end(estimators), type,
-                         [](const auto &estimator, const uint64_t type_) {
-                           return estimator.type < type_;
-                         });
+  /* Background trainer. Pipelines with pending samples are pushed onto a
+   * lock-free list; the trainer only sleeps when that list is empty. */
+  std::atomic<pipeline *> ready{nullptr};
+  std::atomic_bool sleeping{false};
+  std::atomic_bool done{false};
+  std::mutex trainer_lock;
+  std::condition_variable trainer_cv;
+  std::thread trainer;
+
+  /* Periodic checkpoints to filename, written atomically. */
+  std::mutex checkpoint_lock;
+  std::condition_variable checkpoint_cv;
+  std::thread checkpointer;
+
+  auto position(uint64_t type) {
+    return std::lower_bound(std::begin(estimators), std::end(estimators), type,
+                            [](const auto &estimator, const uint64_t type_) {
+                              return estimator.type < type_;
+                            });
+  }
 
+  auto do_find(uint64_t type) {
+    auto it = position(type);
     if (it == std::end(estimators))
       throw_estimator_not_found(type);
 
@@ -318,118 +531,362 @@ struct estimator::impl {
     return *it;
   }
 
+  /* Throws if the type was seen with a different metric count, e.g. because
+   * two call sites with different metrics map to the same type. */
   estimator_ctx &find_insert(uint64_t type, size_t count) {
+    auto it = position(type);
+    if (it != std::end(estimators) && it->type == type) {
+      if (it->count != count)
+        throw_metric_count_mismatch(type, it->count, count);
+      return *it;
+    }
+
+    return share(seed(*estimators.insert(it, {type, count, config_of(type)})));
+  }
+
+  /* Copies the model of the related type, if any and compatible. */
+  estimator_ctx &seed(estimator_ctx &estimator) {
+    auto it = seeds.find(estimator.type);
+    if (it == seeds.end())
+      return estimator;
+
     try {
-      auto it = do_find(type);
-      if (it->type == type)
-        return *it;
-      else
-        return *estimators.insert(it, {type, count});
+      const auto &related = find(it->second);
+      std::vector<uint64_t> state;
+      if (related.count == estimator.count &&
+          related.pipeline->save(state) == estimator.pipeline->kind())
+        estimator.pipeline->load(state.data(), state.size());
     } catch (const std::runtime_error &) {
-      return *estimators.insert(std::end(estimators), {type, count});
+      /* the related type was not seen yet */
+    }
+    return estimator;
+  }
+
+  estimator_ctx &share(estimator_ctx &estimator) {
+    if (segment) {
+      /* the estimator appends a constant metric */
+      if (auto *slot = segment->attach(estimator.type, estimator.count + 1))
+        estimator.pipeline->share(slot, origin);
+    }
+    return estimator;
+  }
+
+  estimator::config config_of(uint64_t type) const {
+    auto it = configs.find(type);
+    return (it != configs.end()) ? it->second : estimator::config{};
+  }
+
+  void schedule(pipeline *p) {
+    p->next_ready = ready.load();
+    while (!ready.compare_exchange_weak(p->next_ready, p))
+      ;
+
+    if (sleeping) {
+      std::lock_guard<std::mutex> l(trainer_lock);
+      trainer_cv.notify_one();
     }
   }
 
-  std::chrono::nanoseconds predict(estimator_ctx &estimator) {
-    using namespace std::chrono;
-    assert(estimator.jobs.size() > 0);
-    auto &job = estimator.jobs.back();
-    job.prediction = duration_cast<nanoseconds>(
-        duration<double>(estimator.llsp.predict(job.metrics.data())));
+  void train() {
+    while (!done) {
+      pipeline *p = ready.exchange(nullptr);
+
+      if (p == nullptr) {
+        std::unique_lock<std::mutex> l(trainer_lock);
+        sleeping = true;
+        trainer_cv.wait(l, [this] { return ready.load() || done; });
+        sleeping = false;
+        continue;
+      }
+
+      while (p != nullptr) {
+        pipeline *next = p->next_ready;
+        /* unschedule before draining, so later samples reschedule */
+        p->scheduled = false;
+        p->fold();
+        p = next;
+      }
+    }
+  }
 
-    return job.prediction;
+  /* fold and solve everything, e.g. before saving or comparing */
+  void flush() const {
+    for (const auto &estimator : estimators)
+      estimator.pipeline->flush();
   }
 
   bool operator==(const impl &rhs) const {
+    flush();
+    rhs.flush();
     return std::equal(estimators.begin(), estimators.end(),
                       rhs.estimators.begin());
   }
 
+  /* Writes all estimators to file, after folding and solving their pending
+   * samples. Training continues while the file is written. */
+  void write(const std::string &file) const {
+    struct entry {
+      uint64_t type;
+      size_t count;
+      std::shared_ptr<class pipeline> pipeline;
+    };
+    std::vector<entry> entries;
+
+    {
+      std::lock_guard<std::mutex> l(lock);
+      entries.reserve(estimators.size());
+      for (const auto &estimator : estimators)
+        entries.push_back({estimator.type, estimator.count, estimator.pipeline});
+    }
+
+    std::vector<uint64_t> state;
+    persistence::writer writer(file);
+    for (const auto &entry : entries) {
+      state.clear();
+      const auto model = entry.pipeline->save(state);
+      writer.append(entry.type, entry.count, static_cast<uint64_t>(model),
+                    state);
+    }
+    writer.commit();
+  }
+
+  void read(const std::string &file) {
+    persistence::reader reader(file);
+    std::vector<estimator_ctx> loaded;
+
+    loaded.reserve(reader.records());
+    while (const auto *record = reader.next()) {
+      estimator::config config;
+      config.type = static_cast<estimator::config::model>(record->model);
+      loaded.emplace_back(record->type, record->count, config);
+      loaded.back().pipeline->load(record->state(), record->words());
+    }
+
+    estimators = std::move(loaded);
+  }
+
   void save(const char *fname) const {
-    std::string file{(fname != nullptr) ? fname : filename};
-    if (!filename.empty()) {
-#ifdef HAVE_BOOST_SERIALIZATION
-      std::ofstream os(fname);
-      boost::archive::text_oarchive oa(os);
-      oa &estimators;
-#endif
+    const std::string file{(fname != nullptr) ? fname : filename};
+    if (!file.empty())
+      write(file);
+  }
+
+  void checkpoint(const std::chrono::seconds interval) {
+    std::unique_lock<std::mutex> l(checkpoint_lock);
+    while (!checkpoint_cv.wait_for(l, interval, [this] { return done.load(); })) {
+      l.unlock();
+      try {
+        write(filename);
+      } catch (const std::exception &e) {
+        std::cerr << "Error writing checkpoint: " << e.what() << std::endl;
+      }
+      l.lock();
     }
   }
 
-  impl(const char *fname) : filename((fname != nullptr) ? fname : "") {
+  impl(const char *fname, const char *shm)
+      : filename((fname != nullptr) ? fname : "") {
+    if (shm != nullptr && *shm != '\0') {
+      try {
+        segment = std::make_unique<shared::segment>(shm, shared_types());
+      } catch (const std::exception &e) {
+        std::cerr << "Error opening shared estimator: " << e.what()
+                  << std::endl;
+      }
+    }
+
     if (!filename.empty()) {
-#ifdef HAVE_BOOST_SERIALIZATION
       std::cerr << "Loading estimator contexts from " << filename << std::endl;
       try {
-        std::ifstream ifs(fname);
-        boost::archive::text_iarchive ia(ifs);
-        ia & estimators;
+        read(filename);
       } catch (const std::exception &e) {
         std::cerr << "Error loading context: " << e.what() << std::endl;
         estimators.clear();
       }
-#else
-      std::cerr << "Boost Serialization was not available at build time. "
-                   "Loading estimator contexts disabled."
-                << std::endl;
-#endif
     }
+
+    for (auto &estimator : estimators)
+      share(estimator);
+
+    trainer = std::thread(&impl::train, this);
+
+    const auto interval = checkpoint_interval();
+    if (!filename.empty() && interval.count() > 0)
+      checkpointer = std::thread(&impl::checkpoint, this, interval);
   }
   ~impl() {
+    {
+      std::lock_guard<std::mutex> l(trainer_lock);
+      done = true;
+      trainer_cv.notify_one();
+    }
+    {
+      std::lock_guard<std::mutex> l(checkpoint_lock);
+      checkpoint_cv.notify_one();
+    }
+    if (trainer.joinable())
+      trainer.join();
+    if (checkpointer.joinable())
+      checkpointer.join();
+
     if (!filename.empty()) {
-#ifdef HAVE_BOOST_SERIALIZATION
       std::cerr << "Saving estimator contexts to " << filename << std::endl;
       try {
-        std::ofstream ofs(filename.c_str());
-        boost::archive::text_oarchive oa(ofs);
-        oa &estimators;
+        write(filename);
       } catch (const std::exception &e) {
-        std::cerr << "Error loading context: " << e.what() << std::endl;
+        std::cerr << "Error saving context: " << e.what() << std::endl;
       }
-#else
-      std::cerr << "Boost Serialization was not available at build time. "
-                   "Saving estimator contexts disabled."
-                << std::endl;
-
-#endif
     }
   }
 };
 
-estimator::estimator(const char *fname) : d_(std::make_unique<impl>(fname)) {}
+estimator::estimator(const char *fname, const char *shm)
+    : d_(std::make_unique<impl>(fname, shm)) {}
 estimator::~estimator() = default;
 std::chrono::nanoseconds estimator::predict(const uint64_t job_type,
                                             const uint64_t id,
                                             const double *metrics,
                                             const size_t count) {
-  std::lock_guard<std::mutex> l(d_->lock);
-  auto &estimator = d_->find_insert(job_type, count);
+  using namespace std::chrono;
+  estimator_ctx::job job(id, metrics, count);
+  std::shared_ptr<pipeline> pipeline;
+  bool bootstrap;
+  nanoseconds budget{0};
+
+  {
+    std::lock_guard<std::mutex> l(d_->lock);
+    auto &estimator = d_->find_insert(job_type, count);
+    pipeline = estimator.pipeline;
+    bootstrap = estimator.bootstrap > 0;
+    if (bootstrap)
+      budget = d_->config_of(job_type).bootstrap_budget;
+  }
+
+  /* may fold pending samples and solve, but not under the estimator lock */
+  job.prediction = duration_cast<nanoseconds>(
+      duration<double>(pipeline->predict(job.metrics.data())));
+  const auto prediction = job.prediction;
 
   {
-    estimator.jobs.emplace_back(id, metrics, count);
-    const auto prediction = d_->predict(estimator);
-    return overallocation(prediction);
+    std::lock_guard<std::mutex> l(d_->lock);
+    d_->find(job_type).jobs.push_back(std::move(job));
+  }
+
+  const auto reservation = pipeline->reserve(prediction);
+  return bootstrap ? bootstrap_reservation(reservation, budget) : reservation;
+}
+
+std::chrono::nanoseconds estimator::estimate(const uint64_t job_type,
+                                             const double *metrics,
+                                             const size_t count) const {
+  std::chrono::nanoseconds reservation;
+  estimate(job_type, metrics, count, 1, &reservation);
+  return reservation;
+}
+
+void estimator::estimate(const uint64_t job_type, const double *metrics,
+                         const size_t count, const size_t candidates,
+                         std::chrono::nanoseconds *reservations) const {
+  using namespace std::chrono;
+  std::shared_ptr<pipeline> pipeline;
+  bool bootstrap;
+  nanoseconds budget{0};
+
+  {
+    std::lock_guard<std::mutex> l(d_->lock);
+    auto it = d_->position(job_type);
+    if (it == std::end(d_->estimators) || it->type != job_type) {
+      std::fill_n(reservations, candidates, 0ns);
+      return;
+    }
+    if (it->count != count)
+      throw_metric_count_mismatch(job_type, it->count, count);
+    pipeline = it->pipeline;
+    bootstrap = it->bootstrap > 0;
+    if (bootstrap)
+      budget = d_->config_of(job_type).bootstrap_budget;
+  }
+
+  for (size_t candidate = 0; candidate < candidates; ++candidate) {
+    const metric_vector values(metrics + candidate * count, count);
+    const auto prediction = duration_cast<nanoseconds>(
+        duration<double>(pipeline->predict(values.data())));
+    const auto reservation = pipeline->reservation(prediction);
+    reservations[candidate] =
+        bootstrap ? bootstrap_reservation(reservation, budget) : reservation;
   }
 }
 
 void estimator::train(const uint64_t job_type, const uint64_t id,
                       std::chrono::nanoseconds exectime) {
+  using namespace std::chrono;
+  std::shared_ptr<pipeline> pipeline;
+  metric_vector metrics;
+  nanoseconds prediction;
+
+  {
+    std::lock_guard<std::mutex> l(d_->lock);
+    auto &estimator = d_->find(job_type);
+    auto job = estimator.remove(id);
+    metrics = std::move(job.metrics);
+    prediction = job.prediction;
+    pipeline = estimator.pipeline;
+    if (estimator.bootstrap)
+      estimator.bootstrapped(exectime, prediction,
+                             d_->config_of(job_type).bootstrap_error);
+  }
+
+  if (pipeline->push(std::move(metrics),
+                     duration_cast<duration<double>>(exectime).count(),
+                     duration_cast<duration<double>>(exectime - prediction).count()))
+    d_->schedule(pipeline.get());
+}
+
+void estimator::discard(const uint64_t job_type, const uint64_t id) {
   std::lock_guard<std::mutex> l(d_->lock);
-  auto &estimator = d_->find(job_type);
+  d_->find(job_type).remove(id);
+}
+
+void estimator::configure(const uint64_t job_type, const config &config) {
+  std::shared_ptr<pipeline> pipeline;
+  size_t count;
+
+  validate(config);
+
   {
-    using namespace std::chrono;
-    const auto job = estimator.remove(id);
-    estimator.llsp.add(job.metrics.data(),
-                       duration_cast<duration<double>>(exectime).count());
-    estimator.llsp.solve();
+    std::lock_guard<std::mutex> l(d_->lock);
+    d_->configs[job_type] = config;
+    try {
+      auto &estimator = d_->find(job_type);
+      pipeline = estimator.pipeline;
+      count = estimator.count;
+    } catch (const std::runtime_error &) {
+      return;
+    }
   }
+
+  if (!pipeline->configured(config))
+    pipeline->reset(make_model(config, count));
+  pipeline->pad(config);
 }
 
-void estimator::save(const char *fname) const {
+void estimator::seed(const uint64_t job_type, const uint64_t related_type) {
   std::lock_guard<std::mutex> l(d_->lock);
-  d_->save(fname);
+  d_->seeds[job_type] = related_type;
+  try {
+    d_->seed(d_->find(job_type));
+  } catch (const std::runtime_error &) {
+    /* seeded when first seen */
+  }
 }
 
+std::chrono::nanoseconds estimator::padding(const uint64_t job_type) const {
+  std::lock_guard<std::mutex> l(d_->lock);
+  return d_->find(job_type).pipeline->padded();
+}
+
+void estimator::save(const char *fname) const { d_->save(fname); }
+
 bool estimator::operator==(const estimator &rhs) const {
   return *d_ == *rhs.d_;
 }
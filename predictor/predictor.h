@@ -5,19 +5,87 @@
 
 #include <cstdlib>
 
+extern "C" {
+#include "llsp.h"
+}
+
 namespace atlas {
 class estimator {
   struct impl;
   std::unique_ptr<impl> d_;
 
 public:
-  estimator(const char *fname = std::getenv("ATLAS_PREDICTOR"));
+  /* Prediction model of a job type and its parameters. */
+  struct config {
+    enum class model {
+      llsp,      /* linear least squares over the metrics */
+      ewma,      /* exponentially weighted moving average */
+      quantile,  /* online linear quantile regression over the metrics */
+      window_max /* maximum over a sliding window */
+    };
+
+    model type = model::llsp;
+    /* weight of a new sample in the EWMA */
+    double weight = 0.125;
+    /* target quantile of the quantile regression, in (0, 1) */
+    double quantile = 0.95;
+    /* step size of the quantile regression, relative to the target scale */
+    double rate = 0.05;
+    /* number of samples in the sliding window */
+    size_t window = 16;
+    /* LLSP aging factor and minimum column contribution */
+    double aging = AGING_FACTOR;
+    double contribution = COLUMN_CONTRIBUTION;
+
+    /* If set, e.g. to 0.95, reservations are padded by this quantile of the
+     * recent prediction errors instead of the fixed overallocation. */
+    double padding = 0.0;
+    /* number of recent prediction errors considered */
+    size_t padding_window = 128;
+    /* errors further from the median than this many deviations are ignored */
+    double outlier = 5.0;
+
+    /* The first jobs of a new type run best-effort, or with a reservation of
+     * at least bootstrap_budget if set, until the model's mean relative
+     * error settles, changing by less than bootstrap_error for a few jobs in
+     * a row, but for at most bootstrap jobs. 0 disables the bootstrap. */
+    size_t bootstrap = 0;
+    std::chrono::nanoseconds bootstrap_budget{0};
+    double bootstrap_error = 0.1;
+  };
+
+  /* Loads and saves the state from fname, if set. If shm names a POSIX
+   * shared memory segment, all estimators using it share their training
+   * samples and coefficients, across processes. */
+  estimator(const char *fname = std::getenv("ATLAS_PREDICTOR"),
+            const char *shm = std::getenv("ATLAS_PREDICTOR_SHM"));
   ~estimator();
 
   std::chrono::nanoseconds predict(const uint64_t job_type, const uint64_t id,
                                    const double *metrics, const size_t count);
   void train(const uint64_t job_type, const uint64_t id,
              const std::chrono::nanoseconds exectime);
+  /* Forgets a predicted job that did not run, e.g. one that was dropped. */
+  void discard(const uint64_t job_type, const uint64_t id);
+  /* Returns the reservation predict() would make, without recording a job.
+   * Returns 0 for types that were not seen yet. */
+  std::chrono::nanoseconds estimate(const uint64_t job_type,
+                                    const double *metrics,
+                                    const size_t count) const;
+  /* Same for candidates metric vectors of count metrics each, stored one
+   * after another. */
+  void estimate(const uint64_t job_type, const double *metrics,
+                const size_t count, const size_t candidates,
+                std::chrono::nanoseconds *reservations) const;
+  /* Selects the model of a job type. A trained model is replaced unless it
+   * already matches the configuration. */
+  void configure(const uint64_t job_type, const config &config);
+  /* Starts job_type from the model of related_type, which needs the same
+   * metric count, e.g. a type restored from a saved state. Applies when
+   * job_type is first seen, or right away if it already was. */
+  void seed(const uint64_t job_type, const uint64_t related_type);
+  /* Returns the padding added to the last prediction of a job type. */
+  std::chrono::nanoseconds padding(const uint64_t job_type) const;
   void save(const char *fname = std::getenv("ATLAS_PREDICTOR")) const;
   bool operator==(const estimator &rhs) const;
 };
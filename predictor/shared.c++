@@ -0,0 +1,230 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shared.h"
+
+namespace atlas {
+namespace shared {
+
+[[noreturn]] static void throw_errno(const std::string &what) {
+  throw std::runtime_error(what + ": Error " + std::to_string(errno) + " " +
+                           strerror(errno));
+}
+
+static uint64_t to_word(const double value) {
+  uint64_t word;
+  std::memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+static double to_double(const uint64_t word) {
+  double value;
+  std::memcpy(&value, &word, sizeof(value));
+  return value;
+}
+
+static bool alive(const uint64_t pid) {
+  return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+void slot::push(const uint64_t origin, const double *metrics,
+                const double target) {
+  const size_t metric_count = count.load(std::memory_order_relaxed);
+  const uint64_t position = head.fetch_add(1, std::memory_order_acq_rel);
+  sample &s = ring[position % ring_size];
+
+  s.sequence.store(2 * position + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s.origin.store(origin, std::memory_order_relaxed);
+  s.target.store(to_word(target), std::memory_order_relaxed);
+  for (size_t i = 0; i < metric_count; ++i)
+    s.metrics[i].store(to_word(metrics[i]), std::memory_order_relaxed);
+  s.sequence.store(2 * position + 2, std::memory_order_release);
+}
+
+void slot::publish(const std::vector<double> &coefficients,
+                   const double last_measured_, const uint64_t samples_,
+                   const uint64_t position_) {
+  const uint64_t self = static_cast<uint64_t>(getpid());
+  uint64_t owner = 0;
+  if (!writer.compare_exchange_strong(owner, self,
+                                      std::memory_order_acquire)) {
+    /* take over from a dead writer */
+    if (alive(owner) ||
+        !writer.compare_exchange_strong(owner, self,
+                                        std::memory_order_acquire))
+      return;
+  }
+
+  /* an odd version was left by a dead writer, the values may be torn */
+  uint64_t current = version.load(std::memory_order_relaxed);
+  const bool torn = current & 1;
+  current &= ~uint64_t{1};
+  version.store(current + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  /* keep the coefficients of a better-trained model, unless the samples
+   * since have outdated them */
+  if (!torn && samples_ < samples.load(std::memory_order_relaxed) &&
+      position_ < position.load(std::memory_order_relaxed) + ring_size) {
+    version.store(current, std::memory_order_release);
+    writer.store(0, std::memory_order_release);
+    return;
+  }
+
+  samples.store(samples_, std::memory_order_relaxed);
+  position.store(position_, std::memory_order_relaxed);
+  last_measured.store(to_word(last_measured_), std::memory_order_relaxed);
+  for (size_t i = 0; i < coefficients.size(); ++i)
+    values[i].store(to_word(coefficients[i]), std::memory_order_relaxed);
+
+  version.store(current + 2, std::memory_order_release);
+  writer.store(0, std::memory_order_release);
+}
+
+bool slot::read(std::vector<double> &coefficients, double &last_measured_,
+                uint64_t &samples_, uint64_t &position_) const {
+  static constexpr int attempts = 8;
+  coefficients.resize(count.load(std::memory_order_relaxed));
+
+  for (int attempt = 0; attempt < attempts; ++attempt) {
+    const uint64_t before = version.load(std::memory_order_acquire);
+    if (before == 0)
+      return false; /* never published */
+    if (before & 1)
+      continue;
+
+    samples_ = samples.load(std::memory_order_relaxed);
+    position_ = position.load(std::memory_order_relaxed);
+    last_measured_ = to_double(last_measured.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < coefficients.size(); ++i)
+      coefficients[i] = to_double(values[i].load(std::memory_order_relaxed));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (version.load(std::memory_order_relaxed) == before)
+      return true;
+  }
+
+  return false;
+}
+
+segment::segment(std::string name_, const size_t capacity)
+    : name(std::move(name_)), base(MAP_FAILED), size(0) {
+  bool creator = true;
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    creator = false;
+    fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+  }
+  if (fd < 0)
+    throw_errno("Opening shared estimator " + name);
+
+  if (creator) {
+    size = sizeof(header) + capacity * sizeof(slot);
+    /* the zero-filled segment is a valid, empty table */
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+      throw_errno("Sizing shared estimator " + name);
+    }
+  } else {
+    /* wait for the creator to size the segment */
+    struct stat info;
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+      if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw_errno("Reading shared estimator " + name);
+      }
+      if (info.st_size > 0)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    size = static_cast<size_t>(info.st_size);
+  }
+
+  if (size >= sizeof(header))
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (size < sizeof(header))
+    throw std::runtime_error(name + " is not a shared estimator.");
+  if (base == MAP_FAILED)
+    throw_errno("Mapping shared estimator " + name);
+
+  header_ = static_cast<header *>(base);
+  slots = reinterpret_cast<slot *>(header_ + 1);
+
+  if (creator) {
+    header_->capacity.store(capacity, std::memory_order_relaxed);
+    header_->version.store(version, std::memory_order_relaxed);
+    header_->magic.store(magic, std::memory_order_release);
+    return;
+  }
+
+  for (int attempt = 0; attempt < 1000; ++attempt) {
+    if (header_->magic.load(std::memory_order_acquire) == magic)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (header_->magic.load(std::memory_order_acquire) != magic ||
+      header_->version.load(std::memory_order_relaxed) != version ||
+      sizeof(header) + header_->capacity.load() * sizeof(slot) != size) {
+    munmap(base, size);
+    throw std::runtime_error(name + " is not a compatible shared estimator.");
+  }
+}
+
+segment::~segment() { munmap(base, size); }
+
+slot *segment::attach(const uint64_t type, const size_t count) {
+  if (count > max_metrics)
+    return nullptr;
+
+  const size_t capacity = header_->capacity.load(std::memory_order_relaxed);
+  const size_t start = static_cast<size_t>((type * 0x9e3779b97f4a7c15) >> 32);
+
+  const uint64_t self = slot::claimed_by(static_cast<uint64_t>(getpid()));
+
+  for (size_t probe = 0; probe < capacity; ++probe) {
+    slot &s = slots[(start + probe) % capacity];
+    uint64_t state = s.state.load(std::memory_order_acquire);
+
+    /* another process is claiming the slot; it only writes two words, but
+     * may die before it is done */
+    while (state != slot::ready) {
+      const bool claimed = (state & 3) == slot::claimed;
+      if (!claimed || !alive(state >> 2)) {
+        if (s.state.compare_exchange_strong(state, self,
+                                            std::memory_order_acquire)) {
+          s.type.store(type, std::memory_order_relaxed);
+          s.count.store(count, std::memory_order_relaxed);
+          s.state.store(slot::ready, std::memory_order_release);
+          return &s;
+        }
+        continue;
+      }
+      std::this_thread::yield();
+      state = s.state.load(std::memory_order_acquire);
+    }
+
+    if (s.type.load(std::memory_order_relaxed) == type)
+      return (s.count.load(std::memory_order_relaxed) == count) ? &s : nullptr;
+  }
+
+  return nullptr;
+}
+
+void segment::unlink(const std::string &name) { shm_unlink(name.c_str()); }
+}
+}
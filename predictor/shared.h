@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace atlas {
+namespace shared {
+
+/* Estimator state shared by the processes of an application.
+ *
+ * A POSIX shared memory segment holds a fixed table of job type slots. Each
+ * slot has a ring of recent training samples, which every process appends to
+ * and folds into its own model, and the coefficients of the best-trained
+ * model, published with a sequence lock. Slot claims and the writer side of
+ * the sequence lock record the pid of their owner, so a process that dies
+ * while holding either is detected by the next process that needs it, which
+ * takes over. A dead owner whose pid was reused by another live process
+ * blocks publishing, or the slot, until that process exits.
+ *
+ * All fields are 64 bit atomics, which are address-free and thus usable
+ * across processes.
+ */
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "Shared estimator state needs lock-free 64 bit atomics.");
+
+static constexpr uint64_t magic = 0x4d4853415453414c; /* "LASTASHM" */
+static constexpr uint64_t version = 2;
+/* metrics of a shared type, including the constant metric */
+static constexpr size_t max_metrics = 32;
+/* recent samples kept per type */
+static constexpr size_t ring_size = 128;
+
+using word = std::atomic<uint64_t>;
+
+struct sample {
+  /* 2 * position + 1 while written, 2 * position + 2 when complete */
+  word sequence;
+  word origin;
+  word target;
+  word metrics[max_metrics];
+};
+
+struct slot {
+  /* a claimed state also holds the pid of the claiming process */
+  enum : uint64_t { empty, claimed, ready };
+  static constexpr uint64_t claimed_by(const uint64_t pid) {
+    return (pid << 2) | claimed;
+  }
+
+  word state;
+  word type;
+  word count;
+
+  /* coefficients, odd version while written by the process writer */
+  word writer;
+  word version;
+  word samples;  /* samples the publishing model was trained with */
+  word position; /* ring position the publishing model was trained up to */
+  word last_measured;
+  word values[max_metrics];
+
+  word head; /* ring position of the next sample */
+  sample ring[ring_size];
+
+  /* Appends a sample of count metrics. */
+  void push(uint64_t origin, const double *metrics, double target);
+
+  /* Calls add(metrics, target) for the samples of other origins from
+   * position cursor on and returns the position up to which samples were
+   * consumed. Samples overwritten before they were read are skipped. */
+  template <typename Add>
+  uint64_t absorb(uint64_t cursor, uint64_t origin, Add &&add);
+
+  /* Publishes coefficients, unless another writer is active or the published
+   * ones come from a model trained with more samples and are recent. Takes
+   * over from a writer that died. */
+  void publish(const std::vector<double> &coefficients, double last_measured,
+               uint64_t samples, uint64_t position);
+
+  /* Reads consistent coefficients; returns false if none are published or
+   * writers kept interfering. */
+  bool read(std::vector<double> &coefficients, double &last_measured,
+            uint64_t &samples, uint64_t &position) const;
+};
+
+/* A shared memory segment, created by the first process that opens it. */
+class segment {
+  struct header {
+    word magic;
+    word version;
+    word capacity;
+  };
+
+  std::string name;
+  void *base;
+  size_t size;
+  header *header_;
+  slot *slots;
+
+public:
+  /* Opens or creates the segment with room for capacity job types. */
+  segment(std::string name, size_t capacity);
+  ~segment();
+  segment(const segment &) = delete;
+  segment &operator=(const segment &) = delete;
+
+  /* Returns the slot of a job type with count metrics, including the
+   * constant metric, or nullptr if the type cannot be shared. Slots left
+   * claimed by a process that died are claimed again. */
+  slot *attach(uint64_t type, size_t count);
+
+  /* Removes the segment name; mappings stay valid. */
+  static void unlink(const std::string &name);
+};
+
+template <typename Add>
+uint64_t slot::absorb(uint64_t cursor, const uint64_t origin, Add &&add) {
+  const uint64_t end = head.load(std::memory_order_acquire);
+  const size_t metrics = count.load(std::memory_order_relaxed);
+  double values[max_metrics];
+
+  if (end - cursor > ring_size)
+    cursor = end - ring_size;
+
+  for (; cursor < end; ++cursor) {
+    const sample &s = ring[cursor % ring_size];
+    const uint64_t complete = 2 * cursor + 2;
+    const uint64_t before = s.sequence.load(std::memory_order_acquire);
+    if (before < complete)
+      break; /* still being written, retry later */
+    if (before > complete)
+      continue; /* overwritten */
+
+    const uint64_t from = s.origin.load(std::memory_order_relaxed);
+    const uint64_t target = s.target.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < metrics; ++i) {
+      const uint64_t bits = s.metrics[i].load(std::memory_order_relaxed);
+      std::memcpy(&values[i], &bits, sizeof(double));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.sequence.load(std::memory_order_relaxed) != before || from == origin)
+      continue;
+
+    double value;
+    std::memcpy(&value, &target, sizeof(value));
+    add(static_cast<const double *>(values), value);
+  }
+
+  return cursor;
+}
+}
+}
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "predictor/model.h"
+
+/* Tests of the prediction models behind the estimator. */
+
+using kind = atlas::estimator::config::model;
+
+static atlas::estimator::config configured(const kind type) {
+  atlas::estimator::config config;
+  config.type = type;
+  return config;
+}
+
+/* Prediction of a model trained without metrics. */
+static double predict(const atlas::model &model) {
+  const double constant = 1.0;
+  return model.snapshot()->predict(&constant);
+}
+
+static void add(atlas::model &model, const double target) {
+  const double constant = 1.0;
+  model.add(&constant, target);
+  model.solve();
+}
+
+TEST(ModelTest, EwmaConverges) {
+  auto config = configured(kind::ewma);
+  config.weight = 0.125;
+  auto model = atlas::make_model(config, 0);
+
+  /* the first sample is taken as it is */
+  add(*model, 2.0);
+  EXPECT_DOUBLE_EQ(predict(*model), 2.0);
+  add(*model, 10.0);
+  EXPECT_DOUBLE_EQ(predict(*model), 2.0 + 0.125 * 8.0);
+
+  for (int job = 0; job < 100; ++job)
+    add(*model, 10.0);
+  EXPECT_NEAR(predict(*model), 10.0, 1e-4);
+}
+
+TEST(ModelTest, QuantileRegressionCoversQuantile) {
+  auto config = configured(kind::quantile);
+  config.quantile = 0.9;
+  config.rate = 0.05;
+  auto model = atlas::make_model(config, 1);
+
+  std::mt19937_64 generator;
+  std::uniform_real_distribution<> noise(0.0, 1.0);
+  std::uniform_real_distribution<> size(1.0, 4.0);
+  /* the execution time grows with the metric and varies by up to 2x */
+  const auto sample = [&](const double metric) {
+    return 10.0 * metric * (1.0 + noise(generator));
+  };
+
+  for (int job = 0; job < 100000; ++job) {
+    const double metrics[] = {size(generator), 1.0};
+    model->add(metrics, sample(metrics[0]));
+  }
+  model->solve();
+
+  const auto coefficients = model->snapshot();
+  int below = 0;
+  static constexpr int jobs = 10000;
+  for (int job = 0; job < jobs; ++job) {
+    const double metrics[] = {size(generator), 1.0};
+    if (sample(metrics[0]) <= coefficients->predict(metrics))
+      ++below;
+  }
+  EXPECT_NEAR(static_cast<double>(below) / jobs, 0.9, 0.03);
+}
+
+TEST(ModelTest, WindowMaxEvicts) {
+  auto config = configured(kind::window_max);
+  config.window = 4;
+  auto model = atlas::make_model(config, 0);
+
+  EXPECT_EQ(predict(*model), 0.0);
+  add(*model, 10.0);
+  for (int job = 0; job < 3; ++job)
+    add(*model, 1.0);
+  EXPECT_EQ(predict(*model), 10.0);
+
+  /* the fifth sample evicts the first */
+  add(*model, 2.0);
+  EXPECT_EQ(predict(*model), 2.0);
+  for (int job = 0; job < 4; ++job)
+    add(*model, 1.0);
+  EXPECT_EQ(predict(*model), 1.0);
+}
+
+TEST(ModelTest, RoundTrips) {
+  std::mt19937_64 generator;
+  std::uniform_real_distribution<> distribution(1.0, 2.0);
+
+  for (const auto type :
+       {kind::llsp, kind::ewma, kind::quantile, kind::window_max}) {
+    SCOPED_TRACE(static_cast<int>(type));
+    auto config = configured(type);
+    config.window = 4;
+    auto original = atlas::make_model(config, 2);
+    const auto train = [&](atlas::model &model, const int jobs) {
+      std::mt19937_64 replay = generator;
+      for (int job = 0; job < jobs; ++job) {
+        const double metrics[] = {distribution(replay), distribution(replay),
+                                  1.0};
+        model.add(metrics, 3.0 * metrics[0] + metrics[1]);
+      }
+      model.solve();
+    };
+    train(*original, 10);
+
+    std::vector<uint64_t> state;
+    original->save(state);
+    auto restored = atlas::make_model(config, 2);
+    restored->load(state.data(), state.size());
+    EXPECT_EQ(restored->type(), type);
+    EXPECT_TRUE(restored->matches(config));
+
+    const double metrics[] = {1.5, 1.25, 1.0};
+    EXPECT_EQ(restored->snapshot()->predict(metrics),
+              original->snapshot()->predict(metrics));
+
+    /* the restored model continues like the original */
+    generator.discard(20);
+    train(*original, 5);
+    train(*restored, 5);
+    EXPECT_EQ(restored->snapshot()->predict(metrics),
+              original->snapshot()->predict(metrics));
+
+    std::vector<uint64_t> again;
+    restored->save(again);
+    state.clear();
+    original->save(state);
+    EXPECT_EQ(again, state);
+  }
+}
+
+TEST(ModelTest, RejectsCorruptState) {
+  auto config = configured(kind::window_max);
+  config.window = 4;
+  auto model = atlas::make_model(config, 0);
+  std::vector<uint64_t> state;
+  model->save(state);
+  /* next beyond the window */
+  state[1] = 4;
+  EXPECT_THROW(model->load(state.data(), state.size()), std::runtime_error);
+  EXPECT_THROW(model->load(state.data(), 3), std::runtime_error);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -2,11 +2,13 @@
 #include <chrono>
 #include <random>
 
+#include <sys/stat.h>
+
 #include "gtest/gtest.h"
 #include "predictor/predictor.h"
 
 using namespace std::chrono;
-static constexpr const char *const fname = "test.json";
+static constexpr const char *const fname = "test.state";
 
 TEST(SaveTest, HandlesEmptySave) {
   atlas::estimator estimator;
@@ -25,6 +27,20 @@ TEST(SaveTest, HandlesSave) {
   estimator.save(fname);
 }
 
+TEST(SaveTest, AppliesUmask) {
+  atlas::estimator estimator;
+  /* the test is single-threaded, so it may change the umask */
+  const mode_t previous = umask(022);
+  for (const mode_t mask : {022, 077}) {
+    umask(mask);
+    estimator.save(fname);
+    struct stat info;
+    ASSERT_EQ(stat(fname, &info), 0);
+    EXPECT_EQ(info.st_mode & 0777, 0666 & ~mask);
+  }
+  umask(previous);
+}
+
 #if 1
 TEST(SaveTest, HandlesLoad) {
   static constexpr uint64_t job_type = 0xdead;
@@ -68,6 +84,51 @@ TEST(SaveTest, HandlesLoad) {
 }
 #endif
 
+TEST(SaveTest, HandlesModels) {
+  using model = atlas::estimator::config::model;
+  static constexpr uint64_t id = 0xbeef;
+  std::array<double, 4> metrics;
+  std::mt19937_64 generator;
+  std::uniform_real_distribution<> distribution;
+
+  atlas::estimator a;
+  for (const auto type : {model::llsp, model::ewma, model::quantile,
+                          model::window_max}) {
+    atlas::estimator::config config;
+    config.type = type;
+    config.window = 4;
+    config.aging = 0.05;
+    a.configure(static_cast<uint64_t>(type), config);
+  }
+
+  for (size_t job = 0; job < 10; ++job) {
+    for (uint64_t type = 0; type < 4; ++type) {
+      std::generate(
+          std::begin(metrics), std::end(metrics),
+          [&generator, &distribution] { return distribution(generator); });
+      a.predict(type, id, metrics.data(), metrics.size());
+      a.train(type, id, milliseconds(1 + job % 3));
+    }
+  }
+
+  a.save(fname);
+  atlas::estimator b(fname);
+  EXPECT_EQ(b, a);
+
+  for (uint64_t type = 0; type < 4; ++type) {
+    EXPECT_EQ(b.predict(type, id, metrics.data(), metrics.size()),
+              a.predict(type, id, metrics.data(), metrics.size()));
+    a.train(type, id, 1ms);
+    b.train(type, id, 1ms);
+  }
+  EXPECT_EQ(b, a);
+
+  /* the window maximum ignores the metrics */
+  const auto window_max = a.predict(3, id, metrics.data(), metrics.size());
+  std::reverse(std::begin(metrics), std::end(metrics));
+  EXPECT_EQ(a.predict(3, id, metrics.data(), metrics.size()), window_max);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
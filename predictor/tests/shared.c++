@@ -0,0 +1,172 @@
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "predictor/predictor.h"
+#include "predictor/shared.h"
+
+using namespace std::chrono;
+
+static constexpr uint64_t job_type = 0xdead;
+static constexpr auto per_metric = 2ms;
+
+static std::string segment_name() {
+  return "/atlas-shared-test-" + std::to_string(getpid());
+}
+
+/* Trains job_type with execution times of per_metric per unit of the metric. */
+static void train(atlas::estimator &estimator, const uint64_t jobs,
+                  const double offset) {
+  for (uint64_t job = 0; job < jobs; ++job) {
+    const double metric = offset + static_cast<double>(job % 10);
+    estimator.predict(job_type, job, &metric, 1);
+    estimator.train(job_type, job,
+                    duration_cast<nanoseconds>(per_metric * metric));
+  }
+}
+
+/* Runs fn in a child process and returns its exit status. */
+template <typename Fn> static int in_child(Fn &&fn) {
+  const pid_t child = fork();
+  if (child == 0) {
+    fn();
+    _exit(::testing::Test::HasFailure() ? 1 : 0);
+  }
+
+  int status;
+  waitpid(child, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST(SharedTest, WarmStart) {
+  const auto name = segment_name();
+  const double metric = 3.0;
+
+  EXPECT_EQ(in_child([&name] {
+              atlas::estimator trained(nullptr, name.c_str());
+              train(trained, 200, 1.0);
+            }),
+            0);
+
+  /* a new process predicts well on its first job */
+  atlas::estimator shared(nullptr, name.c_str());
+  const auto prediction = shared.predict(job_type, 0, &metric, 1);
+  EXPECT_NEAR(duration<double>(prediction).count(),
+              duration<double>(per_metric * metric).count(), 0.001);
+
+  atlas::estimator unshared(nullptr, nullptr);
+  EXPECT_LT(unshared.predict(job_type, 0, &metric, 1), 1ms);
+
+  shm_unlink(name.c_str());
+}
+
+TEST(SharedTest, ConcurrentTraining) {
+  const auto name = segment_name();
+  static constexpr int processes = 4;
+  pid_t children[processes];
+
+  for (int process = 0; process < processes; ++process) {
+    children[process] = fork();
+    if (children[process] == 0) {
+      {
+        atlas::estimator estimator(nullptr, name.c_str());
+        train(estimator, 500, 1.0 + process * 10);
+      }
+      _exit(0);
+    }
+  }
+
+  for (const pid_t child : children) {
+    int status;
+    waitpid(child, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  /* samples of all processes trained the same relation */
+  atlas::estimator shared(nullptr, name.c_str());
+  for (const double metric : {2.0, 20.0, 40.0}) {
+    const auto prediction = shared.predict(job_type, 0, &metric, 1);
+    EXPECT_NEAR(duration<double>(prediction).count(),
+                duration<double>(per_metric * metric).count(),
+                0.05 * duration<double>(per_metric * metric).count());
+    shared.train(job_type, 0, duration_cast<nanoseconds>(per_metric * metric));
+  }
+
+  shm_unlink(name.c_str());
+}
+
+TEST(SharedTest, SharesLiveSamples) {
+  const auto name = segment_name();
+  atlas::estimator a(nullptr, name.c_str());
+  atlas::estimator b(nullptr, name.c_str());
+  const double metric = 5.0;
+
+  /* samples trained by a are visible to b */
+  train(a, 50, 1.0);
+  const auto prediction = b.predict(job_type, 0, &metric, 1);
+  EXPECT_NEAR(duration<double>(prediction).count(),
+              duration<double>(per_metric * metric).count(), 0.001);
+
+  shm_unlink(name.c_str());
+}
+
+/* The pid of a process that has exited. */
+static uint64_t dead_pid() {
+  const pid_t child = fork();
+  if (child == 0)
+    _exit(0);
+  waitpid(child, nullptr, 0);
+  return static_cast<uint64_t>(child);
+}
+
+TEST(SharedTest, RecoversFromDeadWriter) {
+  const auto name = segment_name();
+  atlas::shared::segment segment(name, 4);
+  auto *slot = segment.attach(job_type, 2);
+  ASSERT_NE(slot, nullptr);
+  slot->publish({1.0, 2.0}, 0.0, 10, 10);
+
+  /* a writer died while publishing */
+  slot->writer.store(dead_pid());
+  slot->version.fetch_add(1);
+  std::vector<double> coefficients;
+  double last_measured;
+  uint64_t samples, position;
+  EXPECT_FALSE(slot->read(coefficients, last_measured, samples, position));
+
+  /* the next writer takes over, even with a less trained model */
+  slot->publish({3.0, 4.0}, 0.0, 5, 5);
+  ASSERT_TRUE(slot->read(coefficients, last_measured, samples, position));
+  EXPECT_EQ(coefficients, (std::vector<double>{3.0, 4.0}));
+  EXPECT_EQ(slot->writer.load(), 0u);
+
+  shm_unlink(name.c_str());
+}
+
+TEST(SharedTest, RecoversFromDeadClaimer) {
+  const auto name = segment_name();
+  atlas::shared::segment segment(name, 4);
+  auto *slot = segment.attach(job_type, 2);
+  ASSERT_NE(slot, nullptr);
+
+  /* a process died while claiming the slot */
+  slot->state.store(atlas::shared::slot::claimed_by(dead_pid()));
+  slot->type.store(0);
+
+  atlas::shared::segment other(name, 4);
+  EXPECT_NE(other.attach(job_type, 2), nullptr);
+  EXPECT_EQ(slot->state.load(), atlas::shared::slot::ready);
+  EXPECT_EQ(slot->type.load(), job_type);
+
+  shm_unlink(name.c_str());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
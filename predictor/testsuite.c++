@@ -84,9 +84,18 @@ int main(int argc, char *argv[]) {
       {
         auto reference_duration =
             duration_cast<nanoseconds>(duration<double>{reservation});
+        /* a query predicts the same, but does not record a job */
+        const auto estimate =
+            estimator.estimate(type, metrics.data(), metrics.size());
         /* job id 0, because each job-type processes in FIFO order */
         auto just_prediction =
             estimator.predict(type, 0, metrics.data(), metrics.size());
+        if (estimate.count() != 0 && estimate != just_prediction) {
+          std::cerr << "Exepected estimate of " << just_prediction.count()
+                    << "ns" << std::endl;
+          std::cerr << "Got estimate of " << estimate.count() << "ns"
+                    << std::endl;
+        }
         if ((just_prediction < reference_duration - 1ns) ||
             (just_prediction > reference_duration + 1ns)) {
           std::cerr << "Exepected prediction of " << reference_duration.count()
@@ -0,0 +1,192 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+namespace atlas {
+namespace trace {
+
+[[noreturn]] static void throw_errno(const std::string &what) {
+  throw std::runtime_error(what + ": Error " + std::to_string(errno) + " " +
+                           strerror(errno));
+}
+
+bool parse(const char *line, char &action, uint64_t &type,
+           std::vector<double> &values) {
+  char *end;
+
+  while (*line == ' ' || *line == '\t')
+    ++line;
+  if (*line == '\0' || *line == '\n')
+    return false;
+  action = *line++;
+
+  type = std::strtoull(line, &end, 16);
+  if (end == line)
+    throw std::runtime_error(std::string("Trace record without type: ") + line);
+  line = end;
+
+  /* strtod() reads the hexadecimal floating point values exactly */
+  values.clear();
+  for (double value = std::strtod(line, &end); end != line;
+       value = std::strtod(line, &end)) {
+    values.push_back(value);
+    line = end;
+  }
+
+  return true;
+}
+
+writer::writer(std::string path_) : path(std::move(path_)) {
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw_errno("Creating " + path);
+
+  /* the record count is filled in on commit */
+  const header h{magic, version, byte_order, 0};
+  buffer.resize(sizeof(h) / sizeof(uint64_t));
+  std::memcpy(buffer.data(), &h, sizeof(h));
+}
+
+writer::~writer() {
+  if (fd >= 0)
+    close(fd);
+}
+
+void writer::flush() {
+  const char *data = reinterpret_cast<const char *>(buffer.data());
+  size_t left = buffer.size() * sizeof(uint64_t);
+
+  while (left) {
+    const ssize_t written = write(fd, data, left);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw_errno("Writing " + path);
+    }
+    data += written;
+    left -= static_cast<size_t>(written);
+  }
+
+  buffer.clear();
+}
+
+void writer::append(const uint64_t type, const char action,
+                    const std::vector<double> &values) {
+  const size_t minimum = (action == record::prediction) ? 2 : 1;
+  if ((action != record::prediction && action != record::training) ||
+      values.size() < minimum)
+    throw std::runtime_error("Invalid trace record for type " +
+                             std::to_string(type));
+
+  const size_t offset = buffer.size();
+  buffer.resize(offset + (sizeof(record) / sizeof(uint64_t)) + values.size());
+  record *r = reinterpret_cast<record *>(buffer.data() + offset);
+  r->type = type;
+  r->action = static_cast<uint32_t>(action);
+  r->count = static_cast<uint32_t>(values.size());
+  std::memcpy(r + 1, values.data(), values.size() * sizeof(double));
+
+  ++records;
+
+  static constexpr size_t flush_words = 1 << 17;
+  if (buffer.size() >= flush_words)
+    flush();
+}
+
+void writer::commit() {
+  flush();
+
+  if (pwrite(fd, &records, sizeof(records), offsetof(header, records)) !=
+      sizeof(records))
+    throw_errno("Writing " + path);
+  if (close(fd) != 0) {
+    fd = -1;
+    throw_errno("Closing " + path);
+  }
+  fd = -1;
+}
+
+reader::reader(const std::string &path) : base(MAP_FAILED), size(0) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw_errno("Opening " + path);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw_errno("Reading " + path);
+  }
+  size = static_cast<size_t>(info.st_size);
+
+  if (size >= sizeof(header))
+    base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (size < sizeof(header))
+    throw std::runtime_error(path + " is not a binary trace.");
+  if (base == MAP_FAILED)
+    throw_errno("Mapping " + path);
+  /* traces are read front to back */
+  madvise(base, size, MADV_SEQUENTIAL);
+
+  const header *h = static_cast<const header *>(base);
+  if (h->magic != magic) {
+    munmap(base, size);
+    throw std::runtime_error(path + " is not a binary trace.");
+  }
+  if (h->version != version || h->byte_order != byte_order) {
+    munmap(base, size);
+    throw std::runtime_error(path + " has version " +
+                             std::to_string(h->version) + ", expected " +
+                             std::to_string(version) + ".");
+  }
+
+  rewind();
+}
+
+reader::~reader() { munmap(base, size); }
+
+uint64_t reader::records() const {
+  return static_cast<const header *>(base)->records;
+}
+
+void reader::rewind() {
+  cursor = static_cast<const char *>(base) + sizeof(header);
+  remaining = records();
+}
+
+const record *reader::next() {
+  if (remaining == 0)
+    return nullptr;
+
+  const char *end = static_cast<const char *>(base) + size;
+  const record *r = reinterpret_cast<const record *>(cursor);
+  if (static_cast<size_t>(end - cursor) < sizeof(record) ||
+      static_cast<size_t>(end - cursor) < r->size() ||
+      r->count < ((r->action == record::prediction) ? 2U : 1U) ||
+      (r->action != record::prediction && r->action != record::training))
+    throw std::runtime_error("Truncated or corrupt trace record.");
+
+  cursor += r->size();
+  --remaining;
+  return r;
+}
+
+bool is_binary(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  uint64_t word = 0;
+  file.read(reinterpret_cast<char *>(&word), sizeof(word));
+  return file && word == magic;
+}
+}
+}
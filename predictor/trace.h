@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace atlas {
+namespace trace {
+
+/* Binary predictor trace.
+ *
+ * The binary form of the text traces recorded by the estimator, such as
+ * predictor_test_values. A header is followed by the records in trace order.
+ * Fields are stored in native byte order and records are 8 byte aligned, so a
+ * trace can be mapped and read in place:
+ *
+ *   record     { type, action, count, values[count] }
+ *   prediction { prediction, reservation, metrics[count - 2] }
+ *   training   { execution time, metrics[count - 1] }
+ *
+ * Values are doubles in seconds or metric units, bit-identical to the text.
+ */
+static constexpr uint64_t magic = 0x4352545341544c41; /* "ATLASTRC" */
+static constexpr uint32_t version = 1;
+static constexpr uint32_t byte_order = 0x01020304;
+
+struct header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t records;
+};
+
+struct record {
+  enum action : uint32_t { prediction = 'p', training = 't' };
+
+  uint64_t type;
+  uint32_t action;
+  uint32_t count; /* number of values */
+
+  const double *values() const {
+    return reinterpret_cast<const double *>(this + 1);
+  }
+  size_t size() const { return sizeof(record) + count * sizeof(double); }
+
+  /* values of a prediction record */
+  double predicted() const { return values()[0]; }
+  double reservation() const { return values()[1]; }
+  /* value of a training record */
+  double exectime() const { return values()[0]; }
+
+  const double *metrics() const {
+    return values() + ((action == prediction) ? 2 : 1);
+  }
+  size_t metric_count() const {
+    return count - ((action == prediction) ? 2 : 1);
+  }
+};
+
+/* Parses one line of a text trace into action, type and values. Returns false
+ * for lines without a record. */
+bool parse(const char *line, char &action, uint64_t &type,
+           std::vector<double> &values);
+
+/* Writes a binary trace. */
+class writer {
+  std::string path;
+  int fd;
+  uint64_t records = 0;
+  std::vector<uint64_t> buffer;
+
+  void flush();
+
+public:
+  explicit writer(std::string path);
+  ~writer();
+  writer(const writer &) = delete;
+  writer &operator=(const writer &) = delete;
+
+  void append(uint64_t type, char action, const std::vector<double> &values);
+  /* Fills in the record count and closes the file. */
+  void commit();
+};
+
+/* Maps a binary trace and walks its records. */
+class reader {
+  void *base;
+  size_t size;
+  const char *cursor;
+  uint64_t remaining;
+
+public:
+  explicit reader(const std::string &path);
+  ~reader();
+  reader(const reader &) = delete;
+  reader &operator=(const reader &) = delete;
+
+  uint64_t records() const;
+  /* Returns the next record or nullptr after the last one. */
+  const record *next();
+  /* Starts over at the first record. */
+  void rewind();
+};
+
+/* Returns true if the file starts like a binary trace. */
+bool is_binary(const std::string &path);
+}
+}
@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "runtime/dispatch.h"
+
+/* Runs cache-heavy synthetic jobs of several types on a parallel queue over
+ * all CPUs. Each type does random lookups in its own table. Jobs are
+ * submitted in short runs per type. Compare the time per job with and
+ * without ATLAS_AFFINITY_SLACK, which enables type affinity routing, to see
+ * whether routing keeps the tables in the workers' caches; that takes
+ * several CPUs. Set ATLAS_BACKEND=NONE to run without kernel support.
+ * Usage: affinity [jobs] [table KiB] */
+
+using namespace std::chrono;
+
+static constexpr size_t types = 8;
+static constexpr size_t run_length = 4;
+static constexpr size_t lookups = 1 << 16;
+
+template <size_t I> struct table_type {
+  static constexpr uint64_t id = 0x7461626c6500 + I;
+};
+template <size_t I> constexpr uint64_t table_type<I>::id;
+
+static std::vector<std::vector<uint32_t>> tables;
+
+static void lookup(const std::vector<uint32_t> &table) {
+  volatile uint32_t sum = 0;
+  uint32_t index = 0;
+  for (size_t i = 0; i < lookups; ++i) {
+    index = index * 1664525 + 1013904223 + sum;
+    sum = sum + table[index % table.size()];
+  }
+}
+
+using submitter = std::future<void> (*)(atlas::dispatch_queue &);
+
+template <size_t I>
+static std::future<void> submit(atlas::dispatch_queue &queue) {
+  return queue.async(1s, atlas::job_class<table_type<I>>{},
+                     [] { lookup(tables[I]); });
+}
+
+template <size_t... I>
+static std::vector<submitter> submitters(std::index_sequence<I...>) {
+  return {&submit<I>...};
+}
+
+int main(int argc, char *argv[]) {
+  const size_t jobs = (argc > 1) ? std::stoul(argv[1]) : 4096;
+  const size_t table_kib = (argc > 2) ? std::stoul(argv[2]) : 256;
+
+  for (size_t type = 0; type < types; ++type)
+    tables.emplace_back(table_kib * 1024 / sizeof(uint32_t),
+                        static_cast<uint32_t>(type));
+
+  cpu_set_t cpus;
+  sched_getaffinity(0, sizeof(cpus), &cpus);
+  atlas::dispatch_queue queue("affinity", &cpus);
+  const auto submit = submitters(std::make_index_sequence<types>());
+
+  std::vector<std::future<void>> pending;
+  pending.reserve(jobs);
+  const auto start = steady_clock::now();
+  for (size_t job = 0; job < jobs; ++job)
+    pending.push_back(submit[(job / run_length) % types](queue));
+  for (auto &&job : pending)
+    job.get();
+  const auto elapsed = steady_clock::now() - start;
+
+  uint64_t ran = 0, hits = 0;
+  for (const auto &type : queue.locality()) {
+    ran += type.second.jobs;
+    hits += type.second.hits;
+  }
+
+  std::cout << CPU_COUNT(&cpus) << " workers, " << jobs << " jobs of "
+            << types << " types with " << table_kib << " KiB tables"
+            << std::endl;
+  std::cout << "time per job: " << std::fixed << std::setprecision(2)
+            << duration<double, std::micro>(elapsed).count() / jobs << "us"
+            << std::endl;
+  std::cout << "locality hits: " << 100.0 * hits / ran << "%" << std::endl;
+  if (CPU_COUNT(&cpus) < 2)
+    std::cout << "a single worker runs every type, so routing cannot change "
+                 "the time per job"
+              << std::endl;
+}
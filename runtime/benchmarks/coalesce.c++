@@ -0,0 +1,55 @@
+#include <chrono>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "runtime/dispatch.h"
+
+/* Measures the throughput of a serial queue running 1us jobs of one type,
+ * with and without coalescing. Jobs are submitted with deadlines 1us apart
+ * and coalesced if their deadlines are at most the window apart. Set
+ * ATLAS_BACKEND=NONE to run without kernel support.
+ * Usage: coalesce [jobs] [window us] */
+
+using namespace std::chrono;
+
+static void tiny() {
+  const auto end = steady_clock::now() + 1us;
+  while (steady_clock::now() < end)
+    ;
+}
+
+static double throughput(const size_t jobs, const nanoseconds window) {
+  atlas::dispatch_queue queue("coalesce");
+  queue.coalesce(window);
+
+  std::vector<std::future<void>> pending;
+  pending.reserve(jobs);
+  const auto start = steady_clock::now();
+  for (size_t job = 0; job < jobs; ++job)
+    pending.push_back(queue.async(start + 10ms + job * 1us, tiny));
+  for (auto &&job : pending)
+    job.get();
+
+  return jobs / duration<double>(steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  const size_t jobs = (argc > 1) ? std::stoul(argv[1]) : 200000;
+  const auto window = microseconds{(argc > 2) ? std::stol(argv[2]) : 50};
+
+  const double separate = throughput(jobs, -1ns);
+  const double coalesced = throughput(jobs, window);
+
+  std::cout << std::left << std::setw(12) << "jobs" << std::right
+            << std::setw(16) << "jobs/s" << std::endl;
+  std::cout << std::fixed << std::setprecision(0) << std::left
+            << std::setw(12) << "separate" << std::right << std::setw(16)
+            << separate << std::endl;
+  std::cout << std::left << std::setw(12) << "coalesced" << std::right
+            << std::setw(16) << coalesced << std::endl;
+  std::cout << "speedup: " << std::setprecision(2) << coalesced / separate
+            << "x" << std::endl;
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "runtime/dispatch.h"
+
+/* Measures the latency of sync() on an idle serial queue and on one kept
+ * busy by another thread. Set ATLAS_INLINE_SYNC=0 to compare against always
+ * running the work on the queue's thread, and ATLAS_BACKEND=NONE to run
+ * without kernel support.
+ * Usage: sync [calls] */
+
+using namespace std::chrono;
+
+static std::vector<nanoseconds> measure(atlas::dispatch_queue &queue,
+                                        const size_t calls) {
+  std::vector<nanoseconds> latencies;
+  latencies.reserve(calls);
+  volatile size_t work = 0;
+
+  for (size_t call = 0; call < calls; ++call) {
+    const auto start = steady_clock::now();
+    queue.sync(1s, [&work] { work = work + 1; });
+    latencies.push_back(steady_clock::now() - start);
+  }
+
+  std::sort(std::begin(latencies), std::end(latencies));
+  return latencies;
+}
+
+static void print(const std::string &name,
+                  const std::vector<nanoseconds> &latencies) {
+  const auto percentile = [&latencies](const double p) {
+    return duration<double, std::micro>(
+               latencies[static_cast<size_t>(p * (latencies.size() - 1))])
+        .count();
+  };
+  std::cout << std::left << std::setw(8) << name << std::right << std::fixed
+            << std::setprecision(2) << std::setw(12) << percentile(0.5)
+            << std::setw(12) << percentile(0.9) << std::setw(12)
+            << percentile(0.99) << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t calls = (argc > 1) ? std::stoul(argv[1]) : 10000;
+
+  std::cout << std::left << std::setw(8) << "queue" << std::right
+            << std::setw(12) << "p50 [us]" << std::setw(12) << "p90 [us]"
+            << std::setw(12) << "p99 [us]" << std::endl;
+
+  {
+    atlas::dispatch_queue queue("idle");
+    print("idle", measure(queue, calls));
+  }
+
+  {
+    /* another thread keeps a few short jobs queued */
+    atlas::dispatch_queue queue("busy");
+    std::atomic_bool done{false};
+    std::thread load([&queue, &done] {
+      std::deque<std::future<void>> jobs;
+      while (!done) {
+        jobs.push_back(queue.async(1s, [] {
+          const auto end = steady_clock::now() + 20us;
+          while (steady_clock::now() < end)
+            ;
+        }));
+        if (jobs.size() > 4) {
+          jobs.front().get();
+          jobs.pop_front();
+        }
+      }
+      for (auto &&job : jobs)
+        job.get();
+    });
+    print("busy", measure(queue, calls));
+    done = true;
+    load.join();
+  }
+}
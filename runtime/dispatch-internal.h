@@ -3,12 +3,70 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
 #include <future>
 #include <list>
+#include <map>
 #include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dispatch.h"
 
 namespace atlas {
+/* Execution time budget of a queue per period, like a constant bandwidth
+ * server. Jobs are charged their predicted execution time when admitted and
+ * corrected by their actual one when they ran; jobs that do not fit into the
+ * rest of the budget are demoted to best-effort. The budget is replenished at
+ * the start of each period. */
+class bandwidth {
+  mutable std::mutex lock;
+  std::chrono::nanoseconds budget{0};
+  std::chrono::nanoseconds period{0};
+  std::chrono::steady_clock::time_point start;
+  std::chrono::nanoseconds used{0};
+  uint64_t admitted = 0;
+  uint64_t demoted = 0;
+
+  /* must be called with lock held */
+  void replenish(std::chrono::steady_clock::time_point now);
+
+public:
+  /* a budget of 0 removes it */
+  void configure(std::chrono::nanoseconds budget,
+                 std::chrono::nanoseconds period);
+  bool active() const;
+  /* Charges a job's predicted execution time; false if it does not fit. */
+  bool admit(std::chrono::nanoseconds prediction);
+  /* Demotes an admitted job when it is dispatched, if the budget is used up
+   * without it, and refunds its charge. */
+  bool demote(std::chrono::nanoseconds prediction);
+  /* Takes back the admission of a job that was rejected after all. */
+  void refund(std::chrono::nanoseconds prediction);
+  /* Replaces the charge of an admitted job by its actual execution time. */
+  void charge(std::chrono::nanoseconds exectime,
+              std::chrono::nanoseconds prediction);
+  dispatch_queue::budget_usage usage();
+};
+
+/* Capacity and coalescing of the work of a queue, see dispatch_queue::limit()
+ * and coalesce(). Guarded by the lock of the executor running the work, which
+ * keeps one per queue if it is shared by several. */
+struct queue_limits {
+  /* bound of the work queued, 0 if there is none */
+  size_t max_queued = 0;
+  dispatch_queue::overflow overflow_policy = dispatch_queue::overflow::block;
+  /* jobs queued and not dropped, including coalesced ones */
+  size_t queued_jobs = 0;
+  /* work items queued or running, see executor::drain() */
+  size_t items = 0;
+  /* negative if off */
+  std::chrono::nanoseconds coalesce_window{-1};
+};
+
 struct work_item {
   std::chrono::steady_clock::time_point submit;
   std::chrono::steady_clock::time_point deadline;
@@ -19,10 +77,52 @@ struct work_item {
   std::packaged_task<void()> work;
   bool is_realtime;
   bool internal = false;
+  /* optional parts of an imprecise job and the number of them that ran */
+  std::vector<refinement> refinements{};
+  std::shared_ptr<std::promise<size_t>> refined{};
+  /* called by the worker once the work and its refinements ran */
+  std::function<void()> completion{};
+  /* real-time work dropped after it was queued, skipped by the worker */
+  bool dropped = false;
+  /* jobs of the same type coalesced into this one and run after it; its
+   * deadline and prediction cover them */
+  std::deque<std::packaged_task<void()>> coalesced{};
+  /* queued by a coalescing executor, so jobs may be coalesced into it */
+  bool batch = false;
+  /* budget of the queue charged for the work, and the charge */
+  std::shared_ptr<bandwidth> budget{};
+  std::chrono::nanoseconds charged{0};
+  /* over its queue's budget, so it runs after other best-effort work */
+  bool demoted = false;
+  /* limits of the work's queue on a shared executor, or none for the
+   * executor's own */
+  std::shared_ptr<queue_limits> limits{};
+  /* queue the work was dispatched to, see dispatch_queue::current() */
+  const dispatch_queue *queue = nullptr;
 };
 
+class executor;
+
+/* A real-time job running on a worker, see dispatch_queue::report(). */
+struct job_context {
+  const executor *owner;
+  work_item *work;
+  std::chrono::nanoseconds start;
+  /* the type of each reported phase and the CPU time it started at */
+  std::vector<std::pair<uint64_t, std::chrono::nanoseconds>> phases{};
+};
+
+/* Finishes a work item after its work and its optional parts ran. */
+inline void complete(work_item &work) {
+  if (work.completion)
+    work.completion();
+}
+
 class executor {
   mutable std::condition_variable empty;
+  mutable std::condition_variable space;
+  /* notified when the last work item of a queue finished */
+  mutable std::condition_variable drained;
   mutable std::mutex list_lock;
   mutable std::list<work_item> work_queue;
   std::string label;
@@ -30,17 +130,89 @@ class executor {
   virtual void
   submit(const uint64_t id, const std::chrono::nanoseconds exectime,
          const std::chrono::steady_clock::time_point deadline) const = 0;
+  /* updates the reservation of submitted work, see extensible */
+  virtual void extend(const uint64_t, const std::chrono::nanoseconds,
+                      const std::chrono::steady_clock::time_point) const {}
   mutable std::atomic_bool done{false};
+  /* reservations of the real-time work queued or running, in ns */
+  mutable std::atomic<int64_t> planned{0};
+  /* a worker runs an item, or a caller holds the executor */
+  mutable bool running = false;
+  mutable bool held = false;
+  /* worker that ran each type last, and how often that was the same one */
+  mutable std::unordered_map<uint64_t, size_t> last_worker;
+  mutable std::map<uint64_t, dispatch_queue::type_locality> localities;
+  /* must be called with list_lock held */
+  queue_limits &limits_of(const work_item &work) const {
+    return work.limits ? *work.limits : limits;
+  }
+  bool coalescable(const work_item &work) const;
+  work_item *batch_for(const work_item &work) const;
+  /* must be called with list_lock held */
+  std::list<work_item>::const_iterator
+  affine(std::list<work_item>::const_iterator earliest, size_t worker) const;
 
 protected:
+  /* Non-real-time work runs by earliest deadline instead of in order, for
+   * executors shared by several queues. */
+  bool deadline_ordered = false;
+  /* Work runs one item at a time, so an idle executor can be held by a
+   * caller running work itself. */
+  bool serial = false;
+  /* Work runs on several workers at once. */
+  bool parallel = false;
+  /* If not negative, non-real-time work preferably runs on the worker that
+   * ran its type last, unless other work is due more than this earlier. */
+  std::chrono::nanoseconds affinity_slack{-1};
+  /* Reservations of submitted work can be extended, so real-time work can
+   * be coalesced. */
+  bool extensible = false;
+  /* limits of the work without limits of its own */
+  mutable queue_limits limits;
+
   void shutdown() const;
-  void work_loop() const;
+  void work_loop(size_t worker = 0) const;
+  /* Runs the optional parts of an imprecise job after its work, which took
+   * exectime, and returns the time of both. */
+  std::chrono::nanoseconds refine(work_item &work,
+                                  std::chrono::nanoseconds exectime) const;
 
 public:
   executor();
   executor(std::string);
   virtual ~executor();
-  virtual void enqueue(work_item work) const;
+
+  /* How enqueue() treats work beyond the capacity: by the overflow policy,
+   * by rejecting it, or by queueing it anyway, e.g. for work already
+   * admitted by another queue. */
+  enum class admission { policy, reject, bypass };
+  /* Returns false if the work was rejected. */
+  virtual bool enqueue(work_item work,
+                       admission mode = admission::policy) const;
+  virtual void limit(size_t capacity, dispatch_queue::overflow policy) const;
+  virtual size_t capacity() const;
+  virtual size_t occupancy() const;
+  virtual void coalesce(std::chrono::nanoseconds window) const;
+  /* The same for the work of a queue sharing the executor. */
+  void limit(queue_limits &queue, size_t capacity,
+             dispatch_queue::overflow policy) const;
+  size_t capacity(const queue_limits &queue) const;
+  size_t occupancy(const queue_limits &queue) const;
+  void coalesce(queue_limits &queue, std::chrono::nanoseconds window) const;
+  /* Waits until the queued and running work of a queue finished. */
+  void drain(const queue_limits &queue) const;
+  /* Adjusts the reservation of running real-time work to exectime in
+   * total. */
+  void reserve(work_item &work, std::chrono::nanoseconds exectime) const;
+  /* Holds a serial executor while it is idle, so the caller can run work in
+   * its place; returns false otherwise. Queued work waits for release(). */
+  virtual bool acquire() const;
+  virtual void release() const;
+  bool is_parallel() const { return parallel; }
+  virtual std::chrono::nanoseconds backlog() const {
+    return std::chrono::nanoseconds{planned.load()};
+  }
+  virtual std::map<uint64_t, dispatch_queue::type_locality> locality() const;
 };
 
 #ifdef HAVE_GCD
@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <list>
+#include <map>
 #include <mutex>
 #include <thread>
+#include <tuple>
 #include <condition_variable>
 #include <iterator>
 #include <vector>
@@ -23,7 +26,11 @@
 #include "pmu.h"
 #endif
 
-static thread_local atlas::dispatch_queue *current_queue;
+static thread_local const atlas::dispatch_queue *current_queue;
+/* the thread runs a real-time job, under its reservation */
+static thread_local bool reserved = false;
+/* the real-time job the thread runs, if it has a reservation of its own */
+static thread_local atlas::job_context *current_job = nullptr;
 
 static pid_t gettid() { return static_cast<pid_t>(syscall(SYS_gettid)); }
 
@@ -36,6 +43,8 @@ class Options {
 #endif
   bool use_gcd_ = false;
   bool use_atlas_ = true;
+  bool inline_sync_ = true;
+  std::chrono::nanoseconds affinity_slack_{-1};
   /* estimator dump */
 public:
   Options() {
@@ -60,6 +69,16 @@ public:
     } catch (...) {
     }
 
+    /* ATLAS_INLINE_SYNC=0 always runs sync() work on the queue's thread */
+    if (const char *inline_sync = std::getenv("ATLAS_INLINE_SYNC"))
+      inline_sync_ = std::string(inline_sync) != "0";
+
+    /* ATLAS_AFFINITY_SLACK=<us> routes the non-real-time work of parallel
+     * queues to the worker that ran its type last, unless other work is due
+     * more than that earlier */
+    if (const char *slack = std::getenv("ATLAS_AFFINITY_SLACK"))
+      affinity_slack_ = std::chrono::microseconds{std::stol(slack)};
+
 #ifdef HAVE_JEVENTS
     const char *env;
     if ((env = std::getenv("ATLAS_PMU")) != nullptr) {
@@ -91,6 +110,8 @@ public:
   }
 
   bool atlas() const { return use_atlas_; }
+  bool inline_sync() const { return inline_sync_; }
+  std::chrono::nanoseconds affinity_slack() const { return affinity_slack_; }
   bool gcd() const {
       return use_gcd_; }
 
@@ -178,26 +199,142 @@ static work_item *next_work_item() {
   }
 }
 
+void bandwidth::replenish(const std::chrono::steady_clock::time_point now) {
+  if (now - start < period)
+    return;
+  start += period * ((now - start) / period);
+  used = std::chrono::nanoseconds{0};
+}
+
+void bandwidth::configure(const std::chrono::nanoseconds budget_,
+                          const std::chrono::nanoseconds period_) {
+  if (budget_.count() < 0 || (budget_.count() > 0 && period_ < budget_))
+    throw std::runtime_error("Budget must not exceed its period.");
+  std::lock_guard<std::mutex> l(lock);
+  budget = budget_;
+  period = period_;
+  start = std::chrono::steady_clock::now();
+  used = std::chrono::nanoseconds{0};
+}
+
+bool bandwidth::active() const {
+  std::lock_guard<std::mutex> l(lock);
+  return budget.count() > 0;
+}
+
+bool bandwidth::admit(const std::chrono::nanoseconds prediction) {
+  std::lock_guard<std::mutex> l(lock);
+  replenish(std::chrono::steady_clock::now());
+  if (used + prediction > budget) {
+    ++demoted;
+    return false;
+  }
+  used += prediction;
+  ++admitted;
+  return true;
+}
+
+bool bandwidth::demote(const std::chrono::nanoseconds prediction) {
+  std::lock_guard<std::mutex> l(lock);
+  replenish(std::chrono::steady_clock::now());
+  if (used - prediction < budget)
+    return false;
+  used -= prediction;
+  --admitted;
+  ++demoted;
+  return true;
+}
+
+void bandwidth::refund(const std::chrono::nanoseconds prediction) {
+  std::lock_guard<std::mutex> l(lock);
+  replenish(std::chrono::steady_clock::now());
+  used = std::max(used - prediction, std::chrono::nanoseconds{0});
+  --admitted;
+}
+
+void bandwidth::charge(const std::chrono::nanoseconds exectime,
+                       const std::chrono::nanoseconds prediction) {
+  std::lock_guard<std::mutex> l(lock);
+  replenish(std::chrono::steady_clock::now());
+  /* jobs admitted in an earlier period are corrected in the current one */
+  used = std::max(used + exectime - prediction, std::chrono::nanoseconds{0});
+}
+
+dispatch_queue::budget_usage bandwidth::usage() {
+  std::lock_guard<std::mutex> l(lock);
+  if (budget.count() > 0)
+    replenish(std::chrono::steady_clock::now());
+  return {budget, period, used, admitted, demoted};
+}
+
 executor::executor(std::string label_) : label(std::move(label_)) {}
 executor::executor() : executor("default") {}
 
 void executor::shutdown() const {
   using namespace std::literals::chrono_literals;
-  enqueue({atlas::clock::now(), atlas::clock::now(), 0us, nullptr, 0, 0,
+  /* the latest deadline, so deadline-ordered executors finish their work */
+  enqueue({atlas::clock::now(), atlas::clock::time_point::max(), 0us, nullptr,
+           0, 0,
            std::packaged_task<void()>([=] {
              done = true;
              empty.notify_all();
+             space.notify_all();
            }),
            false, true});
 }
 
-void executor::work_loop() const {
+/* Demotes best-effort work whose queue used up its budget by the time the
+ * work is dispatched. */
+static bool demote_exhausted(work_item &work) {
+  if (!work.budget || work.demoted || !work.budget->demote(work.charged))
+    return false;
+  work.budget.reset();
+  work.demoted = true;
+  return true;
+}
+
+std::list<work_item>::const_iterator
+executor::affine(const std::list<work_item>::const_iterator earliest,
+                 const size_t worker) const {
+  const auto latest = atlas::clock::time_point::max();
+  const auto bound = (earliest->deadline < latest - affinity_slack)
+                         ? earliest->deadline + affinity_slack
+                         : latest;
+  /* candidates considered, to bound the cost of long queues */
+  static constexpr size_t window = 64;
+  size_t candidates = 0;
+  auto preferred = work_queue.cend();
+  /* queued work often comes in runs of one type */
+  uint64_t type = 0;
+  bool owned = false;
+
+  for (auto it = work_queue.cbegin();
+       it != work_queue.cend() && candidates < window; ++it) {
+    if (it->is_realtime || it->demoted != earliest->demoted ||
+        it->deadline > bound)
+      continue;
+    ++candidates;
+    if (candidates == 1 || it->type != type) {
+      const auto owner = last_worker.find(it->type);
+      type = it->type;
+      owned = owner == last_worker.cend() || owner->second == worker;
+    }
+    if (owned &&
+        (preferred == work_queue.cend() || it->deadline < preferred->deadline))
+      preferred = it;
+  }
+
+  return (preferred != work_queue.cend()) ? preferred : earliest;
+}
+
+void executor::work_loop(const size_t worker) const {
   while (!done) {
     std::list<work_item> tmp;
 
     {
       std::unique_lock<std::mutex> lock(list_lock);
-      empty.wait(lock, [this] { return (!work_queue.empty() || done); });
+      empty.wait(lock,
+                 [this] { return (!work_queue.empty() && !held) || done; });
 
       if (done) {
         break;
@@ -206,7 +343,24 @@ void executor::work_loop() const {
       /* do non-real-time work in order - pop from the front as long as there
        * is work */
       if (!work_queue.front().is_realtime) {
-        tmp.splice(tmp.cbegin(), work_queue, work_queue.cbegin());
+        auto it = work_queue.cbegin();
+        for (;;) {
+          if (deadline_ordered)
+            it = std::min_element(
+                work_queue.cbegin(), work_queue.cend(),
+                [](const auto &lhs, const auto &rhs) {
+                  return !lhs.is_realtime &&
+                         (rhs.is_realtime ||
+                          std::tie(lhs.demoted, lhs.deadline) <
+                              std::tie(rhs.demoted, rhs.deadline));
+                });
+          if (affinity_slack.count() >= 0)
+            it = affine(it, worker);
+          /* demoted work yields to the other work of shared workers */
+          if (!demote_exhausted(*work_queue.erase(it, it)) || !deadline_ordered)
+            break;
+        }
+        tmp.splice(tmp.cbegin(), work_queue, it);
       } else {
         /* do real-time work */
         auto ptr = next_work_item();
@@ -231,84 +385,463 @@ void executor::work_loop() const {
           continue;
         }
       }
+
+      running = true;
+
+      const auto &next = tmp.front();
+      const auto jobs = 1 + next.coalesced.size();
+      if (!next.dropped && !next.internal) {
+        auto &queue = limits_of(next);
+        queue.queued_jobs -= jobs;
+        if (queue.max_queued > 0)
+          space.notify_all();
+      }
+      if (deadline_ordered && !next.internal && !next.dropped) {
+        auto &locality = localities[next.type];
+        auto last = last_worker.emplace(next.type, worker);
+        locality.jobs += jobs;
+        /* coalesced jobs follow one of their type */
+        locality.hits += jobs - 1;
+        if (!last.second && last.first->second == worker)
+          ++locality.hits;
+        last.first->second = worker;
+      }
     }
 
     work_item &work = tmp.front();
+    /* workers may be shared by several queues */
+    const auto previous = current_queue;
+    if (work.queue)
+      current_queue = work.queue;
 
     try {
       // might throw std::future_error, if already invoked
 
-      if (work.is_realtime) {
+      if (work.dropped) {
+        planned -= std::chrono::nanoseconds{work.prediction}.count();
+        application_estimator.discard(work.type,
+                                      reinterpret_cast<uint64_t>(&work));
+        for (const auto &job : work.coalesced)
+          application_estimator.discard(work.type,
+                                        reinterpret_cast<uint64_t>(&job));
+        if (work.budget)
+          work.budget->charge(std::chrono::nanoseconds{0}, work.charged);
+        complete(work);
+      } else if (work.is_realtime) {
         using namespace std::chrono;
-        const auto start = cputime_clock::now();
-        {
-          //options.pmu_begin();
-          work.work();
-          //options.pmu_end(work);
-        }
-        const auto end = cputime_clock::now();
-        const auto exectime = end - start;
-        const uint64_t id = reinterpret_cast<uint64_t>(&work);
-        try {
-          application_estimator.train(work.type, id,
-                                      duration_cast<microseconds>(exectime));
-        } catch (const std::runtime_error &e) {
-          std::cerr << e.what() << std::endl;
-          std::terminate();
-        }
+        /* each job is trained on its own, also when coalesced */
+        const auto run = [this, &work](std::packaged_task<void()> &task,
+                                       const uint64_t id) {
+          const auto start = cputime_clock::now();
+          job_context job{this, &work, start.time_since_epoch()};
+          {
+            //options.pmu_begin();
+            reserved = true;
+            if (work.coalesced.empty())
+              current_job = &job;
+            task();
+            current_job = nullptr;
+            reserved = false;
+            //options.pmu_end(work);
+          }
+          const auto end = cputime_clock::now();
+          const auto exectime = end - start;
+          try {
+            for (const auto &phase : job.phases)
+              application_estimator.train(
+                  phase.first, id,
+                  duration_cast<microseconds>(end.time_since_epoch() -
+                                              phase.second));
+            application_estimator.train(work.type, id,
+                                        duration_cast<microseconds>(exectime));
+          } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            std::terminate();
+          }
+          return exectime;
+        };
+        auto exectime = run(work.work, reinterpret_cast<uint64_t>(&work));
+        for (auto &job : work.coalesced)
+          exectime += run(job, reinterpret_cast<uint64_t>(&job));
+        exectime = refine(work, exectime);
+        planned -= std::chrono::nanoseconds{work.prediction}.count();
+        if (work.budget)
+          work.budget->charge(exectime, work.charged);
+        complete(work);
       } else {
         //const auto pmu = !work.internal;
         //if (pmu)
         //  options.pmu_begin();
 
+        const auto start = cputime_clock::now();
         work.work();
+        for (auto &job : work.coalesced)
+          job();
         //if (pmu)
         //  options.pmu_end(work);
+        const auto exectime = refine(work, cputime_clock::now() - start);
+        if (work.budget)
+          work.budget->charge(exectime, work.charged);
+        complete(work);
       }
     } catch (const std::runtime_error &e) {
       // Bad library, wrinting to cerr!
       std::cerr << e.what() << std::endl;
     }
+    current_queue = previous;
+
+    std::lock_guard<std::mutex> lock(list_lock);
+    running = false;
+    if (--limits_of(work).items == 0)
+      drained.notify_all();
   };
 }
 
-void executor::enqueue(work_item work) const {
+std::map<uint64_t, dispatch_queue::type_locality>
+executor::locality() const {
+  std::lock_guard<std::mutex> lock(list_lock);
+  return localities;
+}
+
+bool executor::acquire() const {
+  std::lock_guard<std::mutex> lock(list_lock);
+  if (!serial || running || held || !work_queue.empty())
+    return false;
+  held = true;
+  return true;
+}
+
+void executor::release() const {
+  {
+    std::lock_guard<std::mutex> lock(list_lock);
+    held = false;
+  }
+  empty.notify_all();
+}
+
+std::chrono::nanoseconds
+executor::refine(work_item &work, std::chrono::nanoseconds exectime) const {
+  using namespace std::chrono;
+  if (!work.refined)
+    return exectime;
+
+  size_t ran = 0;
+  try {
+    /* rethrows the exception of the mandatory part */
+    work.work.get_future().get();
+
+    for (const auto &part : work.refinements) {
+      const auto reservation = application_estimator.estimate(
+          part.type, part.metrics.data(), part.metrics.size());
+      /* the part delays the reservations queued behind the job, so they
+       * have to fit into the slack as well */
+      const auto queued =
+          std::max(backlog() - nanoseconds{work.prediction}, nanoseconds{0});
+      if (atlas::clock::now() + queued + reservation > work.deadline)
+        break;
+      /* the part runs in the job's reservation, extended by it */
+      if (work.is_realtime)
+        reserve(work, exectime + reservation);
+
+      const uint64_t id = reinterpret_cast<uint64_t>(&part);
+      application_estimator.predict(part.type, id, part.metrics.data(),
+                                    part.metrics.size());
+      const auto start = cputime_clock::now();
+      const auto train = [&] {
+        const auto elapsed = cputime_clock::now() - start;
+        reserved = false;
+        exectime += elapsed;
+        application_estimator.train(part.type, id,
+                                    duration_cast<microseconds>(elapsed));
+      };
+      reserved = work.is_realtime;
+      try {
+        part.work();
+      } catch (...) {
+        train();
+        throw;
+      }
+      train();
+      ++ran;
+    }
+  } catch (...) {
+    work.refined->set_exception(std::current_exception());
+    return exectime;
+  }
+
+  work.refined->set_value(ran);
+  return exectime;
+}
+
+/* The queued work to drop for incoming work under overflow::drop_earliest:
+ * the one of its queue due first, or end() if that is the incoming work
+ * itself. */
+static std::list<work_item>::iterator dropped_for(std::list<work_item> &queue,
+                                                  const work_item &incoming) {
+  auto earliest = queue.end();
+  for (auto it = queue.begin(); it != queue.end(); ++it) {
+    if (it->internal || it->dropped || it->limits != incoming.limits)
+      continue;
+    if (earliest == queue.end() || it->deadline < earliest->deadline)
+      earliest = it;
+  }
+  if (earliest != queue.end() && incoming.deadline < earliest->deadline)
+    return queue.end();
+  return earliest;
+}
+
+/* Finishes work dropped before it ran; destroying it breaks its promises. */
+static void finish_dropped(std::list<work_item> &dropped) {
+  for (auto &work : dropped) {
+    if (work.budget)
+      work.budget->charge(std::chrono::nanoseconds{0}, work.charged);
+    if (work.completion)
+      work.completion();
+  }
+  dropped.clear();
+}
+
+bool executor::coalescable(const work_item &work) const {
+  return limits_of(work).coalesce_window.count() >= 0 && !work.internal &&
+         !work.refined &&
+         !work.completion && (!work.is_realtime || extensible);
+}
+
+work_item *executor::batch_for(const work_item &work) const {
+  /* coalesced jobs run back to back on one worker, so batches are bounded */
+  static constexpr size_t max_batch = 64;
+  /* jobs of a type are usually submitted close together */
+  static constexpr size_t window = 16;
+
+  if (!coalescable(work))
+    return nullptr;
+
+  /* in-order work would overtake the jobs queued after an earlier batch */
+  const size_t reach = (deadline_ordered || work.is_realtime) ? window : 1;
+  size_t candidates = 0;
+  for (auto it = work_queue.rbegin();
+       it != work_queue.rend() && candidates < reach; ++it, ++candidates) {
+    if (!it->batch || it->dropped || it->type != work.type ||
+        it->is_realtime != work.is_realtime || it->budget != work.budget ||
+        it->demoted != work.demoted || it->limits != work.limits ||
+        it->coalesced.size() + 1 >= max_batch)
+      continue;
+    const auto distance = (it->deadline < work.deadline)
+                              ? work.deadline - it->deadline
+                              : it->deadline - work.deadline;
+    if (distance <= limits_of(work).coalesce_window)
+      return &*it;
+  }
+  return nullptr;
+}
+
+bool executor::enqueue(work_item work, const admission mode) const {
+  using overflow = dispatch_queue::overflow;
+  using namespace std::chrono;
   std::list<work_item> tmp;
   tmp.push_back(std::move(work));
 
   work_item *item = &tmp.front();
+  /* finished after the lock is released */
+  std::list<work_item> dropped;
+  std::vector<std::packaged_task<void()>> cancelled;
+  std::shared_ptr<std::promise<size_t>> cancelled_refinements;
+  bool submitted = false;
 
   /*
    * link in queue first, otherwise threads might get the job id from next,
    * but not find it in the queue.
    */
   {
-    std::lock_guard<std::mutex> lock(list_lock);
+    std::unique_lock<std::mutex> lock(list_lock);
+    auto &queue = limits_of(*item);
+    if (queue.max_queued > 0 && mode != admission::bypass && !item->internal &&
+        queue.queued_jobs >= queue.max_queued) {
+      switch ((mode == admission::reject) ? overflow::fail
+                                          : queue.overflow_policy) {
+      case overflow::block:
+        space.wait(lock, [this, &queue] {
+          return queue.max_queued == 0 ||
+                 queue.queued_jobs < queue.max_queued || done;
+        });
+        break;
+      case overflow::fail:
+        return false;
+      case overflow::drop_earliest: {
+        auto victim = dropped_for(work_queue, *item);
+        if (victim == work_queue.end()) {
+          dropped.splice(dropped.end(), tmp);
+          break;
+        }
+        queue.queued_jobs -= 1 + victim->coalesced.size();
+        if (!victim->is_realtime) {
+          --queue.items;
+          dropped.splice(dropped.end(), work_queue, victim);
+        } else {
+          /* it may be submitted already, so it stays queued until the kernel
+           * hands it out, and the worker skips it then */
+          victim->dropped = true;
+          cancelled.push_back(std::move(victim->work));
+          for (auto &job : victim->coalesced)
+            cancelled.push_back(std::move(job));
+          cancelled_refinements = std::move(victim->refined);
+        }
+        break;
+      }
+      }
+    }
+    if (tmp.empty()) {
+      lock.unlock();
+      finish_dropped(dropped);
+      return true;
+    }
+    if (!item->internal)
+      ++queue.queued_jobs;
+
+    if (auto batch = batch_for(*item)) {
+      batch->coalesced.push_back(std::move(item->work));
+      batch->charged += item->charged;
+      if (item->deadline < batch->deadline)
+        batch->deadline = item->deadline;
+      if (item->is_realtime) {
+        /* the id of a coalesced job is its task */
+        const uint64_t id = reinterpret_cast<uint64_t>(&batch->coalesced.back());
+        const auto exectime = application_estimator.predict(
+            item->type, id, item->metrics, item->metrics_count);
+        const auto prediction = duration_cast<microseconds>(exectime);
+        batch->prediction += prediction;
+        planned += nanoseconds{prediction}.count();
+        extend(reinterpret_cast<uint64_t>(batch), batch->prediction,
+               batch->deadline);
+      }
+      lock.unlock();
+      finish_dropped(dropped);
+      return true;
+    }
+
+    /* a batch's reservation is extended under the lock, so it is also
+     * submitted under it */
+    item->batch = coalescable(*item);
+    ++queue.items;
     work_queue.splice(work_queue.end(), std::move(tmp));
+    if (item->batch && item->is_realtime) {
+      const uint64_t id = reinterpret_cast<uint64_t>(item);
+      const auto exectime = application_estimator.predict(
+          item->type, id, item->metrics, item->metrics_count);
+      item->prediction = duration_cast<microseconds>(exectime);
+      planned += nanoseconds{item->prediction}.count();
+      submit(id, exectime, item->deadline);
+      submitted = true;
+    }
   }
 
-  if (item->is_realtime) {
+  finish_dropped(dropped);
+
+  if (item->is_realtime && !submitted) {
     const uint64_t id = reinterpret_cast<uint64_t>(item);
     const auto exectime = application_estimator.predict(
         item->type, id, item->metrics, item->metrics_count);
-    using namespace std::chrono;
     item->prediction = duration_cast<microseconds>(exectime);
+    planned += nanoseconds{item->prediction}.count();
     submit(id, exectime, item->deadline);
   }
 
   empty.notify_all();
+  return true;
+}
+
+void executor::reserve(work_item &work,
+                       const std::chrono::nanoseconds exectime) const {
+  using namespace std::chrono;
+  const auto prediction = duration_cast<microseconds>(exectime);
+  planned += nanoseconds{prediction - work.prediction}.count();
+  work.prediction = prediction;
+  extend(reinterpret_cast<uint64_t>(&work), exectime, work.deadline);
+}
+
+void executor::coalesce(const std::chrono::nanoseconds window) const {
+  coalesce(limits, window);
+}
+
+void executor::limit(const size_t capacity,
+                     const dispatch_queue::overflow policy) const {
+  limit(limits, capacity, policy);
+}
+
+size_t executor::capacity() const { return capacity(limits); }
+size_t executor::occupancy() const { return occupancy(limits); }
+
+void executor::coalesce(queue_limits &queue,
+                        const std::chrono::nanoseconds window) const {
+  std::lock_guard<std::mutex> lock(list_lock);
+  queue.coalesce_window = window;
+}
+
+void executor::limit(queue_limits &queue, const size_t capacity,
+                     const dispatch_queue::overflow policy) const {
+  {
+    std::lock_guard<std::mutex> lock(list_lock);
+    queue.max_queued = capacity;
+    queue.overflow_policy = policy;
+  }
+  space.notify_all();
+}
+
+size_t executor::capacity(const queue_limits &queue) const {
+  std::lock_guard<std::mutex> lock(list_lock);
+  return queue.max_queued;
+}
+
+size_t executor::occupancy(const queue_limits &queue) const {
+  std::lock_guard<std::mutex> lock(list_lock);
+  return queue.queued_jobs;
+}
+
+void executor::drain(const queue_limits &queue) const {
+  std::unique_lock<std::mutex> lock(list_lock);
+  drained.wait(lock, [this, &queue] { return queue.items == 0 || done; });
 }
 
 executor::~executor() {}
 
 struct dispatch_queue::impl {
   uint32_t magic = 0x61746C73; // 'atls'
-  std::unique_ptr<executor> worker;
+  std::shared_ptr<executor> worker;
+  std::shared_ptr<bandwidth> budget = std::make_shared<bandwidth>();
 
   impl(dispatch_queue *queue);
   impl(dispatch_queue *queue, std::string label);
   impl(dispatch_queue *queue, std::string label, std::vector<int> cpu_set);
-  void dispatch(work_item item) const { worker->enqueue(std::move(item)); }
+  impl(std::string label, const impl &target);
+  /* Charges the work to the queue's budget, or demotes it to best-effort
+   * if it does not fit. */
+  void admit(work_item &item) const {
+    if (!budget->active())
+      return;
+    const auto prediction = application_estimator.estimate(
+        item.type, item.metrics, item.metrics_count);
+    if (budget->admit(prediction)) {
+      item.budget = budget;
+      item.charged = prediction;
+    } else {
+      item.is_realtime = false;
+      item.demoted = true;
+    }
+  }
+  bool enqueue(work_item item, const executor::admission mode) const {
+    admit(item);
+    const auto budget_ = item.budget;
+    const auto charged = item.charged;
+    if (worker->enqueue(std::move(item), mode))
+      return true;
+    if (budget_)
+      budget_->refund(charged);
+    return false;
+  }
+  void dispatch(work_item item) const {
+    if (!enqueue(std::move(item), executor::admission::policy))
+      throw std::runtime_error("Dispatch queue is full.");
+  }
 };
 
 #pragma clang diagnostic push
@@ -330,11 +863,19 @@ class main_queue_executor final : public executor {
     np::submit(main_thread, id, exectime, deadline);
   }
 
+  void
+  extend(const uint64_t id, const std::chrono::nanoseconds exectime,
+         const std::chrono::steady_clock::time_point deadline) const override {
+    atlas::update(np::from(main_thread), id, exectime, deadline);
+  }
+
   friend class main_queue;
 public:
   main_queue_executor(dispatch_queue *queue, const std::string &label)
       : executor(label), queue_(queue),
-        main_thread(std::this_thread::get_id()) {}
+        main_thread(std::this_thread::get_id()) {
+    extensible = true;
+  }
   ~main_queue_executor() override { shutdown(); }
   void dispatch() { process_work(queue_); }
 };
@@ -375,9 +916,19 @@ class queue_worker final : public executor {
     np::submit(thread, id, exectime, deadline);
   }
 
+  void
+  extend(const uint64_t id, const std::chrono::nanoseconds exectime,
+         const std::chrono::steady_clock::time_point deadline) const override {
+    atlas::update(np::from(thread), id, exectime, deadline);
+  }
+
 public:
   queue_worker(dispatch_queue *queue, const std::string &label)
-      : executor(label), thread(&queue_worker::process_work, this, queue) {}
+      : executor(label) {
+    serial = true;
+    extensible = true;
+    thread = std::thread(&queue_worker::process_work, this, queue);
+  }
   ~queue_worker() override {
     shutdown();
 
@@ -390,7 +941,11 @@ class pool {
   uint64_t id = static_cast<uint64_t>(-1);
 
 public:
-  pool() : id(atlas::threadpool::create()) {}
+  /* without kernel support, work is not submitted and there is no pool */
+  pool() {
+    if (options.atlas())
+      id = atlas::threadpool::create();
+  }
   ~pool() {
     if (id != static_cast<uint64_t>(-1))
       atlas::threadpool::destroy(id);
@@ -419,9 +974,12 @@ class concurrent final : public executor {
   std::unique_ptr<std::thread[]> workers;
   size_t thread_count;
 
-  std::atomic<size_t> init{0};
+  /* workers that did not join the thread pool yet */
+  size_t init;
+  std::mutex init_lock;
+  std::condition_variable initialized;
 
-  void process_work(dispatch_queue *queue, int cpu) {
+  void process_work(dispatch_queue *queue, size_t worker, int cpu) {
     {
       const auto tid = gettid();
       cpu_set_t cpu_set;
@@ -432,11 +990,16 @@ class concurrent final : public executor {
     }
 
     ignore_deadlines();
-    tp.join();
+    if (options.atlas())
+      tp.join();
     current_queue = queue;
-    --init;
+    {
+      std::lock_guard<std::mutex> lock(init_lock);
+      if (--init == 0)
+        initialized.notify_all();
+    }
 
-    executor::work_loop();
+    executor::work_loop(worker);
   }
 
   void
@@ -449,16 +1012,18 @@ public:
   concurrent(dispatch_queue *queue, std::vector<int> cpu_set)
       : workers(std::make_unique<std::thread[]>(cpu_set.size())),
         thread_count(cpu_set.size()), init(thread_count) {
+    deadline_ordered = true;
+    parallel = true;
+    affinity_slack = options.affinity_slack();
     for (size_t i = 0; i < cpu_set.size(); ++i) {
       workers[i] =
-          std::thread(&concurrent::process_work, this, queue, cpu_set[i]);
+          std::thread(&concurrent::process_work, this, queue, i, cpu_set[i]);
     }
 
     /* wait until all threads are up, to avoid loosing a submit, when the thread
      * pool is still empty */
-    for (; init;) {
-      std::this_thread::yield();
-    }
+    std::unique_lock<std::mutex> lock(init_lock);
+    initialized.wait(lock, [this] { return init == 0; });
   }
   ~concurrent() override {
     shutdown();
@@ -471,6 +1036,210 @@ public:
   }
 };
 
+/* A serial queue running on the workers of another queue. Only its oldest
+ * work item is passed on at a time, so queues sharing workers cannot starve
+ * each other, and its work runs in order. */
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wweak-vtables"
+class serial_target final : public executor {
+#pragma clang diagnostic pop
+  std::shared_ptr<executor> target;
+  mutable std::mutex lock;
+  mutable std::condition_variable idle;
+  mutable std::condition_variable space;
+  mutable std::list<work_item> pending;
+  mutable bool busy = false;
+
+  void submit(const uint64_t, const std::chrono::nanoseconds,
+              const std::chrono::steady_clock::time_point) const override {}
+
+  /* must be called with lock held */
+  void forward(work_item work) const {
+    busy = true;
+    work.completion = [ this, completion = std::move(work.completion) ] {
+      if (completion)
+        completion();
+      next();
+    };
+    /* admitted by this queue already */
+    target->enqueue(std::move(work), admission::bypass);
+  }
+
+  void next() const {
+    std::lock_guard<std::mutex> l(lock);
+    if (pending.empty()) {
+      busy = false;
+      idle.notify_all();
+      space.notify_all();
+      return;
+    }
+
+    work_item work = std::move(pending.front());
+    pending.pop_front();
+    space.notify_one();
+    forward(std::move(work));
+  }
+
+public:
+  serial_target(std::string label, std::shared_ptr<executor> target_)
+      : executor(std::move(label)), target(std::move(target_)) {
+    serial = true;
+  }
+  ~serial_target() override {
+    std::unique_lock<std::mutex> l(lock);
+    idle.wait(l, [this] { return !busy; });
+  }
+
+  bool enqueue(work_item work, const admission mode) const override {
+    using overflow = dispatch_queue::overflow;
+    std::list<work_item> dropped;
+    bool queued = true;
+    {
+      std::unique_lock<std::mutex> l(lock);
+      if (busy && limits.max_queued > 0 && mode != admission::bypass &&
+          pending.size() >= limits.max_queued) {
+        switch ((mode == admission::reject) ? overflow::fail
+                                            : limits.overflow_policy) {
+        case overflow::block:
+          space.wait(l, [this] {
+            return !busy || limits.max_queued == 0 ||
+                   pending.size() < limits.max_queued;
+          });
+          break;
+        case overflow::fail:
+          return false;
+        case overflow::drop_earliest: {
+          /* pending work is not submitted yet, so it is simply removed */
+          auto victim = dropped_for(pending, work);
+          if (victim == pending.end()) {
+            dropped.push_back(std::move(work));
+            queued = false;
+          } else {
+            dropped.splice(dropped.end(), pending, victim);
+          }
+          break;
+        }
+        }
+      }
+      if (queued && busy)
+        pending.push_back(std::move(work));
+      else if (queued)
+        forward(std::move(work));
+    }
+    finish_dropped(dropped);
+    return true;
+  }
+
+  void limit(const size_t capacity,
+             const dispatch_queue::overflow policy) const override {
+    {
+      std::lock_guard<std::mutex> l(lock);
+      limits.max_queued = capacity;
+      limits.overflow_policy = policy;
+    }
+    space.notify_all();
+  }
+
+  size_t capacity() const override {
+    std::lock_guard<std::mutex> l(lock);
+    return limits.max_queued;
+  }
+
+  size_t occupancy() const override {
+    std::lock_guard<std::mutex> l(lock);
+    return pending.size();
+  }
+
+  std::chrono::nanoseconds backlog() const override {
+    return target->backlog();
+  }
+
+  /* A target running one item at a time may run work of other queues, so
+   * it is held as well. */
+  bool acquire() const override {
+    std::lock_guard<std::mutex> l(lock);
+    if (busy || (!target->is_parallel() && !target->acquire()))
+      return false;
+    busy = true;
+    return true;
+  }
+
+  void release() const override {
+    /* pending work is passed on first, so it runs before later work of
+     * other queues */
+    next();
+    if (!target->is_parallel())
+      target->release();
+  }
+};
+
+/* A parallel queue on the workers it shares with the parallel queues on the
+ * same CPUs. Its capacity and coalescing only apply to its own work. */
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wweak-vtables"
+class pooled final : public executor {
+#pragma clang diagnostic pop
+  std::shared_ptr<executor> pool;
+  std::shared_ptr<queue_limits> own = std::make_shared<queue_limits>();
+
+  void submit(const uint64_t, const std::chrono::nanoseconds,
+              const std::chrono::steady_clock::time_point) const override {}
+
+public:
+  pooled(std::string label, std::shared_ptr<executor> pool_)
+      : executor(std::move(label)), pool(std::move(pool_)) {
+    parallel = true;
+  }
+
+  /* the work may use state of the caller that ends with the queue */
+  ~pooled() override { pool->drain(*own); }
+
+  bool enqueue(work_item work, const admission mode) const override {
+    work.limits = own;
+    return pool->enqueue(std::move(work), mode);
+  }
+
+  void limit(const size_t capacity,
+             const dispatch_queue::overflow policy) const override {
+    pool->limit(*own, capacity, policy);
+  }
+
+  size_t capacity() const override { return pool->capacity(*own); }
+  size_t occupancy() const override { return pool->occupancy(*own); }
+
+  void coalesce(const std::chrono::nanoseconds window) const override {
+    pool->coalesce(*own, window);
+  }
+
+  std::chrono::nanoseconds backlog() const override { return pool->backlog(); }
+
+  std::map<uint64_t, dispatch_queue::type_locality> locality() const override {
+    return pool->locality();
+  }
+};
+
+/* Worker pools of concurrent queues. Queues on the same CPUs share one. */
+static std::shared_ptr<executor> shared_pool(std::vector<int> cpu_set) {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wexit-time-destructors"
+  static std::mutex lock;
+  static std::map<std::vector<int>, std::weak_ptr<executor>> pools;
+#pragma clang diagnostic pop
+
+  std::sort(std::begin(cpu_set), std::end(cpu_set));
+  cpu_set.erase(std::unique(std::begin(cpu_set), std::end(cpu_set)),
+                std::end(cpu_set));
+
+  std::lock_guard<std::mutex> l(lock);
+  auto &pool = pools[cpu_set];
+  auto workers = pool.lock();
+  if (!workers) {
+    workers = std::make_shared<concurrent>(nullptr, cpu_set);
+    pool = workers;
+  }
+  return workers;
+}
+
 dispatch_queue::impl::impl(dispatch_queue *queue)
     : worker(std::make_unique<main_queue_executor>(queue, "main-queue")) {}
 
@@ -486,9 +1255,13 @@ dispatch_queue::impl::impl(dispatch_queue *queue, std::string label)
 {
 }
 
-dispatch_queue::impl::impl(dispatch_queue *queue, std::string,
+dispatch_queue::impl::impl(dispatch_queue *, std::string label,
                            std::vector<int> cpu_set)
-    : worker(std::make_unique<concurrent>(queue, cpu_set)) {}
+    : worker(std::make_shared<pooled>(std::move(label),
+                                      shared_pool(std::move(cpu_set)))) {}
+
+dispatch_queue::impl::impl(std::string label, const impl &target)
+    : worker(std::make_shared<serial_target>(std::move(label), target.worker)) {}
 
 dispatch_queue::dispatch_queue(std::string label)
     : d_(std::make_unique<impl>(this, std::move(label))) {}
@@ -501,6 +1274,9 @@ dispatch_queue::dispatch_queue(std::string label, cpu_set_t *cpu_set)
     : d_(std::make_unique<impl>(this, std::move(label),
                                 cpu_set_to_vector(cpu_set))) {}
 
+dispatch_queue::dispatch_queue(std::string label, const dispatch_queue &target)
+    : d_(std::make_unique<impl>(std::move(label), *target.d_)) {}
+
 dispatch_queue::dispatch_queue(dispatch_queue &&) = default;
 dispatch_queue &dispatch_queue::operator=(dispatch_queue &&) = default;
 dispatch_queue::~dispatch_queue() = default;
@@ -515,7 +1291,8 @@ std::future<void> dispatch_queue::dispatch(std::function<void()> f,
                         0,
                         type,
                         std::packaged_task<void()>(std::move(f)),
-                        true};
+                        options.atlas()};
+  item.queue = this;
   auto future = item.work.get_future();
   d_->dispatch(std::move(item));
   return future;
@@ -535,11 +1312,199 @@ dispatch_queue::dispatch(const std::chrono::steady_clock::time_point deadline,
                         type,
                         std::packaged_task<void()>(std::move(block)),
                         options.atlas()};
+  item.queue = this;
   auto future = item.work.get_future();
   d_->dispatch(std::move(item));
   return future;
 }
 
+std::future<void> dispatch_queue::try_dispatch(
+    const std::chrono::steady_clock::time_point deadline,
+    const double *metrics, const size_t metrics_count, const uint64_t type,
+    std::function<void()> block) const {
+  using namespace std::literals::chrono_literals;
+  auto item = work_item{atlas::clock::now(),
+                        deadline,
+                        0us,
+                        metrics,
+                        metrics_count,
+                        type,
+                        std::packaged_task<void()>(std::move(block)),
+                        options.atlas()};
+  item.queue = this;
+  auto future = item.work.get_future();
+  if (!d_->enqueue(std::move(item), executor::admission::reject))
+    return {};
+  return future;
+}
+
+dispatch_queue::prediction
+dispatch_queue::estimate(const uint64_t type, const double *metrics,
+                         const size_t metrics_count) const {
+  prediction estimate;
+  estimate.backlog = this->estimate(type, metrics, metrics_count, 1,
+                                    &estimate.exectime);
+  return estimate;
+}
+
+std::chrono::nanoseconds
+dispatch_queue::estimate(const uint64_t type, const double *metrics,
+                         const size_t metrics_count, const size_t candidates,
+                         std::chrono::nanoseconds *exectimes) const {
+  application_estimator.estimate(type, metrics, metrics_count, candidates,
+                                 exectimes);
+  return d_->worker->backlog();
+}
+
+void dispatch_queue::dispatch_sync(
+    const std::chrono::steady_clock::time_point deadline,
+    const double *metrics, const size_t metrics_count, const uint64_t type,
+    std::function<void()> block) const {
+  /* Best-effort work can run on any thread. Real-time work needs a
+   * reservation, which the caller only has while running a real-time job
+   * itself, whose reservation is then extended by the block. */
+  const bool realtime = options.atlas();
+  if (!options.inline_sync() || (realtime && !reserved) ||
+      !d_->worker->acquire()) {
+    dispatch(deadline, metrics, metrics_count, type, std::move(block)).get();
+    return;
+  }
+
+  struct holder {
+    const dispatch_queue *queue;
+    const dispatch_queue *previous = current_queue;
+    /* work run in place is charged to the queue's budget as it ran */
+    const bool charged = queue->d_->budget->active();
+    const cputime_clock::time_point start =
+        charged ? cputime_clock::now() : cputime_clock::time_point{};
+    holder(const dispatch_queue *queue_) : queue(queue_) {
+      current_queue = queue;
+    }
+    ~holder() {
+      if (charged)
+        queue->d_->budget->charge(cputime_clock::now() - start,
+                                  std::chrono::nanoseconds{0});
+      current_queue = previous;
+      queue->d_->worker->release();
+    }
+  } hold(this);
+
+  if (!realtime) {
+    block();
+    return;
+  }
+
+  using namespace std::chrono;
+  const uint64_t id = reinterpret_cast<uint64_t>(&hold);
+  const auto prediction =
+      application_estimator.predict(type, id, metrics, metrics_count);
+  /* coalesced jobs share a reservation, which is not extended */
+  if (auto job = current_job) {
+    const auto elapsed = cputime_clock::now().time_since_epoch() - job->start;
+    job->owner->reserve(
+        *job->work,
+        std::max<nanoseconds>(job->work->prediction, elapsed) + prediction);
+  }
+  const auto start = cputime_clock::now();
+  const auto train = [&] {
+    application_estimator.train(
+        type, id, duration_cast<microseconds>(cputime_clock::now() - start));
+  };
+  try {
+    block();
+  } catch (...) {
+    train();
+    throw;
+  }
+  train();
+}
+
+std::future<size_t>
+dispatch_queue::dispatch(const std::chrono::steady_clock::time_point deadline,
+                         const double *metrics, const size_t metrics_count,
+                         const uint64_t type, std::function<void()> mandatory,
+                         std::vector<refinement> optional) const {
+  using namespace std::literals::chrono_literals;
+  auto item = work_item{atlas::clock::now(),
+                        deadline,
+                        0us,
+                        metrics,
+                        metrics_count,
+                        type,
+                        std::packaged_task<void()>(std::move(mandatory)),
+                        options.atlas(),
+                        false,
+                        std::move(optional),
+                        std::make_shared<std::promise<size_t>>()};
+  item.queue = this;
+  auto future = item.refined->get_future();
+  d_->dispatch(std::move(item));
+  return future;
+}
+
+void dispatch_queue::limit(const size_t capacity,
+                           const overflow policy) {
+  d_->worker->limit(capacity, policy);
+}
+
+size_t dispatch_queue::capacity() const { return d_->worker->capacity(); }
+void dispatch_queue::budget(const std::chrono::nanoseconds budget_,
+                            const std::chrono::nanoseconds period) {
+  d_->budget->configure(budget_, period);
+}
+
+dispatch_queue::budget_usage dispatch_queue::usage() const {
+  return d_->budget->usage();
+}
+
+void dispatch_queue::coalesce(const std::chrono::nanoseconds window) {
+  d_->worker->coalesce(window);
+}
+size_t dispatch_queue::occupancy() const { return d_->worker->occupancy(); }
+
+std::map<uint64_t, dispatch_queue::type_locality>
+dispatch_queue::locality() const {
+  return d_->worker->locality();
+}
+
+/* The n-th phase of a job type is predicted as a type of its own. */
+static uint64_t phase_type(const uint64_t type, const uint64_t phase) {
+  return type ^ (phase * UINT64_C(0x9e3779b97f4a7c15));
+}
+
+std::chrono::nanoseconds dispatch_queue::report(const double *metrics,
+                                                const size_t metrics_count) {
+  using namespace std::chrono;
+  auto job = current_job;
+  if (job == nullptr)
+    return nanoseconds{0};
+
+  const auto now = cputime_clock::now().time_since_epoch();
+  const auto type = phase_type(job->work->type, job->phases.size() + 1);
+  const auto rest = application_estimator.predict(
+      type, reinterpret_cast<uint64_t>(job->work), metrics, metrics_count);
+  job->phases.emplace_back(type, now);
+  job->owner->reserve(*job->work, now - job->start + rest);
+  return rest;
+}
+
+std::chrono::nanoseconds dispatch_queue::report(const double progress) {
+  using namespace std::chrono;
+  if (!(progress > 0.0 && progress <= 1.0))
+    throw std::runtime_error("Progress must be in (0, 1].");
+  auto job = current_job;
+  if (job == nullptr)
+    return nanoseconds{0};
+
+  const auto elapsed = cputime_clock::now().time_since_epoch() - job->start;
+  const auto rest = duration_cast<nanoseconds>(elapsed * (1.0 - progress) /
+                                               progress);
+  job->owner->reserve(*job->work, elapsed + rest);
+  return rest;
+}
+
+const dispatch_queue *dispatch_queue::current() { return current_queue; }
+
 static main_queue main_queue_;
 dispatch_queue &dispatch_queue::dispatch_get_main_queue() { return main_queue_; }
 void dispatch_queue::dispatch_main() { main_queue_.dispatch(); }
@@ -1,13 +1,17 @@
 #pragma once
 
 #ifdef __cplusplus
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <functional>
 #include <future>
 #include <mutex>
 #include <memory>
 #include <typeindex>
+#include <vector>
 #include <initializer_list>
+#include <map>
 #include <ctime>
 #include <tuple>
 #include <type_traits>
@@ -61,8 +65,66 @@ uint64_t work_type(Ret (^f)(Args...)) {
   return type;
 }
 #endif
+
+template <typename... T> constexpr bool all_arithmetic() {
+  bool result = true;
+  for (const bool arithmetic : {true, std::is_arithmetic<T>::value...})
+    result = result && arithmetic;
+  return result;
+}
 }
 
+/* A class of jobs with an explicit type id and a fixed metric schema.
+ *
+ * Tag names the class and provides its id, which stays the same across
+ * builds and processes, unlike the ids inferred from the work itself:
+ *
+ *   struct decode { static constexpr uint64_t id = 0x6465636f6465; };
+ *   using decode_job = atlas::job_class<decode, size_t, int>;
+ *   queue.async(deadline, decode_job{bytes, frames}, decode_frame, buffer);
+ *
+ * The metrics are held by value, so their count is checked at compile time
+ * and the estimator always uses the solver of that count for the class.
+ */
+template <typename Tag, typename... Metrics> class job_class {
+  static_assert(_::all_arithmetic<Metrics...>(), "Metrics must be numbers.");
+
+  std::array<double, sizeof...(Metrics)> values;
+
+public:
+  static constexpr uint64_t type = Tag::id;
+  static constexpr size_t count = sizeof...(Metrics);
+
+  job_class(const Metrics... metrics)
+      : values{{static_cast<double>(metrics)...}} {}
+
+  const double *metrics() const { return values.data(); }
+};
+
+template <typename Tag, typename... Metrics>
+constexpr uint64_t job_class<Tag, Metrics...>::type;
+template <typename Tag, typename... Metrics>
+constexpr size_t job_class<Tag, Metrics...>::count;
+
+/* An optional part of an imprecise job, with its own type and metrics. See
+ * dispatch_queue::imprecise(). */
+struct refinement {
+  uint64_t type;
+  std::vector<double> metrics;
+  std::function<void()> work;
+
+  template <typename Func, typename = std::result_of_t<Func()>>
+  refinement(const double *metrics_, const size_t metrics_count, Func &&f)
+      : type(_::work_type(f)), metrics(metrics_, metrics_ + metrics_count),
+        work(std::forward<Func>(f)) {}
+
+  template <typename Tag, typename... Metrics, typename Func,
+            typename = std::result_of_t<Func()>>
+  refinement(const job_class<Tag, Metrics...> &job, Func &&f)
+      : type(job.type), metrics(job.metrics(), job.metrics() + job.count),
+        work(std::forward<Func>(f)) {}
+};
+
 class dispatch_queue {
 protected:
   struct impl;
@@ -72,17 +134,64 @@ protected:
                              const double *, const size_t, const uint64_t,
                              std::function<void()>) const;
   std::future<void> dispatch(std::function<void()>, const uint64_t) const;
+  std::future<size_t> dispatch(const clock::time_point, const double *,
+                               const size_t, const uint64_t,
+                               std::function<void()>,
+                               std::vector<refinement>) const;
+  /* Returns an invalid future instead of queueing beyond the capacity. */
+  std::future<void> try_dispatch(const clock::time_point, const double *,
+                                 const size_t, const uint64_t,
+                                 std::function<void()>) const;
+  /* Runs the block on the calling thread if the queue is serial and idle,
+   * otherwise dispatches it and waits. */
+  void dispatch_sync(const clock::time_point, const double *, const size_t,
+                     const uint64_t, std::function<void()>) const;
 
 public:
   struct attr {
     size_t num_threads;
   };
 
+  /* Jobs of a type run by the queue's workers, and how many of them ran on
+   * the worker that ran the type's previous job. */
+  struct type_locality {
+    uint64_t jobs;
+    uint64_t hits;
+  };
+
+  /* What async() does when the queue holds as much work as its capacity:
+   *  - block: wait until a worker takes work from the queue
+   *  - fail: throw std::runtime_error
+   *  - drop_earliest: drop the job due first, which may be the new one; its
+   *    future reports std::future_errc::broken_promise */
+  enum class overflow { block, fail, drop_earliest };
+
+  /* Bandwidth budget of a queue and its use in the current period. */
+  struct budget_usage {
+    std::chrono::nanoseconds budget;
+    std::chrono::nanoseconds period;
+    std::chrono::nanoseconds used;
+    /* jobs admitted within the budget and demoted to best-effort */
+    uint64_t admitted;
+    uint64_t demoted;
+  };
+
+  /* Prediction for a job that is not submitted. */
+  struct prediction {
+    /* padded execution time, as reserved for the job */
+    std::chrono::nanoseconds exectime;
+    /* reservations of the real-time jobs queued or running on this queue */
+    std::chrono::nanoseconds backlog;
+  };
+
   /* serial queue */
   dispatch_queue(std::string label);
-  /* parallel queue */
+  /* parallel queue; parallel queues on the same CPUs share their workers */
   dispatch_queue(std::string label, std::initializer_list<int> cpu_set);
   dispatch_queue(std::string label, cpu_set_t *cpu_set);
+  /* serial queue running its work in order on the workers of target, e.g. a
+   * parallel queue; creating it starts no threads */
+  dispatch_queue(std::string label, const dispatch_queue &target);
   dispatch_queue(dispatch_queue &&);
   dispatch_queue &operator=(dispatch_queue &&);
   ~dispatch_queue();
@@ -115,12 +224,142 @@ public:
 
   template <typename Func, typename... Args,
             typename = std::result_of_t<Func(Args...)>>
-  decltype(auto) sync(const clock::time_point deadline, const double *metrics,
-                      const size_t metrics_count, Func &&block,
+  void sync(const clock::time_point deadline, const double *metrics,
+            const size_t metrics_count, Func &&block, Args &&... args) {
+    const uint64_t type = _::work_type(block);
+    dispatch_sync(deadline, metrics, metrics_count, type, [
+      f_ = std::forward<Func>(block),
+      args_ = std::make_tuple(std::forward<Args>(args)...)
+    ]() mutable { std::experimental::apply(std::move(f_), std::move(args_)); });
+  }
+
+  /* Job class overloads */
+  template <typename Tag, typename... Metrics, typename Func, typename... Args,
+            typename = std::result_of_t<Func(Args...)>>
+  decltype(auto) async(const clock::time_point deadline,
+                       const job_class<Tag, Metrics...> &job, Func &&block,
+                       Args &&... args) {
+    return dispatch(deadline, job.metrics(), job.count, job.type, [
+      f_ = std::forward<Func>(block),
+      args_ = std::make_tuple(std::forward<Args>(args)...)
+    ]() mutable { std::experimental::apply(std::move(f_), std::move(args_)); });
+  }
+
+  template <typename Tag, typename... Metrics, typename Func, typename... Args,
+            typename = std::result_of_t<Func(Args...)>>
+  void sync(const clock::time_point deadline,
+            const job_class<Tag, Metrics...> &job, Func &&block,
+            Args &&... args) {
+    dispatch_sync(deadline, job.metrics(), job.count, job.type, [
+      f_ = std::forward<Func>(block),
+      args_ = std::make_tuple(std::forward<Args>(args)...)
+    ]() mutable { std::experimental::apply(std::move(f_), std::move(args_)); });
+  }
+
+  template <typename Rep, typename Period, typename Tag, typename... Metrics,
+            typename Func, typename... Args,
+            typename = std::result_of_t<Func(Args...)>>
+  decltype(auto) async(const std::chrono::duration<Rep, Period> deadline,
+                       const job_class<Tag, Metrics...> &job, Func &&block,
+                       Args &&... args) {
+    return async(clock::now() + deadline, job, std::forward<Func>(block),
+                 std::forward<Args>(args)...);
+  }
+
+  template <typename Rep, typename Period, typename Tag, typename... Metrics,
+            typename Func, typename... Args,
+            typename = std::result_of_t<Func(Args...)>>
+  decltype(auto) sync(const std::chrono::duration<Rep, Period> deadline,
+                      const job_class<Tag, Metrics...> &job, Func &&block,
                       Args &&... args) {
-    return async(deadline, metrics, metrics_count, std::forward<Func>(block),
-                 std::forward<Args>(args)...)
-        .get();
+    return sync(clock::now() + deadline, job, std::forward<Func>(block),
+                std::forward<Args>(args)...);
+  }
+
+  /* Imprecise jobs. The mandatory block is reserved when it is submitted.
+   * After it ran, the optional parts run in order, as long as the predicted
+   * slack before the deadline covers the next one and the reservations
+   * queued on the queue. A real-time job's reservation is extended by each
+   * part before it runs. The future holds the number of optional parts that
+   * ran. */
+  template <typename Func, typename = std::result_of_t<Func()>>
+  std::future<size_t> imprecise(const clock::time_point deadline,
+                                const double *metrics,
+                                const size_t metrics_count, Func &&mandatory,
+                                std::vector<refinement> optional) {
+    const uint64_t type = _::work_type(mandatory);
+    return dispatch(deadline, metrics, metrics_count, type,
+                    std::forward<Func>(mandatory), std::move(optional));
+  }
+
+  template <typename Tag, typename... Metrics, typename Func,
+            typename = std::result_of_t<Func()>>
+  std::future<size_t> imprecise(const clock::time_point deadline,
+                                const job_class<Tag, Metrics...> &job,
+                                Func &&mandatory,
+                                std::vector<refinement> optional) {
+    return dispatch(deadline, job.metrics(), job.count, job.type,
+                    std::forward<Func>(mandatory), std::move(optional));
+  }
+
+  template <typename Rep, typename Period, typename Func,
+            typename = std::result_of_t<Func()>>
+  std::future<size_t> imprecise(const std::chrono::duration<Rep, Period> deadline,
+                                const double *metrics,
+                                const size_t metrics_count, Func &&mandatory,
+                                std::vector<refinement> optional) {
+    return imprecise(clock::now() + deadline, metrics, metrics_count,
+                     std::forward<Func>(mandatory), std::move(optional));
+  }
+
+  template <typename Rep, typename Period, typename Tag, typename... Metrics,
+            typename Func, typename = std::result_of_t<Func()>>
+  std::future<size_t> imprecise(const std::chrono::duration<Rep, Period> deadline,
+                                const job_class<Tag, Metrics...> &job,
+                                Func &&mandatory,
+                                std::vector<refinement> optional) {
+    return imprecise(clock::now() + deadline, job,
+                     std::forward<Func>(mandatory), std::move(optional));
+  }
+
+  /* Like async(), but returns an invalid future without waiting or dropping
+   * work if the queue is at its capacity. */
+  template <typename Func, typename... Args,
+            typename = std::result_of_t<Func(Args...)>>
+  std::future<void> try_async(const clock::time_point deadline,
+                              const double *metrics,
+                              const size_t metrics_count, Func &&block,
+                              Args &&... args) {
+    const uint64_t type = _::work_type(block);
+    return try_dispatch(deadline, metrics, metrics_count, type, [
+      f_ = std::forward<Func>(block),
+      args_ = std::make_tuple(std::forward<Args>(args)...)
+    ]() mutable { std::experimental::apply(std::move(f_), std::move(args_)); });
+  }
+
+  template <typename Tag, typename... Metrics, typename Func, typename... Args,
+            typename = std::result_of_t<Func(Args...)>>
+  std::future<void> try_async(const clock::time_point deadline,
+                              const job_class<Tag, Metrics...> &job,
+                              Func &&block, Args &&... args) {
+    return try_dispatch(deadline, job.metrics(), job.count, job.type, [
+      f_ = std::forward<Func>(block),
+      args_ = std::make_tuple(std::forward<Args>(args)...)
+    ]() mutable { std::experimental::apply(std::move(f_), std::move(args_)); });
+  }
+
+  template <typename Func, typename... Args,
+            typename = std::result_of_t<Func(Args...)>>
+  std::future<void> try_async(const clock::time_point deadline, Func &&block,
+                              Args &&... args) {
+    return try_async(deadline, static_cast<const double *>(nullptr), size_t(0),
+                     std::forward<Func>(block), std::forward<Args>(args)...);
+  }
+
+  template <typename Rep, typename Period, typename... Args>
+  std::future<void> try_async(const std::chrono::duration<Rep, Period> deadline,
+                              Args &&... args) {
+    return try_async(clock::now() + deadline, std::forward<Args>(args)...);
   }
 
   /* No metrics overloads */
@@ -193,8 +432,12 @@ public:
 
   template <typename Func, typename... Args,
             typename = std::result_of_t<Func(Args...)>>
-  auto sync(Func &&f, Args &&... args) {
-    return async(std::forward<Func>(f), std::forward<Args>(args)...).get();
+  void sync(Func &&f, Args &&... args) {
+    const uint64_t type = _::work_type(f);
+    dispatch_sync(clock::now(), nullptr, 0, type, [
+      f_ = std::forward<Func>(f),
+      args_ = std::make_tuple(std::forward<Args>(args)...)
+    ]() mutable { std::experimental::apply(std::move(f_), std::move(args_)); });
   }
 
 #ifdef __BLOCKS__
@@ -258,6 +501,87 @@ public:
   }
 #endif
 
+  /* Predicts a job of the given type and metrics without enqueueing it, e.g.
+   * to choose the work to submit. Types that were not submitted yet are
+   * predicted as 0. */
+  prediction estimate(const uint64_t type, const double *metrics,
+                      const size_t metrics_count) const;
+  /* Predicts candidates jobs of metrics_count metrics each, stored one after
+   * another, into exectimes and returns the backlog. */
+  std::chrono::nanoseconds estimate(const uint64_t type, const double *metrics,
+                                    const size_t metrics_count,
+                                    const size_t candidates,
+                                    std::chrono::nanoseconds *exectimes) const;
+
+  template <typename Tag, typename... Metrics>
+  prediction estimate(const job_class<Tag, Metrics...> &job) const {
+    return estimate(job.type, job.metrics(), job.count);
+  }
+
+  template <typename Tag, typename... Metrics, size_t N>
+  std::chrono::nanoseconds
+  estimate(const std::array<job_class<Tag, Metrics...>, N> &jobs,
+           std::array<std::chrono::nanoseconds, N> &exectimes) const {
+    using job = job_class<Tag, Metrics...>;
+    std::array<double, N * job::count> metrics;
+    for (size_t i = 0; i < N; ++i)
+      std::copy_n(jobs[i].metrics(), job::count,
+                  metrics.begin() + i * job::count);
+    return estimate(job::type, metrics.data(), job::count, N,
+                    exectimes.data());
+  }
+
+  /* Bounds the work queued and not running yet to capacity jobs, or removes
+   * the bound if capacity is 0. The policy selects what async() does beyond
+   * it; with overflow::block, the queue's own work must not submit to it. */
+  void limit(const size_t capacity, const overflow policy = overflow::block);
+  size_t capacity() const;
+  /* Jobs queued and not running yet. */
+  size_t occupancy() const;
+
+  /* Reserves a bandwidth of budget execution time every period for the
+   * queue, to isolate it from other queues on the same CPUs. Jobs beyond it
+   * are demoted to best-effort: they are not reserved and run after the
+   * other best-effort work of shared workers. A budget of 0 removes it. */
+  void budget(const std::chrono::nanoseconds budget,
+              const std::chrono::nanoseconds period);
+  budget_usage usage() const;
+
+  /* Coalesces jobs of the same type with deadlines at most window apart
+   * into one work item, with the earliest of their deadlines and the sum of
+   * their predicted execution times as its reservation. The jobs run back to
+   * back on one worker and are still trained one by one. This saves the
+   * per-job overhead of very short jobs. A negative window turns it off,
+   * the default. Best-effort jobs of a serial queue run in order, so they
+   * only join the job queued last. Real-time jobs are only coalesced on serial queues, whose
+   * reservations can be extended; serial queues on a target do not
+   * coalesce. */
+  void coalesce(const std::chrono::nanoseconds window);
+
+  /* Locality of the job types run by a parallel queue's workers, which are
+   * shared by all parallel queues on the same CPUs. */
+  std::map<uint64_t, type_locality> locality() const;
+
+  /* Context of the real-time job running on the calling thread, for jobs
+   * that learn their cost while they run, e.g. after parsing their input.
+   * Both reports adjust the job's reservation and return the time predicted
+   * for the rest of the job, or 0 if the thread does not run a real-time job
+   * with a reservation of its own, i.e. one that was not coalesced.
+   *
+   * Reports metrics describing the rest of the job. The rest is predicted
+   * as a phase of the job's type: the n-th report of a job is predicted from
+   * the n-th reports of earlier jobs of its type, which must have the same
+   * number of metrics, and trains on the time from the report to the end of
+   * the job. The kernel only updates the reservations of serial queues; on
+   * parallel queues, the backlog follows the report. */
+  static std::chrono::nanoseconds report(const double *metrics,
+                                         const size_t metrics_count);
+  /* Reports the fraction of the job done so far, 0 < progress <= 1. The
+   * rest is extrapolated from the time taken so far. */
+  static std::chrono::nanoseconds report(const double progress);
+  /* The queue whose work runs on the calling thread. */
+  static const dispatch_queue *current();
+
   static dispatch_queue &dispatch_get_main_queue();
   static void dispatch_main();
   static void dispatch_main_quit();
@@ -94,7 +94,7 @@ public:
   gcd_worker(const std::string &);
   ~gcd_worker() override;
 
-  void enqueue(work_item work) const override;
+  bool enqueue(work_item work, admission) const override;
   void submit(const uint64_t, const std::chrono::nanoseconds,
               const std::chrono::steady_clock::time_point) const override {}
 };
@@ -108,13 +108,17 @@ gcd_worker::~gcd_worker() {
   gcd.dispatch_release(gcd_queue);
 }
 
-void gcd_worker::enqueue(work_item work) const {
+/* libdispatch queues are not bounded */
+bool gcd_worker::enqueue(work_item work, admission) const {
   /* This is a debug aid only, so let's be disgustingly inefficient. */
-  auto *task = new std::packaged_task<void()>(std::move(work.work));
+  auto *item = new work_item(std::move(work));
   gcd.dispatch_async(gcd_queue, ^{
-    (*task)();
-    delete task;
+    item->work();
+    refine(*item, std::chrono::nanoseconds{0});
+    complete(*item);
+    delete item;
   });
+  return true;
 }
 
 std::unique_ptr<executor> make_gcd_queue(const std::string &label) {
@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "runtime/dispatch.h"
+
+/* Soak tests of bounded queues: the producer submits jobs ten times faster
+ * than the queue runs them. Run with ATLAS_BACKEND=NONE without kernel
+ * support. */
+
+using namespace std::chrono;
+using overflow = atlas::dispatch_queue::overflow;
+
+static constexpr size_t capacity = 16;
+static constexpr size_t jobs = 2000;
+static constexpr auto consume = 100us;
+static constexpr auto produce = consume / 10;
+
+static void spin(const nanoseconds duration) {
+  const auto end = steady_clock::now() + duration;
+  while (steady_clock::now() < end)
+    ;
+}
+
+/* Submits the jobs with submit, which returns their futures, and returns
+ * the largest occupancy seen. */
+template <typename Submit>
+static size_t soak(atlas::dispatch_queue &queue,
+                   std::vector<std::future<void>> &futures, Submit &&submit) {
+  size_t occupancy = 0;
+  futures.reserve(jobs);
+  for (size_t job = 0; job < jobs; ++job) {
+    futures.push_back(submit(job));
+    occupancy = std::max(occupancy, queue.occupancy());
+    spin(produce);
+  }
+  return occupancy;
+}
+
+/* Counts the jobs that ran and those dropped. */
+static std::pair<size_t, size_t>
+outcome(std::vector<std::future<void>> &futures) {
+  size_t ran = 0, dropped = 0;
+  for (auto &&future : futures) {
+    if (!future.valid())
+      continue;
+    try {
+      future.get();
+      ++ran;
+    } catch (const std::future_error &e) {
+      EXPECT_EQ(e.code(), std::future_errc::broken_promise);
+      ++dropped;
+    }
+  }
+  return {ran, dropped};
+}
+
+TEST(BackpressureTest, Unbounded) {
+  atlas::dispatch_queue queue("unbounded");
+  EXPECT_EQ(queue.capacity(), 0u);
+  std::vector<std::future<void>> futures;
+  const auto occupancy = soak(queue, futures, [&queue](size_t) {
+    return queue.async(1s, [] { spin(consume); });
+  });
+  EXPECT_GT(occupancy, capacity);
+  EXPECT_EQ(outcome(futures).first, jobs);
+}
+
+TEST(BackpressureTest, BlockThrottlesProducer) {
+  atlas::dispatch_queue queue("block");
+  queue.limit(capacity, overflow::block);
+  EXPECT_EQ(queue.capacity(), capacity);
+  std::vector<std::future<void>> futures;
+  const auto start = steady_clock::now();
+  const auto occupancy = soak(queue, futures, [&queue](size_t) {
+    return queue.async(1s, [] { spin(consume); });
+  });
+  /* the producer was held back to the pace of the queue */
+  EXPECT_GE(steady_clock::now() - start, (jobs - capacity - 1) * consume);
+  EXPECT_LE(occupancy, capacity);
+  EXPECT_EQ(outcome(futures).first, jobs);
+  EXPECT_EQ(queue.occupancy(), 0u);
+}
+
+TEST(BackpressureTest, TryAsyncFailsFast) {
+  atlas::dispatch_queue queue("fail");
+  queue.limit(capacity, overflow::fail);
+  std::vector<std::future<void>> futures;
+  const auto occupancy = soak(queue, futures, [&queue](size_t) {
+    return queue.try_async(1s, [] { spin(consume); });
+  });
+  EXPECT_LE(occupancy, capacity);
+
+  const auto rejected = static_cast<size_t>(
+      std::count_if(futures.begin(), futures.end(),
+                    [](const auto &future) { return !future.valid(); }));
+  EXPECT_GT(rejected, jobs / 2);
+  EXPECT_EQ(outcome(futures).first, jobs - rejected);
+}
+
+TEST(BackpressureTest, AsyncThrowsWhenFull) {
+  atlas::dispatch_queue queue("throw");
+  queue.limit(capacity, overflow::fail);
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  std::vector<std::future<void>> futures;
+  futures.push_back(queue.async(1s, [open] { open.wait(); }));
+  while (queue.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  for (size_t job = 0; job < capacity; ++job)
+    futures.push_back(queue.async(1s, [] {}));
+  EXPECT_THROW(queue.async(1s, [] {}), std::runtime_error);
+  EXPECT_FALSE(queue.try_async(1s, [] {}).valid());
+
+  gate.set_value();
+  EXPECT_EQ(outcome(futures).first, capacity + 1);
+}
+
+TEST(BackpressureTest, RejectedWorkIsNotCharged) {
+  atlas::dispatch_queue queue("budgeted");
+  queue.budget(1s, 10s);
+  queue.limit(capacity, overflow::fail);
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  std::vector<std::future<void>> futures;
+  futures.push_back(queue.async(1s, [open] { open.wait(); }));
+  while (queue.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  for (size_t job = 0; job < capacity; ++job)
+    futures.push_back(queue.async(1s, [] {}));
+  const auto full = queue.usage();
+  EXPECT_EQ(full.admitted, capacity + 1);
+  EXPECT_THROW(queue.async(1s, [] {}), std::runtime_error);
+  EXPECT_FALSE(queue.try_async(1s, [] {}).valid());
+  const auto rejected = queue.usage();
+  EXPECT_EQ(rejected.used, full.used);
+  EXPECT_EQ(rejected.admitted, full.admitted);
+  EXPECT_EQ(rejected.demoted, full.demoted);
+
+  gate.set_value();
+  EXPECT_EQ(outcome(futures).first, capacity + 1);
+}
+
+TEST(BackpressureTest, DropEarliest) {
+  atlas::dispatch_queue queue("drop");
+  queue.limit(capacity, overflow::drop_earliest);
+  std::vector<std::future<void>> futures;
+  const auto start = steady_clock::now();
+  const auto occupancy = soak(queue, futures, [&queue, start](size_t job) {
+    return queue.async(start + 1s + job * 1us, [] { spin(consume); });
+  });
+  EXPECT_LE(occupancy, capacity);
+
+  /* the latest job is kept */
+  EXPECT_NO_THROW(futures.back().get());
+  futures.pop_back();
+  const auto result = outcome(futures);
+  EXPECT_EQ(result.first + result.second + 1, jobs);
+  EXPECT_GT(result.second, jobs / 2);
+}
+
+TEST(BackpressureTest, DropsIncomingJobDueFirst) {
+  atlas::dispatch_queue queue("drop-incoming");
+  queue.limit(1, overflow::drop_earliest);
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  auto running = queue.async(1s, [open] { open.wait(); });
+  while (queue.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  auto late = queue.async(2s, [] {});
+  auto early = queue.async(1s, [] {});
+  EXPECT_EQ(queue.occupancy(), 1u);
+  gate.set_value();
+  EXPECT_THROW(early.get(), std::future_error);
+  EXPECT_NO_THROW(late.get());
+  running.get();
+}
+
+TEST(BackpressureTest, TargetQueue) {
+  atlas::dispatch_queue pool("pool", {0});
+  atlas::dispatch_queue queue("serial", pool);
+  queue.limit(capacity, overflow::block);
+  std::vector<std::future<void>> futures;
+  const auto occupancy = soak(queue, futures, [&queue](size_t) {
+    return queue.async(1s, [] { spin(consume); });
+  });
+  EXPECT_LE(occupancy, capacity);
+  EXPECT_EQ(outcome(futures).first, jobs);
+}
+
+TEST(BackpressureTest, SharedWorkersLimitEachQueue) {
+  /* both queues share the worker of CPU 0 */
+  atlas::dispatch_queue limited("limited", {0});
+  atlas::dispatch_queue other("other", {0});
+  limited.limit(1, overflow::fail);
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  std::vector<std::future<void>> futures;
+  futures.push_back(other.async(1s, [open] { open.wait(); }));
+  while (other.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  const atlas::dispatch_queue *current = nullptr;
+  futures.push_back(limited.async(
+      1s, [&current] { current = atlas::dispatch_queue::current(); }));
+  EXPECT_FALSE(limited.try_async(1s, [] {}).valid());
+  for (size_t job = 0; job < capacity; ++job)
+    futures.push_back(other.async(1s, [] {}));
+  EXPECT_EQ(limited.occupancy(), 1u);
+  EXPECT_EQ(other.occupancy(), capacity);
+  EXPECT_EQ(other.capacity(), 0u);
+
+  gate.set_value();
+  EXPECT_EQ(outcome(futures).first, capacity + 2);
+  EXPECT_EQ(current, &limited);
+}
+
+TEST(BackpressureTest, DestroyingSharedQueueWaitsForItsWork) {
+  atlas::dispatch_queue other("other", {0});
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  auto blocker = other.async(1s, [open] { open.wait(); });
+  while (other.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  std::atomic<size_t> ran{0};
+  std::thread opener;
+  {
+    atlas::dispatch_queue queue("destroyed", {0});
+    for (size_t job = 0; job < 5; ++job)
+      queue.async(1s, [&ran] { ++ran; });
+    opener = std::thread([&gate] {
+      std::this_thread::sleep_for(10ms);
+      gate.set_value();
+    });
+  }
+  EXPECT_EQ(ran, 5u);
+  opener.join();
+  blocker.get();
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,123 @@
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include "gtest/gtest.h"
+#include "runtime/dispatch.h"
+
+/* Tests of queue bandwidth budgets. Run with ATLAS_BACKEND=NONE without
+ * kernel support. */
+
+using namespace std::chrono;
+
+/* Budgets are charged in CPU time, which is less than the wall-clock time
+ * if the thread is preempted. */
+static nanoseconds cputime() {
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return seconds{now.tv_sec} + nanoseconds{now.tv_nsec};
+}
+
+static void spin(const nanoseconds duration) {
+  const auto end = cputime() + duration;
+  while (cputime() < end)
+    ;
+}
+
+TEST(BandwidthTest, Unbudgeted) {
+  atlas::dispatch_queue queue("unbudgeted");
+  queue.async(1s, [] { spin(1ms); }).get();
+  const auto usage = queue.usage();
+  EXPECT_EQ(usage.budget, 0ns);
+  EXPECT_EQ(usage.admitted, 0u);
+  EXPECT_EQ(usage.demoted, 0u);
+}
+
+TEST(BandwidthTest, RejectsBudgetBeyondPeriod) {
+  atlas::dispatch_queue queue("invalid");
+  EXPECT_THROW(queue.budget(2ms, 1ms), std::runtime_error);
+}
+
+TEST(BandwidthTest, DemotesOverBudget) {
+  atlas::dispatch_queue queue("tenant");
+  queue.budget(5ms, 10s);
+  std::vector<std::future<void>> jobs;
+  for (int job = 0; job < 20; ++job)
+    jobs.push_back(queue.async(1s, [] { spin(1ms); }));
+  for (auto &&job : jobs)
+    job.get();
+
+  const auto usage = queue.usage();
+  EXPECT_EQ(usage.budget, 5ms);
+  EXPECT_EQ(usage.period, 10s);
+  EXPECT_EQ(usage.admitted + usage.demoted, 20u);
+  EXPECT_GT(usage.demoted, 0u);
+  /* jobs are only demoted once the budget is used up */
+  EXPECT_GE(usage.used, 5ms);
+}
+
+TEST(BandwidthTest, Replenishes) {
+  atlas::dispatch_queue queue("periodic");
+  queue.budget(2ms, 100ms);
+  queue.async(1s, [] { spin(3ms); }).get();
+  /* the worker charges the job after its future is ready */
+  while (queue.usage().used < 2ms)
+    std::this_thread::sleep_for(100us);
+  queue.async(1s, [] {}).get();
+  EXPECT_EQ(queue.usage().demoted, 1u);
+
+  std::this_thread::sleep_for(100ms);
+  EXPECT_EQ(queue.usage().used, 0ns);
+  queue.async(1s, [] {}).get();
+  EXPECT_EQ(queue.usage().demoted, 1u);
+}
+
+TEST(BandwidthTest, IsolatesTenants) {
+  /* both queues share the worker of CPU 0 */
+  atlas::dispatch_queue greedy("greedy", {0});
+  atlas::dispatch_queue victim("victim", {0});
+  greedy.budget(2ms, 10s);
+
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  auto blocker = victim.async(1s, [open] { open.wait(); });
+  while (victim.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  std::mutex lock;
+  std::vector<char> order;
+  const auto log = [&lock, &order](const char tenant) {
+    std::lock_guard<std::mutex> l(lock);
+    order.push_back(tenant);
+  };
+  std::vector<std::future<void>> jobs;
+  /* the greedy tenant's jobs are due first, but beyond its budget */
+  for (int job = 0; job < 10; ++job)
+    jobs.push_back(greedy.async(100ms, [&log] {
+      spin(1ms);
+      log('g');
+    }));
+  for (int job = 0; job < 5; ++job)
+    jobs.push_back(victim.async(200ms, [&log] { log('v'); }));
+  gate.set_value();
+  blocker.get();
+  for (auto &&job : jobs)
+    job.get();
+
+  /* the demoted work of the greedy tenant ran after the victim's */
+  ASSERT_EQ(order.size(), 15u);
+  const auto demoted = greedy.usage().demoted;
+  EXPECT_GT(demoted, 0u);
+  for (size_t i = order.size() - demoted; i < order.size(); ++i)
+    EXPECT_EQ(order[i], 'g');
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
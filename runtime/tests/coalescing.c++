@@ -0,0 +1,100 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "runtime/dispatch.h"
+
+/* Tests of coalesced jobs. Run with ATLAS_BACKEND=NONE without kernel
+ * support. */
+
+using namespace std::chrono;
+
+/* a job type per tag, which records that it ran */
+template <char Tag> struct append {
+  std::string *order;
+  void operator()() const { order->push_back(Tag); }
+};
+
+/* Queues jobs of the types a, b, a behind a job waiting for the returned
+ * gate, and returns their futures. */
+static std::promise<void> submit(atlas::dispatch_queue &queue,
+                                 std::string &order,
+                                 std::vector<std::future<void>> &futures) {
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  futures.push_back(queue.async(1s, [open] { open.wait(); }));
+  while (queue.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  futures.push_back(queue.async(1s, append<'a'>{&order}));
+  futures.push_back(queue.async(1s, append<'b'>{&order}));
+  futures.push_back(queue.async(1s, append<'a'>{&order}));
+  return gate;
+}
+
+TEST(CoalesceTest, SerialQueueKeepsOrder) {
+  atlas::dispatch_queue queue("serial");
+  queue.coalesce(1s);
+  std::string order;
+  std::vector<std::future<void>> futures;
+  auto gate = submit(queue, order, futures);
+  EXPECT_EQ(queue.occupancy(), 3u);
+
+  gate.set_value();
+  for (auto &&future : futures)
+    EXPECT_NO_THROW(future.get());
+  EXPECT_EQ(order, "aba");
+  EXPECT_EQ(queue.occupancy(), 0u);
+}
+
+TEST(CoalesceTest, SerialQueueJoinsLastJob) {
+  atlas::dispatch_queue queue("serial");
+  queue.coalesce(1s);
+  std::string order;
+  std::vector<std::future<void>> futures;
+  auto gate = submit(queue, order, futures);
+  futures.push_back(queue.async(1s, append<'a'>{&order}));
+  futures.push_back(queue.async(1s, append<'b'>{&order}));
+  EXPECT_EQ(queue.occupancy(), 5u);
+
+  gate.set_value();
+  for (auto &&future : futures)
+    EXPECT_NO_THROW(future.get());
+  EXPECT_EQ(order, "abaab");
+}
+
+TEST(CoalesceTest, SharedWorkersRunByDeadline) {
+  atlas::dispatch_queue queue("parallel", {0});
+  queue.coalesce(1s);
+  std::string order;
+  std::vector<std::future<void>> futures;
+  auto gate = submit(queue, order, futures);
+  EXPECT_EQ(queue.occupancy(), 3u);
+
+  /* the second a joins the first, which is due before b */
+  gate.set_value();
+  for (auto &&future : futures)
+    EXPECT_NO_THROW(future.get());
+  EXPECT_EQ(order, "aab");
+  EXPECT_EQ(queue.occupancy(), 0u);
+}
+
+TEST(CoalesceTest, Off) {
+  atlas::dispatch_queue queue("parallel", {0});
+  std::string order;
+  std::vector<std::future<void>> futures;
+  auto gate = submit(queue, order, futures);
+
+  gate.set_value();
+  for (auto &&future : futures)
+    EXPECT_NO_THROW(future.get());
+  EXPECT_EQ(order, "aba");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -32,6 +32,35 @@ TEST(IdTest, FunctionObjectNotIdentical) {
                atlas::_::work_type(r));
 }
 
+struct decode {
+  static constexpr uint64_t id = 0x6465636f6465;
+};
+struct encode {
+  static constexpr uint64_t id = 0x656e636f6465;
+};
+constexpr uint64_t decode::id;
+constexpr uint64_t encode::id;
+using decode_job = atlas::job_class<decode, size_t, int>;
+using encode_job = atlas::job_class<encode, size_t, int>;
+
+static_assert(decode_job::count == 2, "Metric count is not static.");
+static_assert(atlas::job_class<decode>::count == 0, "Metric count is not static.");
+
+TEST(IdTest, JobClassIdentical) {
+  EXPECT_EQ(decode_job::type, decode::id);
+  EXPECT_EQ(decode_job::type, (atlas::job_class<decode, double>::type));
+}
+
+TEST(IdTest, JobClassNotIdentical) {
+  EXPECT_NE(decode_job::type, encode_job::type);
+}
+
+TEST(IdTest, JobClassMetrics) {
+  const decode_job job{4096, -3};
+  EXPECT_EQ(job.metrics()[0], 4096.0);
+  EXPECT_EQ(job.metrics()[1], -3.0);
+}
+
 static void function() {}
 
 int main(int argc, char **argv) {
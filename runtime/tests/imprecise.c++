@@ -0,0 +1,81 @@
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "runtime/dispatch.h"
+
+/* Tests of imprecise jobs. Run with ATLAS_BACKEND=NONE without kernel
+ * support, where the optional parts are predicted to take no time. */
+
+using namespace std::chrono;
+
+/* a part per tag, which records that it ran */
+template <char Tag> struct append {
+  std::string *order;
+  void operator()() const { order->push_back(Tag); }
+};
+
+TEST(ImpreciseTest, PartsRunInOrderBeforeDeadline) {
+  atlas::dispatch_queue queue("serial");
+  std::string order;
+  auto ran = queue.imprecise(1s, nullptr, 0, append<'m'>{&order},
+                             {{nullptr, 0, append<'1'>{&order}},
+                              {nullptr, 0, append<'2'>{&order}},
+                              {nullptr, 0, append<'3'>{&order}}});
+  EXPECT_EQ(ran.get(), 3u);
+  EXPECT_EQ(order, "m123");
+}
+
+TEST(ImpreciseTest, NoPartRunsAfterDeadline) {
+  atlas::dispatch_queue queue("serial");
+  std::string order;
+  auto ran = queue.imprecise(atlas::clock::now() - 1ms, nullptr, 0,
+                             append<'m'>{&order},
+                             {{nullptr, 0, append<'1'>{&order}}});
+  EXPECT_EQ(ran.get(), 0u);
+  EXPECT_EQ(order, "m");
+}
+
+TEST(ImpreciseTest, PartsStopAtDeadline) {
+  atlas::dispatch_queue queue("serial");
+  std::string order;
+  auto ran = queue.imprecise(
+      100ms, nullptr, 0, append<'m'>{&order},
+      {{nullptr, 0,
+        [&order] {
+          std::this_thread::sleep_for(150ms);
+          order.push_back('1');
+        }},
+       {nullptr, 0, append<'2'>{&order}}});
+  EXPECT_EQ(ran.get(), 1u);
+  EXPECT_EQ(order, "m1");
+}
+
+TEST(ImpreciseTest, MandatoryExceptionPropagates) {
+  atlas::dispatch_queue queue("serial");
+  std::string order;
+  auto ran = queue.imprecise(
+      1s, nullptr, 0, [] { throw std::runtime_error("mandatory"); },
+      {{nullptr, 0, append<'1'>{&order}}});
+  EXPECT_THROW(ran.get(), std::runtime_error);
+  EXPECT_EQ(order, "");
+}
+
+TEST(ImpreciseTest, SharedWorkers) {
+  atlas::dispatch_queue queue("parallel", {0});
+  std::string order;
+  auto ran = queue.imprecise(1s, nullptr, 0, append<'m'>{&order},
+                             {{nullptr, 0, append<'1'>{&order}},
+                              {nullptr, 0, append<'2'>{&order}}});
+  EXPECT_EQ(ran.get(), 2u);
+  EXPECT_EQ(order, "m12");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,62 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "runtime/dispatch.h"
+
+/* Tests of dispatch_sync() running blocks on the calling thread. Run with
+ * ATLAS_BACKEND=NONE without kernel support. */
+
+using namespace std::chrono;
+
+TEST(InlineSyncTest, RunsOnCallingThread) {
+  atlas::dispatch_queue queue("serial");
+  std::thread::id thread;
+  const atlas::dispatch_queue *current = nullptr;
+  queue.sync([&thread, &current] {
+    thread = std::this_thread::get_id();
+    current = atlas::dispatch_queue::current();
+  });
+  EXPECT_EQ(thread, std::this_thread::get_id());
+  EXPECT_EQ(current, &queue);
+  EXPECT_EQ(atlas::dispatch_queue::current(), nullptr);
+}
+
+TEST(InlineSyncTest, QueuedWorkWaitsForRelease) {
+  atlas::dispatch_queue queue("serial");
+  std::string order;
+  std::future<void> queued;
+  queue.sync([&queue, &order, &queued] {
+    queued = queue.async(1s, [&order] { order.push_back('q'); });
+    std::this_thread::sleep_for(10ms);
+    order.push_back('s');
+  });
+  queued.get();
+  EXPECT_EQ(order, "sq");
+}
+
+TEST(InlineSyncTest, BusyQueueDispatches) {
+  atlas::dispatch_queue queue("serial");
+  std::promise<void> gate;
+  auto open = gate.get_future().share();
+  auto blocker = queue.async(1s, [open] { open.wait(); });
+  while (queue.occupancy() > 0)
+    std::this_thread::sleep_for(100us);
+
+  std::thread opener([&gate] {
+    std::this_thread::sleep_for(10ms);
+    gate.set_value();
+  });
+  std::thread::id thread;
+  queue.sync([&thread] { thread = std::this_thread::get_id(); });
+  EXPECT_NE(thread, std::this_thread::get_id());
+  opener.join();
+  blocker.get();
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
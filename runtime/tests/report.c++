@@ -0,0 +1,73 @@
+#include <chrono>
+#include <future>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+#include "runtime/dispatch.h"
+
+/* Tests of the context of the running job. Run with ATLAS_BACKEND=NONE
+ * without kernel support, where no job is real-time. */
+
+using namespace std::chrono;
+using atlas::dispatch_queue;
+
+TEST(ReportTest, OffJob) {
+  const double metrics[] = {1.0};
+  EXPECT_EQ(dispatch_queue::report(metrics, 1), 0ns);
+  EXPECT_EQ(dispatch_queue::report(0.5), 0ns);
+  EXPECT_EQ(dispatch_queue::report(1.0), 0ns);
+}
+
+TEST(ReportTest, BestEffortJob) {
+  dispatch_queue queue("serial");
+  nanoseconds rest{-1};
+  queue.async(1s, [&rest] { rest = dispatch_queue::report(0.5); }).get();
+  EXPECT_EQ(rest, 0ns);
+}
+
+TEST(ReportTest, RejectsProgressOutOfRange) {
+  EXPECT_THROW(dispatch_queue::report(0.0), std::runtime_error);
+  EXPECT_THROW(dispatch_queue::report(-1.0), std::runtime_error);
+  EXPECT_THROW(dispatch_queue::report(1.5), std::runtime_error);
+}
+
+TEST(CurrentTest, OffQueue) {
+  EXPECT_EQ(dispatch_queue::current(), nullptr);
+}
+
+TEST(CurrentTest, SerialQueue) {
+  dispatch_queue queue("serial");
+  const dispatch_queue *current = nullptr;
+  queue.async(1s, [&current] { current = dispatch_queue::current(); }).get();
+  EXPECT_EQ(current, &queue);
+}
+
+TEST(CurrentTest, PooledQueues) {
+  /* both queues share the worker of CPU 0 */
+  dispatch_queue first("first", {0});
+  dispatch_queue second("second", {0});
+  const dispatch_queue *ran_first = nullptr, *ran_second = nullptr;
+  auto a = first.async(
+      1s, [&ran_first] { ran_first = dispatch_queue::current(); });
+  auto b = second.async(
+      1s, [&ran_second] { ran_second = dispatch_queue::current(); });
+  a.get();
+  b.get();
+  EXPECT_EQ(ran_first, &first);
+  EXPECT_EQ(ran_second, &second);
+}
+
+TEST(CurrentTest, TargetedQueue) {
+  dispatch_queue pool("pool", {0});
+  dispatch_queue queue("serial", pool);
+  const dispatch_queue *current = nullptr, *target = nullptr;
+  queue.async(1s, [&current] { current = dispatch_queue::current(); }).get();
+  pool.async(1s, [&target] { target = dispatch_queue::current(); }).get();
+  EXPECT_EQ(current, &queue);
+  EXPECT_EQ(target, &pool);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "runtime/dispatch.h"
 
@@ -16,6 +18,11 @@ static void funcref(int &i) {
   std::cout << " " << i++ << std::endl;
 }
 
+struct frame {
+  static constexpr uint64_t id = 0x6672616d65;
+};
+using frame_job = atlas::job_class<frame, int, int>;
+
 int main() {
   using namespace std::chrono;
   using namespace std::literals::chrono_literals;
@@ -64,6 +71,54 @@ int main() {
   queue.async(steady_clock::now() + 1s, static_cast<const double *>(nullptr),
               size_t(0), func2);
   std::cout << 5 << std::endl;
+  queue.sync(steady_clock::now() + 1s, frame_job{640 * 480, 3}, func, 6);
+  queue.async(1s, frame_job{1920 * 1080, 1},
+              [] { std::cout << "job class" << std::endl; });
+  std::cout << 6 << std::endl;
+  const auto estimate = queue.estimate(frame_job{640 * 480, 3});
+  std::array<std::chrono::nanoseconds, 2> exectimes;
+  queue.estimate(std::array<frame_job, 2>{{{640 * 480, 3}, {1920 * 1080, 1}}},
+                 exectimes);
+  std::cout << "estimate " << estimate.exectime.count() << "ns, backlog "
+            << estimate.backlog.count() << "ns" << std::endl;
+
+  const double layers[] = {1, 2};
+  auto refined = queue.imprecise(
+      1s, frame_job{640 * 480, 3}, [] { std::cout << "base" << std::endl; },
+      {{&layers[0], 1, [] { std::cout << "refinement 1" << std::endl; }},
+       {&layers[1], 1, [] { std::cout << "refinement 2" << std::endl; }}});
+  std::cout << refined.get() << " refinements" << std::endl;
+  auto late = queue.imprecise(
+      steady_clock::now() - 1s, frame_job{640 * 480, 3}, [] {},
+      {{frame_job{640 * 480, 3}, [] { std::cout << "late" << std::endl; }}});
+  std::cout << late.get() << " refinements when late" << std::endl;
+
+  queue.async(1s, frame_job{1920 * 1080, 1}, [&queue] {
+    /* the rest of the job depends on the frame type, e.g. intra frames */
+    const double intra = 1;
+    const auto rest = atlas::dispatch_queue::report(&intra, 1);
+    std::cout << "rest " << rest.count() << "ns, half done: "
+              << atlas::dispatch_queue::report(0.5).count() << "ns, on "
+              << ((atlas::dispatch_queue::current() == &queue) ? "its"
+                                                                 : "another")
+              << " queue" << std::endl;
+  }).get();
+
+  {
+    const auto start = steady_clock::now();
+    std::vector<atlas::dispatch_queue> targeted;
+    for (int i = 0; i < 10; ++i)
+      targeted.emplace_back("targeted " + std::to_string(i), queue);
+    std::cout << "10 targeted queues created in "
+              << duration_cast<microseconds>(steady_clock::now() - start).count()
+              << "us" << std::endl;
+    std::vector<std::future<void>> order;
+    for (int i = 0; i < 3; ++i)
+      order.push_back(targeted.front().async(
+          1s, [i] { std::cout << "targeted " << i << std::endl; }));
+    for (auto &&future : order)
+      future.get();
+  }
   int i = 3;
   queue.sync(funcref, std::ref(i));
   std::cout << "after: " << i << std::endl;
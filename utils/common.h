@@ -97,6 +97,11 @@ enum class attribute {
 std::ostream &operator<<(std::ostream &os, const enum attribute &attr);
 
 template <typename T> void set_procfsparam(enum attribute attr, T value) {
+#ifdef ATLAS_SIMULATOR
+  /* the simulator has no scheduler tunables */
+  (void)attr;
+  (void)value;
+#else
   std::ostringstream path;
   path << "/proc/sys/kernel/sched_atlas_" << attr;
 
@@ -104,5 +109,6 @@ template <typename T> void set_procfsparam(enum attribute attr, T value) {
   file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
   file << value << std::endl;
+#endif
 }
 